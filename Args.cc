@@ -11,7 +11,7 @@ static void Usage(const char* name);
 i32 ParseArgs(i32 argc, char* argv[])
 {
   i32 ch  {};
-  while (ch = getopt(argc, (char* const*)argv, "cho:"), ch != -1)
+  while (ch = getopt(argc, (char* const*)argv, "cho:s"), ch != -1)
   {
     switch (ch)
     {
@@ -24,6 +24,9 @@ i32 ParseArgs(i32 argc, char* argv[])
     case ('o'):
       g_Args.m_ConfigDir = optarg;
       break;
+    case ('s'):
+      g_Args.m_RenderStats = true;
+      break;
     default:
       return (1);
     }
@@ -71,6 +74,7 @@ static void Usage(const char* name)
     "  -c           Create files if they don't exist\n"
     "  -h           Display this help information\n"
     "  -o dir       Use a different config directory\n"
+    "  -s           Print rendering statistics on exit\n"
     "\n"
     "Additional resources:\n"
     "  Source code  https://git.tirimid.net/nimpedpp\n",
@@ -6,7 +6,9 @@
 #include <Input.hh>
 #include <Options.hh>
 #include <Prompt.hh>
+#include <Regex.hh>
 #include <Render.hh>
+#include <Search.hh>
 
 namespace Binds
 {
@@ -41,6 +43,11 @@ static void PromptDeleteWord();
 static void Newline();
 static void Undo();
 static void Redo();
+static void Earlier();
+static void Later();
+static void NextBranch();
+static void PreviousBranch();
+static void GotoHistory();
 static void NewFrame();
 static void KillFrame();
 static void Save();
@@ -48,6 +55,9 @@ static void Focus();
 static void OpenFile();
 static void Search();
 static void ReverseSearch();
+static void RegexSearch();
+static void ReverseRegexSearch();
+static void ReplaceAll();
 static void FrameLeftParen();
 static void FrameLeftBracket();
 static void FrameLeftBrace();
@@ -57,6 +67,10 @@ static void PromptLeftBracket();
 static void PromptLeftBrace();
 static void PromptDoubleQuote();
 static void Paste();
+static void FrameBracketedPaste();
+static void PromptBracketedPaste();
+static void NumberPromptBracketedPaste();
+static void IgnoreBracketedPaste();
 static void CopyLine();
 static void CutLine();
 static void CopyLines();
@@ -70,46 +84,161 @@ static void ExecuteMacro();
 static void Help();
 static void Tab();
 static void Complete();
-
+static void ExecuteMacroRuns();
+static void RenderPromptEditor();
+static void SearchPrompt(const char* prompt, bool reverse);
+static u32  WordBegin(const Frame& f, u32 pos);
+
+}
+
+static constexpr KeymapBind  BASE_BINDS[] =
+{
+  {KEYBIND::FRAME_MOVE_LEFT,       Binds::FrameMoveLeft},
+  {KEYBIND::FRAME_MOVE_RIGHT,      Binds::FrameMoveRight},
+  {KEYBIND::FRAME_MOVE_UP,         Binds::FrameMoveUp},
+  {KEYBIND::FRAME_MOVE_DOWN,       Binds::FrameMoveDown},
+  {KEYBIND::FRAME_MOVE_START,      Binds::FrameMoveStart},
+  {KEYBIND::FRAME_MOVE_END,        Binds::FrameMoveEnd},
+  {KEYBIND::FRAME_MOVE_WORD_LEFT,  Binds::FrameMoveWordLeft},
+  {KEYBIND::FRAME_MOVE_WORD_RIGHT, Binds::FrameMoveWordRight},
+  {KEYBIND::QUIT,                  Binds::Quit},
+  {KEYBIND::NEXT,                  Binds::Next},
+  {KEYBIND::PREVIOUS,              Binds::Previous},
+  {KEYBIND::WRITE_MODE,            Binds::WriteMode},
+  {KEYBIND::UNDO,                  Binds::Undo},
+  {KEYBIND::REDO,                  Binds::Redo},
+  {KEYBIND::EARLIER,               Binds::Earlier},
+  {KEYBIND::LATER,                 Binds::Later},
+  {KEYBIND::NEXT_BRANCH,           Binds::NextBranch},
+  {KEYBIND::PREVIOUS_BRANCH,       Binds::PreviousBranch},
+  {KEYBIND::GOTO_HISTORY,          Binds::GotoHistory},
+  {KEYBIND::NEW_FRAME,             Binds::NewFrame},
+  {KEYBIND::KILL_FRAME,            Binds::KillFrame},
+  {KEYBIND::SAVE,                  Binds::Save},
+  {KEYBIND::FOCUS,                 Binds::Focus},
+  {KEYBIND::OPEN_FILE,             Binds::OpenFile},
+  {KEYBIND::SEARCH,                Binds::Search},
+  {KEYBIND::REVERSE_SEARCH,        Binds::ReverseSearch},
+  {KEYBIND::REGEX_SEARCH,          Binds::RegexSearch},
+  {KEYBIND::REVERSE_REGEX_SEARCH,  Binds::ReverseRegexSearch},
+  {KEYBIND::REPLACE_ALL,           Binds::ReplaceAll},
+  {KEYBIND::PASTE,                 Binds::Paste},
+  {KEYBIND::COPY_LINE,             Binds::CopyLine},
+  {KEYBIND::CUT_LINE,              Binds::CutLine},
+  {KEYBIND::COPY_LINES,            Binds::CopyLines},
+  {KEYBIND::CUT_LINES,             Binds::CutLines},
+  {KEYBIND::COPY_UNTIL_LINE,       Binds::CopyUntilLine},
+  {KEYBIND::CUT_UNTIL_LINE,        Binds::CutUntilLine},
+  {KEYBIND::ZOOM,                  Binds::Zoom},
+  {KEYBIND::GOTO,                  Binds::Goto},
+  {KEYBIND::RECORD_MACRO,          Binds::RecordMacro},
+  {KEYBIND::EXECUTE_MACRO,         Binds::ExecuteMacro},
+  {KEYBIND::EXECUTE_MACRO_RUNS,    Binds::ExecuteMacroRuns},
+  {KEYBIND::HELP,                  Binds::Help},
+  {KEYBIND::BRACKETED_PASTE,       Binds::FrameBracketedPaste}
+};
+
+static constexpr KeymapBind  WRITE_BINDS[] =
+{
+  {KEYBIND::EXIT,            Binds::Exit},
+  {KEYBIND::DELETE_FRONT,    Binds::FrameDeleteFront},
+  {KEYBIND::DELETE_BACK,     Binds::FrameDeleteBack},
+  {KEYBIND::DELETE_WORD,     Binds::FrameDeleteWord},
+  {KEYBIND::NEWLINE,         Binds::Newline},
+  {KEYBIND::LEFT_PAREN,      Binds::FrameLeftParen},
+  {KEYBIND::LEFT_BRACKET,    Binds::FrameLeftBracket},
+  {KEYBIND::LEFT_BRACE,      Binds::FrameLeftBrace},
+  {KEYBIND::DOUBLE_QUOTE,    Binds::FrameDoubleQuote},
+  {KEYBIND::TAB,             Binds::Tab},
+  {KEYBIND::BRACKETED_PASTE, Binds::FrameBracketedPaste}
+};
+
+static constexpr KeymapBind  PROMPT_BINDS[] =
+{
+  {KEYBIND::EXIT,                   Binds::QuitPromptFail},
+  {KEYBIND::NEWLINE,                Binds::QuitPromptSuccess},
+  {KEYBIND::PROMPT_MOVE_LEFT,       Binds::PromptMoveLeft},
+  {KEYBIND::PROMPT_MOVE_RIGHT,      Binds::PromptMoveRight},
+  {KEYBIND::PROMPT_MOVE_START,      Binds::PromptMoveStart},
+  {KEYBIND::PROMPT_MOVE_END,        Binds::PromptMoveEnd},
+  {KEYBIND::PROMPT_MOVE_WORD_LEFT,  Binds::PromptMoveWordLeft},
+  {KEYBIND::PROMPT_MOVE_WORD_RIGHT, Binds::PromptMoveWordRight},
+  {KEYBIND::DELETE_FRONT,           Binds::PromptDeleteFront},
+  {KEYBIND::DELETE_BACK,            Binds::PromptDeleteBack},
+  {KEYBIND::DELETE_WORD,            Binds::PromptDeleteWord},
+  {KEYBIND::LEFT_PAREN,             Binds::PromptLeftParen},
+  {KEYBIND::LEFT_BRACKET,           Binds::PromptLeftBracket},
+  {KEYBIND::LEFT_BRACE,             Binds::PromptLeftBrace},
+  {KEYBIND::DOUBLE_QUOTE,           Binds::PromptDoubleQuote},
+  {KEYBIND::BRACKETED_PASTE,        Binds::PromptBracketedPaste}
+};
+
+static constexpr KeymapBind  PATH_PROMPT_BINDS[] =
+{
+  {KEYBIND::EXIT,                   Binds::QuitPromptFail},
+  {KEYBIND::NEWLINE,                Binds::QuitPromptSuccess},
+  {KEYBIND::PROMPT_MOVE_LEFT,       Binds::PromptMoveLeft},
+  {KEYBIND::PROMPT_MOVE_RIGHT,      Binds::PromptMoveRight},
+  {KEYBIND::PROMPT_MOVE_START,      Binds::PromptMoveStart},
+  {KEYBIND::PROMPT_MOVE_END,        Binds::PromptMoveEnd},
+  {KEYBIND::PROMPT_MOVE_WORD_LEFT,  Binds::PromptMoveWordLeft},
+  {KEYBIND::PROMPT_MOVE_WORD_RIGHT, Binds::PromptMoveWordRight},
+  {KEYBIND::DELETE_FRONT,           Binds::PromptDeleteFront},
+  {KEYBIND::DELETE_BACK,            Binds::PromptDeleteBack},
+  {KEYBIND::DELETE_WORD,            Binds::PromptDeleteWord},
+  {KEYBIND::COMPLETE,               Binds::Complete},
+  {KEYBIND::LEFT_PAREN,             Binds::PromptLeftParen},
+  {KEYBIND::LEFT_BRACKET,           Binds::PromptLeftBracket},
+  {KEYBIND::LEFT_BRACE,             Binds::PromptLeftBrace},
+  {KEYBIND::DOUBLE_QUOTE,           Binds::PromptDoubleQuote},
+  {KEYBIND::BRACKETED_PASTE,        Binds::PromptBracketedPaste}
+};
+
+static constexpr KeymapBind  CONFIRM_PROMPT_BINDS[] =
+{
+  {KEYBIND::PROMPT_YES,      Binds::QuitPromptSuccess},
+  {KEYBIND::PROMPT_NO,       Binds::QuitPromptFail},
+  {KEYBIND::EXIT,            Binds::QuitPromptFail},
+  {KEYBIND::BRACKETED_PASTE, Binds::IgnoreBracketedPaste}
+};
+
+static constexpr KeymapBind  NUMBER_PROMPT_BINDS[] =
+{
+  {KEYBIND::EXIT,                   Binds::QuitPromptFail},
+  {KEYBIND::NEWLINE,                Binds::QuitPromptSuccess},
+  {KEYBIND::PROMPT_MOVE_LEFT,       Binds::PromptMoveLeft},
+  {KEYBIND::PROMPT_MOVE_RIGHT,      Binds::PromptMoveRight},
+  {KEYBIND::PROMPT_MOVE_START,      Binds::PromptMoveStart},
+  {KEYBIND::PROMPT_MOVE_END,        Binds::PromptMoveEnd},
+  {KEYBIND::PROMPT_MOVE_WORD_LEFT,  Binds::PromptMoveWordLeft},
+  {KEYBIND::PROMPT_MOVE_WORD_RIGHT, Binds::PromptMoveWordRight},
+  {KEYBIND::DELETE_FRONT,           Binds::PromptDeleteFront},
+  {KEYBIND::DELETE_BACK,            Binds::PromptDeleteBack},
+  {KEYBIND::DELETE_WORD,            Binds::PromptDeleteWord},
+  {KEYBIND::BRACKETED_PASTE,        Binds::NumberPromptBracketedPaste}
+};
+
+static Keymap  g_BaseKeymap;
+static Keymap  g_WriteKeymap;
+static Keymap  g_PromptKeymap;
+static Keymap  g_PathPromptKeymap;
+static Keymap  g_ConfirmPromptKeymap;
+static Keymap  g_NumberPromptKeymap;
+
+// the keymap of every mode is compiled up front, so that switching modes only switches keymaps
+void  InitBinds()
+{
+  g_BaseKeymap = CompileKeymap(BASE_BINDS, ARRAY_SIZE(BASE_BINDS));
+  g_WriteKeymap = CompileKeymap(WRITE_BINDS, ARRAY_SIZE(WRITE_BINDS));
+  g_PromptKeymap = CompileKeymap(PROMPT_BINDS, ARRAY_SIZE(PROMPT_BINDS));
+  g_PathPromptKeymap = CompileKeymap(PATH_PROMPT_BINDS, ARRAY_SIZE(PATH_PROMPT_BINDS));
+  g_ConfirmPromptKeymap = CompileKeymap(CONFIRM_PROMPT_BINDS, ARRAY_SIZE(CONFIRM_PROMPT_BINDS));
+  g_NumberPromptKeymap = CompileKeymap(NUMBER_PROMPT_BINDS, ARRAY_SIZE(NUMBER_PROMPT_BINDS));
 }
 
 void  InstallBaseBinds()
 {
-  Unbind();
-  Bind(KEYBIND::FRAME_MOVE_LEFT,        Binds::FrameMoveLeft);
-  Bind(KEYBIND::FRAME_MOVE_RIGHT,       Binds::FrameMoveRight);
-  Bind(KEYBIND::FRAME_MOVE_UP,          Binds::FrameMoveUp);
-  Bind(KEYBIND::FRAME_MOVE_DOWN,        Binds::FrameMoveDown);
-  Bind(KEYBIND::FRAME_MOVE_START,       Binds::FrameMoveStart);
-  Bind(KEYBIND::FRAME_MOVE_END,         Binds::FrameMoveEnd);
-  Bind(KEYBIND::FRAME_MOVE_WORD_LEFT,   Binds::FrameMoveWordLeft);
-  Bind(KEYBIND::FRAME_MOVE_WORD_RIGHT,  Binds::FrameMoveWordRight);
-  Bind(KEYBIND::QUIT,                   Binds::Quit);
-  Bind(KEYBIND::NEXT,                   Binds::Next);
-  Bind(KEYBIND::PREVIOUS,               Binds::Previous);
-  Bind(KEYBIND::WRITE_MODE,             Binds::WriteMode);
-  Bind(KEYBIND::UNDO,                   Binds::Undo);
-  Bind(KEYBIND::REDO,                   Binds::Redo);
-  Bind(KEYBIND::NEW_FRAME,              Binds::NewFrame);
-  Bind(KEYBIND::KILL_FRAME,             Binds::KillFrame);
-  Bind(KEYBIND::SAVE,                   Binds::Save);
-  Bind(KEYBIND::FOCUS,                  Binds::Focus);
-  Bind(KEYBIND::OPEN_FILE,              Binds::OpenFile);
-  Bind(KEYBIND::SEARCH,                 Binds::Search);
-  Bind(KEYBIND::REVERSE_SEARCH,         Binds::ReverseSearch);
-  Bind(KEYBIND::PASTE,                  Binds::Paste);
-  Bind(KEYBIND::COPY_LINE,              Binds::CopyLine);
-  Bind(KEYBIND::CUT_LINE,               Binds::CutLine);
-  Bind(KEYBIND::COPY_LINES,             Binds::CopyLines);
-  Bind(KEYBIND::CUT_LINES,              Binds::CutLines);
-  Bind(KEYBIND::COPY_UNTIL_LINE,        Binds::CopyUntilLine);
-  Bind(KEYBIND::CUT_UNTIL_LINE,         Binds::CutUntilLine);
-  Bind(KEYBIND::ZOOM,                   Binds::Zoom);
-  Bind(KEYBIND::GOTO,                   Binds::Goto);
-  Bind(KEYBIND::RECORD_MACRO,           Binds::RecordMacro);
-  Bind(KEYBIND::EXECUTE_MACRO,          Binds::ExecuteMacro);
-  Bind(KEYBIND::HELP,                   Binds::Help);
-  OrganizeInputs();
+  UseKeymap(&g_BaseKeymap);
   
   g_Editor.m_WriteInput = false;
   
@@ -118,18 +247,7 @@ void  InstallBaseBinds()
 
 void  InstallWriteBinds()
 {
-  Unbind();
-  Bind(KEYBIND::EXIT,         Binds::Exit);
-  Bind(KEYBIND::DELETE_FRONT, Binds::FrameDeleteFront);
-  Bind(KEYBIND::DELETE_BACK,  Binds::FrameDeleteBack);
-  Bind(KEYBIND::DELETE_WORD,  Binds::FrameDeleteWord);
-  Bind(KEYBIND::NEWLINE,      Binds::Newline);
-  Bind(KEYBIND::LEFT_PAREN,   Binds::FrameLeftParen);
-  Bind(KEYBIND::LEFT_BRACKET, Binds::FrameLeftBracket);
-  Bind(KEYBIND::LEFT_BRACE,   Binds::FrameLeftBrace);
-  Bind(KEYBIND::DOUBLE_QUOTE, Binds::FrameDoubleQuote);
-  Bind(KEYBIND::TAB,          Binds::Tab);
-  OrganizeInputs();
+  UseKeymap(&g_WriteKeymap);
   
   g_Editor.m_WriteInput = true;
   
@@ -138,77 +256,28 @@ void  InstallWriteBinds()
 
 void  InstallPromptBinds()
 {
-  Unbind();
-  Bind(KEYBIND::EXIT,                   Binds::QuitPromptFail);
-  Bind(KEYBIND::NEWLINE,                Binds::QuitPromptSuccess);
-  Bind(KEYBIND::PROMPT_MOVE_LEFT,       Binds::PromptMoveLeft);
-  Bind(KEYBIND::PROMPT_MOVE_RIGHT,      Binds::PromptMoveRight);
-  Bind(KEYBIND::PROMPT_MOVE_START,      Binds::PromptMoveStart);
-  Bind(KEYBIND::PROMPT_MOVE_END,        Binds::PromptMoveEnd);
-  Bind(KEYBIND::PROMPT_MOVE_WORD_LEFT,  Binds::PromptMoveWordLeft);
-  Bind(KEYBIND::PROMPT_MOVE_WORD_RIGHT, Binds::PromptMoveWordRight);
-  Bind(KEYBIND::DELETE_FRONT,           Binds::PromptDeleteFront);
-  Bind(KEYBIND::DELETE_BACK,            Binds::PromptDeleteBack);
-  Bind(KEYBIND::DELETE_WORD,            Binds::PromptDeleteWord);
-  Bind(KEYBIND::LEFT_PAREN,             Binds::PromptLeftParen);
-  Bind(KEYBIND::LEFT_BRACKET,           Binds::PromptLeftBracket);
-  Bind(KEYBIND::LEFT_BRACE,             Binds::PromptLeftBrace);
-  Bind(KEYBIND::DOUBLE_QUOTE,           Binds::PromptDoubleQuote);
-  OrganizeInputs();
+  UseKeymap(&g_PromptKeymap);
   
   g_Editor.m_WriteInput = false;
 }
 
 void  InstallPathPromptBinds()
 {
-  Unbind();
-  Bind(KEYBIND::EXIT,                   Binds::QuitPromptFail);
-  Bind(KEYBIND::NEWLINE,                Binds::QuitPromptSuccess);
-  Bind(KEYBIND::PROMPT_MOVE_LEFT,       Binds::PromptMoveLeft);
-  Bind(KEYBIND::PROMPT_MOVE_RIGHT,      Binds::PromptMoveRight);
-  Bind(KEYBIND::PROMPT_MOVE_START,      Binds::PromptMoveStart);
-  Bind(KEYBIND::PROMPT_MOVE_END,        Binds::PromptMoveEnd);
-  Bind(KEYBIND::PROMPT_MOVE_WORD_LEFT,  Binds::PromptMoveWordLeft);
-  Bind(KEYBIND::PROMPT_MOVE_WORD_RIGHT, Binds::PromptMoveWordRight);
-  Bind(KEYBIND::DELETE_FRONT,           Binds::PromptDeleteFront);
-  Bind(KEYBIND::DELETE_BACK,            Binds::PromptDeleteBack);
-  Bind(KEYBIND::DELETE_WORD,            Binds::PromptDeleteWord);
-  Bind(KEYBIND::COMPLETE,               Binds::Complete);
-  Bind(KEYBIND::LEFT_PAREN,             Binds::PromptLeftParen);
-  Bind(KEYBIND::LEFT_BRACKET,           Binds::PromptLeftBracket);
-  Bind(KEYBIND::LEFT_BRACE,             Binds::PromptLeftBrace);
-  Bind(KEYBIND::DOUBLE_QUOTE,           Binds::PromptDoubleQuote);
-  OrganizeInputs();
+  UseKeymap(&g_PathPromptKeymap);
   
   g_Editor.m_WriteInput = false;
 }
 
 void  InstallConfirmPromptBinds()
 {
-  Unbind();
-  Bind(KEYBIND::PROMPT_YES, Binds::QuitPromptSuccess);
-  Bind(KEYBIND::PROMPT_NO,  Binds::QuitPromptFail);
-  Bind(KEYBIND::EXIT,       Binds::QuitPromptFail);
-  OrganizeInputs();
+  UseKeymap(&g_ConfirmPromptKeymap);
   
   g_Editor.m_WriteInput = false;
 }
 
 void  InstallNumberPromptBinds()
 {
-  Unbind();
-  Bind(KEYBIND::EXIT,                   Binds::QuitPromptFail);
-  Bind(KEYBIND::NEWLINE,                Binds::QuitPromptSuccess);
-  Bind(KEYBIND::PROMPT_MOVE_LEFT,       Binds::PromptMoveLeft);
-  Bind(KEYBIND::PROMPT_MOVE_RIGHT,      Binds::PromptMoveRight);
-  Bind(KEYBIND::PROMPT_MOVE_START,      Binds::PromptMoveStart);
-  Bind(KEYBIND::PROMPT_MOVE_END,        Binds::PromptMoveEnd);
-  Bind(KEYBIND::PROMPT_MOVE_WORD_LEFT,  Binds::PromptMoveWordLeft);
-  Bind(KEYBIND::PROMPT_MOVE_WORD_RIGHT, Binds::PromptMoveWordRight);
-  Bind(KEYBIND::DELETE_FRONT,           Binds::PromptDeleteFront);
-  Bind(KEYBIND::DELETE_BACK,            Binds::PromptDeleteBack);
-  Bind(KEYBIND::DELETE_WORD,            Binds::PromptDeleteWord);
-  OrganizeInputs();
+  UseKeymap(&g_NumberPromptKeymap);
   
   g_Editor.m_WriteInput = false;
 }
@@ -216,6 +285,8 @@ void  InstallNumberPromptBinds()
 namespace Binds
 {
 
+// motions which can't move stop any macro being executed, so that a macro repeated many times ends at the end of
+// its text
 static void FrameMoveLeft()
 {
   Frame&  f = CurrentFrame();
@@ -224,6 +295,10 @@ static void FrameMoveLeft()
     --f.m_Cursor;
     f.SaveCursor();
   }
+  else
+  {
+    FailMacro();
+  }
 }
 
 static void FrameMoveRight()
@@ -234,26 +309,34 @@ static void FrameMoveRight()
     ++f.m_Cursor;
     f.SaveCursor();
   }
+  else
+  {
+    FailMacro();
+  }
 }
 
 static void FrameMoveUp()
 {
   Frame&  f = CurrentFrame();
-  f.m_Cursor -= f.m_Cursor > 0;
-  while (f.m_Cursor > 0 && f.m_Buffer.m_Data[f.m_Cursor].m_Codepoint != '\n')
+  u32     lineBegin = f.m_Buffer.LineBegin(f.m_Cursor);
+  if (!lineBegin)
   {
-    --f.m_Cursor;
+    FailMacro();
   }
+  
+  f.m_Cursor = lineBegin ? f.m_Buffer.LineBegin(lineBegin - 1) : 0;
   f.LoadCursor();
 }
 
 static void FrameMoveDown()
 {
   Frame&  f = CurrentFrame();
-  while (f.m_Cursor < f.m_Buffer.m_Length && f.m_Buffer.m_Data[f.m_Cursor].m_Codepoint != '\n')
+  f.m_Cursor = f.m_Buffer.LineEnd(f.m_Cursor);
+  if (f.m_Cursor == f.m_Buffer.m_Length)
   {
-    ++f.m_Cursor;
+    FailMacro();
   }
+  
   f.m_Cursor += f.m_Cursor < f.m_Buffer.m_Length;
   f.LoadCursor();
 }
@@ -261,48 +344,48 @@ static void FrameMoveDown()
 static void FrameMoveStart()
 {
   Frame&  f = CurrentFrame();
-  while (f.m_Cursor > 0 && f.m_Buffer.m_Data[f.m_Cursor - 1].m_Codepoint != '\n')
-  {
-    --f.m_Cursor;
-  }
+  f.m_Cursor = f.m_Buffer.LineBegin(f.m_Cursor);
   f.SaveCursor();
 }
 
 static void FrameMoveEnd()
 {
   Frame&  f = CurrentFrame();
-  while (f.m_Cursor < f.m_Buffer.m_Length && f.m_Buffer.m_Data[f.m_Cursor].m_Codepoint != '\n')
-  {
-    ++f.m_Cursor;
-  }
+  f.m_Cursor = f.m_Buffer.LineEnd(f.m_Cursor);
   f.SaveCursor();
 }
 
 static void FrameMoveWordLeft()
 {
   Frame&  f = CurrentFrame();
-  while (f.m_Cursor && !f.m_Buffer.m_Data[f.m_Cursor - 1].IsAlnum())
+  if (!f.m_Cursor)
   {
-    --f.m_Cursor;
-  }
-  while (f.m_Cursor && f.m_Buffer.m_Data[f.m_Cursor - 1].IsAlnum())
-  {
-    --f.m_Cursor;
+    FailMacro();
   }
+  
+  f.m_Cursor = WordBegin(f, f.m_Cursor);
   f.SaveCursor();
 }
 
 static void FrameMoveWordRight()
 {
-  Frame&  f = CurrentFrame();
-  while (f.m_Cursor < f.m_Buffer.m_Length && !f.m_Buffer.m_Data[f.m_Cursor].IsAlnum())
+  Frame&        f = CurrentFrame();
+  BufferCursor  c = f.m_Buffer.Cursor(f.m_Cursor);
+  while (!c.AtEnd() && !c.Get().IsAlnum())
   {
-    ++f.m_Cursor;
+    c.Next();
   }
-  while (f.m_Cursor < f.m_Buffer.m_Length && f.m_Buffer.m_Data[f.m_Cursor].IsAlnum())
+  while (!c.AtEnd() && c.Get().IsAlnum())
   {
-    ++f.m_Cursor;
+    c.Next();
+  }
+  
+  if (c.m_Pos == f.m_Cursor)
+  {
+    FailMacro();
   }
+  
+  f.m_Cursor = c.m_Pos;
   f.SaveCursor();
 }
 
@@ -364,9 +447,7 @@ static void Quit()
     g_Prompt.m_Cursor = -1;
     while (!g_Prompt.m_Status)
     {
-      RenderEditor();
-      RenderPrompt();
-      RenderPresent();
+      RenderPromptEditor();
       
       ReadKey();
     }
@@ -433,8 +514,10 @@ static void FrameDeleteBack()
   
   if (f.m_Cursor < f.m_Buffer.m_Length)
   {
-    u32 prev  = f.m_Buffer.m_Data[f.m_Cursor - 1].m_Codepoint;
-    u32 cur   = f.m_Buffer.m_Data[f.m_Cursor].m_Codepoint;
+    BufferCursor  c     = f.m_Buffer.Cursor(f.m_Cursor);
+    u32           cur   = c.Codepoint();
+    c.Prev();
+    u32           prev  = c.Codepoint();
     if ((prev == '(' && cur == ')') || (prev == '[' && cur == ']') || (prev == '{' && cur == '}') || (prev == '"' && cur == '"'))
     {
       --f.m_Cursor;
@@ -448,20 +531,14 @@ static void FrameDeleteBack()
   {
     // deletion of tabspace indentation requires special handling
     --f.m_Cursor;
-    bool  done  = !f.m_Buffer.m_Data[f.m_Cursor].IsSpace();
+    bool  done  = !f.m_Buffer.At(f.m_Cursor).IsSpace();
     f.Erase(f.m_Cursor);
     
     if (!done)
     {
-      u32 lineBegin = f.m_Cursor;
-      while (lineBegin && f.m_Buffer.m_Data[lineBegin - 1].m_Codepoint != '\n')
-      {
-        --lineBegin;
-      }
-      
-      u32 linePos     = f.m_Cursor - lineBegin;
+      u32 linePos     = f.m_Cursor - f.m_Buffer.LineBegin(f.m_Cursor);
       u32 lastIndent  = linePos / g_Options.m_TabSize * g_Options.m_TabSize;
-      while (linePos > lastIndent && f.m_Buffer.m_Data[f.m_Cursor - 1].m_Codepoint == ' ')
+      while (linePos > lastIndent && f.m_Buffer.At(f.m_Cursor - 1).m_Codepoint == ' ')
       {
         --f.m_Cursor;
         f.Erase(f.m_Cursor);
@@ -483,14 +560,7 @@ static void FrameDeleteWord()
 {
   Frame&  f           = CurrentFrame();
   u32     upperBound  = f.m_Cursor;
-  while (f.m_Cursor > 0 && !f.m_Buffer.m_Data[f.m_Cursor - 1].IsAlnum())
-  {
-    --f.m_Cursor;
-  }
-  while (f.m_Cursor > 0 && f.m_Buffer.m_Data[f.m_Cursor - 1].IsAlnum())
-  {
-    --f.m_Cursor;
-  }
+  f.m_Cursor = WordBegin(f, f.m_Cursor);
   f.SaveCursor();
   
   if (f.m_Cursor < upperBound)
@@ -550,18 +620,14 @@ static void PromptDeleteWord()
 
 static void Newline()
 {
-  Frame&  f         = CurrentFrame();
-  u32     lineBegin = f.m_Cursor;
-  while (lineBegin > 0 && f.m_Buffer.m_Data[lineBegin - 1].m_Codepoint != '\n')
-  {
-    --lineBegin;
-  }
+  Frame&        f       = CurrentFrame();
+  BufferCursor  indent  = f.m_Buffer.Cursor(f.m_Buffer.LineBegin(f.m_Cursor));
   
   u32 nIndent = 0;
   if (g_Options.m_TabSpaces)
   {
     u32 nSpaces = 0;
-    while (lineBegin + nSpaces < f.m_Buffer.m_Length && f.m_Buffer.m_Data[lineBegin + nSpaces].m_Codepoint == ' ')
+    for (; !indent.AtEnd() && indent.Codepoint() == ' '; indent.Next())
     {
       ++nSpaces;
     }
@@ -569,7 +635,7 @@ static void Newline()
   }
   else
   {
-    while (lineBegin + nIndent < f.m_Buffer.m_Length && f.m_Buffer.m_Data[lineBegin + nIndent].m_Codepoint == '\t')
+    for (; !indent.AtEnd() && indent.Codepoint() == '\t'; indent.Next())
     {
       ++nIndent;
     }
@@ -579,8 +645,10 @@ static void Newline()
   bool  unfolded  = false;
   if (f.m_Cursor > 0 && f.m_Cursor < f.m_Buffer.m_Length)
   {
-    u32 prev  = f.m_Buffer.m_Data[f.m_Cursor - 1].m_Codepoint;
-    u32 cur   = f.m_Buffer.m_Data[f.m_Cursor].m_Codepoint;
+    BufferCursor  c     = f.m_Buffer.Cursor(f.m_Cursor);
+    u32           cur   = c.Codepoint();
+    c.Prev();
+    u32           prev  = c.Codepoint();
     if (prev == '(' || prev == '[' || prev == '{')
     {
       f.Write('\n', f.m_Cursor);
@@ -641,7 +709,7 @@ static void Undo()
 static void Redo()
 {
   Frame&  f = CurrentFrame();
-  if (f.m_CurHistory == f.m_HistoryLength)
+  if (!(f.m_CurHistory ? f.m_History[f.m_CurHistory - 1].m_Redo : f.m_RootRedo))
   {
     Info("Binds: Nothing to redo");
     return;
@@ -650,6 +718,89 @@ static void Redo()
   f.Redo();
 }
 
+// history entries are numbered in the order they were made, regardless of the branch they are on
+static void Earlier()
+{
+  Frame&  f = CurrentFrame();
+  if (f.m_CurHistory == 0)
+  {
+    Info("Binds: Already at oldest change");
+    return;
+  }
+  
+  f.GotoHistory(f.m_CurHistory - 1);
+}
+
+static void Later()
+{
+  Frame&  f = CurrentFrame();
+  if (f.m_CurHistory == f.m_HistoryLength)
+  {
+    Info("Binds: Already at newest change");
+    return;
+  }
+  
+  f.GotoHistory(f.m_CurHistory + 1);
+}
+
+static void NextBranch()
+{
+  Frame&  f       = CurrentFrame();
+  u32     branch  = f.NextBranch(false);
+  if (branch == f.m_CurHistory)
+  {
+    Info("Binds: No other branch");
+    return;
+  }
+  
+  f.GotoHistory(branch);
+}
+
+static void PreviousBranch()
+{
+  Frame&  f       = CurrentFrame();
+  u32     branch  = f.NextBranch(true);
+  if (branch == f.m_CurHistory)
+  {
+    Info("Binds: No other branch");
+    return;
+  }
+  
+  f.GotoHistory(branch);
+}
+
+static void GotoHistory()
+{
+  InstallNumberPromptBinds();
+  BeginPrompt("Goto change: ");
+  while (!g_Prompt.m_Status)
+  {
+    RenderPromptEditor();
+    
+    EChar key = ReadKey();
+    if (key.m_Codepoint < 128 && key.IsDigit())
+    {
+      PromptWrite(key, g_Prompt.m_Cursor);
+      ++g_Prompt.m_Cursor;
+    }
+  }
+  EndPrompt();
+  InstallBaseBinds();
+  
+  if (g_Prompt.m_Status == PROMPT_FAIL)
+  {
+    return;
+  }
+  
+  char* changeString  = PromptDataCString();
+  u64   change        = strtoll(changeString, nullptr, 10);
+  free(changeString);
+  
+  Frame&  f = CurrentFrame();
+  f.GotoHistory(change < f.m_HistoryLength ? change : f.m_HistoryLength);
+  Info("Binds: At change %u of %u", f.m_CurHistory, f.m_HistoryLength);
+}
+
 static void NewFrame()
 {
   if (g_Editor.m_NFrames >= FUNCTIONAL::MAX_FILES)
@@ -676,9 +827,7 @@ static void KillFrame()
   g_Prompt.m_Cursor = -1;
   while (!g_Prompt.m_Status)
   {
-    RenderEditor();
-    RenderPrompt();
-    RenderPresent();
+    RenderPromptEditor();
     
     ReadKey();
   }
@@ -707,9 +856,7 @@ static void Save()
   BeginPrompt("Save as: ");
   while (!g_Prompt.m_Status)
   {
-    RenderEditor();
-    RenderPrompt();
-    RenderPresent();
+    RenderPromptEditor();
     
     EChar key = ReadKey();
     if (WritableToPrompt(key))
@@ -767,9 +914,7 @@ static void OpenFile()
   BeginPrompt("Open file: ");
   while (!g_Prompt.m_Status)
   {
-    RenderEditor();
-    RenderPrompt();
-    RenderPresent();
+    RenderPromptEditor();
     
     EChar key = ReadKey();
     if (WritableToPrompt(key))
@@ -817,14 +962,22 @@ static void OpenFile()
 }
 
 static void Search()
+{
+  SearchPrompt("Search literally: ", false);
+}
+
+static void ReverseSearch()
+{
+  SearchPrompt("Reverse search literally: ", true);
+}
+
+static void RegexSearch()
 {
   InstallPromptBinds();
-  BeginPrompt("Search literally: ");
+  BeginPrompt("Search regex: ");
   while (!g_Prompt.m_Status)
   {
-    RenderEditor();
-    RenderPrompt();
-    RenderPresent();
+    RenderPromptEditor();
     
     EChar key = ReadKey();
     if (WritableToPrompt(key))
@@ -842,43 +995,41 @@ static void Search()
   }
   
   Frame&  f       = CurrentFrame();
-  EString needle  = PromptData();
-  if (needle.m_Length == 0)
+  EString pattern = PromptData();
+  if (pattern.m_Length == 0)
   {
-    needle.Free();
+    f.m_MatchIndex.Reset(f.m_Buffer, pattern, false);
     return;
   }
   
-  for (usize i = f.m_Cursor + 1; i + needle.m_Length <= f.m_Buffer.m_Length; ++i)
+  Regex*  regex = CachedRegex(pattern);
+  if (!regex)
   {
-    for (usize j = 0; j < needle.m_Length; ++j)
-    {
-      if (needle.m_Data[j].m_Codepoint != f.m_Buffer.m_Data[i + j].m_Codepoint)
-      {
-        goto nextChar;
-      }
-    }
-    
-    f.m_Cursor = i;
+    pattern.Free();
+    FailMacro();
+    return;
+  }
+  f.m_MatchIndex.Reset(f.m_Buffer, pattern, true);
+  
+  u32 lb = 0, ub = 0;
+  if (FindRegexForward(f.m_Buffer, *regex, f.m_Cursor + 1, f.m_Buffer.m_Length, lb, ub))
+  {
+    f.m_Cursor = lb;
     f.SaveCursor();
-    needle.Free();
     return;
-  nextChar:;
   }
   
-  Info("Binds: Didn't find search string");
-  needle.Free();
+  Info("Binds: Didn't find regex match");
+  FailMacro();
 }
 
-static void ReverseSearch()
+static void ReverseRegexSearch()
 {
   InstallPromptBinds();
-  BeginPrompt("Reverse search literally: ");
+  BeginPrompt("Reverse search regex: ");
   while (!g_Prompt.m_Status)
   {
-    RenderEditor();
-    RenderPrompt();
-    RenderPresent();
+    RenderPromptEditor();
     
     EChar key = ReadKey();
     if (WritableToPrompt(key))
@@ -896,32 +1047,146 @@ static void ReverseSearch()
   }
   
   Frame&  f       = CurrentFrame();
-  EString needle  = PromptData();
-  if (needle.m_Length == 0)
+  EString pattern = PromptData();
+  if (pattern.m_Length == 0)
   {
-    needle.Free();
+    f.m_MatchIndex.Reset(f.m_Buffer, pattern, false);
     return;
   }
   
-  for (isize i = f.m_Cursor; i >= (isize)needle.m_Length; --i)
+  Regex*  regex = CachedRegex(pattern);
+  if (!regex)
   {
-    for (isize j = 0; j < (isize)needle.m_Length; ++j)
+    pattern.Free();
+    FailMacro();
+    return;
+  }
+  f.m_MatchIndex.Reset(f.m_Buffer, pattern, true);
+  
+  // an empty match at the cursor would leave it where it is
+  u32   lb    = 0, ub = 0;
+  bool  found = FindRegexReverse(f.m_Buffer, *regex, 0, f.m_Cursor, lb, ub);
+  if (found && lb == f.m_Cursor)
+  {
+    found = f.m_Cursor > 0 && FindRegexReverse(f.m_Buffer, *regex, 0, f.m_Cursor - 1, lb, ub);
+  }
+  
+  if (found)
+  {
+    f.m_Cursor = lb;
+    f.SaveCursor();
+    return;
+  }
+  
+  Info("Binds: Didn't find regex match");
+  FailMacro();
+}
+
+// every match is found before anything is replaced, and all of them are replaced in one edit, which is undone at once
+static void ReplaceAll()
+{
+  InstallPromptBinds();
+  BeginPrompt("Replace literally: ");
+  while (!g_Prompt.m_Status)
+  {
+    RenderPromptEditor();
+    
+    EChar key = ReadKey();
+    if (WritableToPrompt(key))
     {
-      if (needle.m_Data[j].m_Codepoint != f.m_Buffer.m_Data[i - needle.m_Length + j].m_Codepoint)
-      {
-        goto nextChar;
-      }
+      PromptWrite(key, g_Prompt.m_Cursor);
+      ++g_Prompt.m_Cursor;
     }
+  }
+  EndPrompt();
+  
+  EString str = PromptData();
+  if (g_Prompt.m_Status == PROMPT_FAIL || str.m_Length == 0)
+  {
+    InstallBaseBinds();
+    str.Free();
+    return;
+  }
+  
+  BeginPrompt("Replace with: ");
+  while (!g_Prompt.m_Status)
+  {
+    RenderPromptEditor();
     
-    f.m_Cursor = i - needle.m_Length;
-    f.SaveCursor();
-    needle.Free();
+    EChar key = ReadKey();
+    if (WritableToPrompt(key))
+    {
+      PromptWrite(key, g_Prompt.m_Cursor);
+      ++g_Prompt.m_Cursor;
+    }
+  }
+  EndPrompt();
+  InstallBaseBinds();
+  
+  EString replacement = PromptData();
+  if (g_Prompt.m_Status == PROMPT_FAIL)
+  {
+    str.Free();
+    replacement.Free();
     return;
-  nextChar:;
   }
   
-  Info("Binds: Didn't find search string");
+  Frame&        f       = CurrentFrame();
+  SearchNeedle  needle  {};
+  CompileNeedle(needle, str);
+  
+  // matches don't overlap, the earliest one winning
+  u32*  positions = (u32*)malloc(sizeof(u32) * 64);
+  u32   count     = 0;
+  u32   capacity  = 64;
+  u32   pos       = 0;
+  while (FindForward(f.m_Buffer, needle, pos, f.m_Buffer.m_Length, pos))
+  {
+    if (count >= capacity)
+    {
+      capacity *= 2;
+      positions = (u32*)reallocarray(positions, capacity, sizeof(u32));
+    }
+    positions[count++] = pos;
+    pos += str.m_Length;
+  }
   needle.Free();
+  
+  if (count == 0)
+  {
+    str.Free();
+    replacement.Free();
+    free(positions);
+    Info("Binds: Didn't find search string");
+    FailMacro();
+    return;
+  }
+  
+  // the cursor keeps its place in the text around it, moving to the start of a match it was inside of
+  u32 lb  = 0;
+  u32 ub  = count;
+  while (lb < ub)
+  {
+    u32 mid = (lb + ub) / 2;
+    if (positions[mid] + str.m_Length <= f.m_Cursor)
+    {
+      lb = mid + 1;
+    }
+    else
+    {
+      ub = mid;
+    }
+  }
+  u32 cursor  = lb < count && positions[lb] < f.m_Cursor ? positions[lb] : f.m_Cursor;
+  
+  f.Replace(positions, count, str.m_Length, replacement);
+  f.m_Cursor = cursor + lb * (replacement.m_Length - str.m_Length);
+  f.SaveCursor();
+  
+  Info("Binds: Replaced %u occurrences", count);
+  str.Free();
+  replacement.Free();
+  free(positions);
 }
 
 static void FrameLeftParen()
@@ -991,10 +1256,7 @@ static void Paste()
   Frame&  f = CurrentFrame();
   
   f.SaveCursor();
-  while (f.m_Cursor < f.m_Buffer.m_Length && f.m_Buffer.m_Data[f.m_Cursor].m_Codepoint != '\n')
-  {
-    ++f.m_Cursor;
-  }
+  f.m_Cursor = f.m_Buffer.LineEnd(f.m_Cursor);
   
   f.Write('\n', f.m_Cursor);
   ++f.m_Cursor;
@@ -1002,21 +1264,80 @@ static void Paste()
   f.LoadCursor();
 }
 
-static void CopyLine()
+// the whole paste goes in with a single write, and nothing is rendered until it is in
+static void FrameBracketedPaste()
 {
-  Frame&  f = CurrentFrame();
+  EString paste = ReadPaste();
+  u32     n     = 0;
+  for (u32 i = 0; i < paste.m_Length; ++i)
+  {
+    if (paste.m_Data[i].m_Codepoint == '\n' || WritableToEditor(paste.m_Data[i]))
+    {
+      paste.m_Data[n++] = paste.m_Data[i];
+    }
+  }
+  paste.m_Length = n;
   
-  u32 lineBegin = f.m_Cursor;
-  while (lineBegin > 0 && f.m_Buffer.m_Data[lineBegin - 1].m_Codepoint != '\n')
+  if (paste.m_Length)
   {
-    --lineBegin;
+    Frame&  f = CurrentFrame();
+    f.Write(paste, f.m_Cursor);
+    f.m_Cursor += paste.m_Length;
+    f.SaveCursor();
   }
   
-  u32 lineEnd = f.m_Cursor;
-  while (lineEnd < f.m_Buffer.m_Length && f.m_Buffer.m_Data[lineEnd].m_Codepoint != '\n')
+  paste.Free();
+}
+
+static void PromptBracketedPaste()
+{
+  EString paste = ReadPaste();
+  u32     n     = 0;
+  for (u32 i = 0; i < paste.m_Length; ++i)
   {
-    ++lineEnd;
+    if (WritableToPrompt(paste.m_Data[i]))
+    {
+      paste.m_Data[n++] = paste.m_Data[i];
+    }
   }
+  paste.m_Length = n;
+  
+  PromptWrite(paste, g_Prompt.m_Cursor);
+  g_Prompt.m_Cursor += paste.m_Length;
+  paste.Free();
+}
+
+static void NumberPromptBracketedPaste()
+{
+  EString paste = ReadPaste();
+  u32     n     = 0;
+  for (u32 i = 0; i < paste.m_Length; ++i)
+  {
+    if (paste.m_Data[i].m_Codepoint < 128 && paste.m_Data[i].IsDigit())
+    {
+      paste.m_Data[n++] = paste.m_Data[i];
+    }
+  }
+  paste.m_Length = n;
+  
+  PromptWrite(paste, g_Prompt.m_Cursor);
+  g_Prompt.m_Cursor += paste.m_Length;
+  paste.Free();
+}
+
+// pasted text must not be taken for an answer
+static void IgnoreBracketedPaste()
+{
+  EString paste = ReadPaste();
+  paste.Free();
+}
+
+static void CopyLine()
+{
+  Frame&  f = CurrentFrame();
+  
+  u32 lineBegin = f.m_Buffer.LineBegin(f.m_Cursor);
+  u32 lineEnd   = f.m_Buffer.LineEnd(f.m_Cursor);
   
   g_Editor.m_Clipboard.Free();
   g_Editor.m_Clipboard = f.m_Buffer.Substring(lineBegin, lineEnd);
@@ -1028,17 +1349,8 @@ static void CutLine()
 {
   Frame&  f = CurrentFrame();
   
-  u32 lineBegin = f.m_Cursor;
-  while (lineBegin > 0 && f.m_Buffer.m_Data[lineBegin - 1].m_Codepoint != '\n')
-  {
-    --lineBegin;
-  }
-  
-  u32 lineEnd = f.m_Cursor;
-  while (lineEnd < f.m_Buffer.m_Length && f.m_Buffer.m_Data[lineEnd].m_Codepoint != '\n')
-  {
-    ++lineEnd;
-  }
+  u32 lineBegin = f.m_Buffer.LineBegin(f.m_Cursor);
+  u32 lineEnd   = f.m_Buffer.LineEnd(f.m_Cursor);
   
   g_Editor.m_Clipboard.Free();
   g_Editor.m_Clipboard = f.m_Buffer.Substring(lineBegin, lineEnd);
@@ -1057,9 +1369,7 @@ static void CopyLines()
   BeginPrompt("Copy lines: ");
   while (!g_Prompt.m_Status)
   {
-    RenderEditor();
-    RenderPrompt();
-    RenderPresent();
+    RenderPromptEditor();
     
     EChar key = ReadKey();
     if (key.m_Codepoint < 128 && key.IsDigit())
@@ -1088,22 +1398,9 @@ static void CopyLines()
   
   Frame&  f = CurrentFrame();
   
-  u32 begin = f.m_Cursor;
-  while (begin > 0 && f.m_Buffer.m_Data[begin - 1].m_Codepoint != '\n')
-  {
-    --begin;
-  }
-  
-  u32 end = begin;
-  while (end < f.m_Buffer.m_Length)
-  {
-    lines -= f.m_Buffer.m_Data[end].m_Codepoint == '\n';
-    if (lines == 0)
-    {
-      break;
-    }
-    ++end;
-  }
+  u32 begin = f.m_Buffer.LineBegin(f.m_Cursor);
+  u64 last  = f.m_Buffer.LineOf(f.m_Cursor) + lines - 1;
+  u32 end   = f.m_Buffer.LineEnd(f.m_Buffer.LineOffset(last < f.m_Buffer.m_Newlines ? last : f.m_Buffer.m_Newlines));
   
   g_Editor.m_Clipboard.Free();
   g_Editor.m_Clipboard = f.m_Buffer.Substring(begin, end);
@@ -1117,9 +1414,7 @@ static void CutLines()
   BeginPrompt("Cut lines: ");
   while (!g_Prompt.m_Status)
   {
-    RenderEditor();
-    RenderPrompt();
-    RenderPresent();
+    RenderPromptEditor();
     
     EChar key = ReadKey();
     if (key.m_Codepoint < 128 && key.IsDigit())
@@ -1148,22 +1443,9 @@ static void CutLines()
   
   Frame&  f = CurrentFrame();
   
-  u32 begin = f.m_Cursor;
-  while (begin > 0 && f.m_Buffer.m_Data[begin - 1].m_Codepoint != '\n')
-  {
-    --begin;
-  }
-  
-  u32 end = begin;
-  while (end < f.m_Buffer.m_Length)
-  {
-    lines -= f.m_Buffer.m_Data[end].m_Codepoint == '\n';
-    if (lines == 0)
-    {
-      break;
-    }
-    ++end;
-  }
+  u32 begin = f.m_Buffer.LineBegin(f.m_Cursor);
+  u64 last  = f.m_Buffer.LineOf(f.m_Cursor) + lines - 1;
+  u32 end   = f.m_Buffer.LineEnd(f.m_Buffer.LineOffset(last < f.m_Buffer.m_Newlines ? last : f.m_Buffer.m_Newlines));
   
   g_Editor.m_Clipboard.Free();
   g_Editor.m_Clipboard = f.m_Buffer.Substring(begin, end);
@@ -1182,9 +1464,7 @@ static void CopyUntilLine()
   BeginPrompt("Copy until line: ");
   while (!g_Prompt.m_Status)
   {
-    RenderEditor();
-    RenderPrompt();
-    RenderPresent();
+    RenderPromptEditor();
     
     EChar key = ReadKey();
     if (key.m_Codepoint < 128 && key.IsDigit())
@@ -1207,38 +1487,20 @@ static void CopyUntilLine()
   
   Frame&  f = CurrentFrame();
   
-  u32 begin = f.m_Cursor;
-  while (begin > 0 && f.m_Buffer.m_Data[begin - 1].m_Codepoint != '\n')
-  {
-    --begin;
-  }
+  u32 begin = f.m_Buffer.LineBegin(f.m_Cursor);
   
-  u32 end = 0;
-  while (end < f.m_Buffer.m_Length)
+  u32 end = f.m_Buffer.m_Length;
+  if (line)
   {
-    line -= f.m_Buffer.m_Data[end].m_Codepoint == '\n';
-    if (line == 0)
-    {
-      break;
-    }
-    ++end;
+    --line;
+    end = f.m_Buffer.LineEnd(f.m_Buffer.LineOffset(line < f.m_Buffer.m_Newlines ? line : f.m_Buffer.m_Newlines));
   }
   
   if (begin > end)
   {
     u32 tmp = begin;
-    begin = end;
-    end = tmp;
-    
-    while (begin > 0 && f.m_Buffer.m_Data[begin - 1].m_Codepoint != '\n')
-    {
-      --begin;
-    }
-    
-    while (end < f.m_Buffer.m_Length && f.m_Buffer.m_Data[end].m_Codepoint != '\n')
-    {
-      ++end;
-    }
+    begin = f.m_Buffer.LineBegin(end);
+    end = f.m_Buffer.LineEnd(tmp);
   }
   
   g_Editor.m_Clipboard.Free();
@@ -1253,9 +1515,7 @@ static void CutUntilLine()
   BeginPrompt("Cut until line: ");
   while (!g_Prompt.m_Status)
   {
-    RenderEditor();
-    RenderPrompt();
-    RenderPresent();
+    RenderPromptEditor();
     
     EChar key = ReadKey();
     if (key.m_Codepoint < 128 && key.IsDigit())
@@ -1278,38 +1538,20 @@ static void CutUntilLine()
   
   Frame&  f = CurrentFrame();
   
-  u32 begin = f.m_Cursor;
-  while (begin > 0 && f.m_Buffer.m_Data[begin - 1].m_Codepoint != '\n')
-  {
-    --begin;
-  }
+  u32 begin = f.m_Buffer.LineBegin(f.m_Cursor);
   
-  u32 end = 0;
-  while (end < f.m_Buffer.m_Length)
+  u32 end = f.m_Buffer.m_Length;
+  if (line)
   {
-    line -= f.m_Buffer.m_Data[end].m_Codepoint == '\n';
-    if (line == 0)
-    {
-      break;
-    }
-    ++end;
+    --line;
+    end = f.m_Buffer.LineEnd(f.m_Buffer.LineOffset(line < f.m_Buffer.m_Newlines ? line : f.m_Buffer.m_Newlines));
   }
   
   if (begin > end)
   {
     u32 tmp = begin;
-    begin = end;
-    end = tmp;
-    
-    while (begin > 0 && f.m_Buffer.m_Data[begin - 1].m_Codepoint != '\n')
-    {
-      --begin;
-    }
-    
-    while (end < f.m_Buffer.m_Length && f.m_Buffer.m_Data[end].m_Codepoint != '\n')
-    {
-      ++end;
-    }
+    begin = f.m_Buffer.LineBegin(end);
+    end = f.m_Buffer.LineEnd(tmp);
   }
   
   g_Editor.m_Clipboard.Free();
@@ -1342,9 +1584,7 @@ static void Goto()
   BeginPrompt("Goto line: ");
   while (!g_Prompt.m_Status)
   {
-    RenderEditor();
-    RenderPrompt();
-    RenderPresent();
+    RenderPromptEditor();
     
     EChar key = ReadKey();
     if (key.m_Codepoint < 128 && key.IsDigit())
@@ -1369,14 +1609,7 @@ static void Goto()
   Frame&  f = CurrentFrame();
   
   // move cursor to needed line
-  f.m_Cursor = 0;
-  while (f.m_Cursor < f.m_Buffer.m_Length && line)
-  {
-    if (f.m_Buffer.m_Data[f.m_Cursor++].m_Codepoint == '\n')
-    {
-      --line;
-    }
-  }
+  f.m_Cursor = line < f.m_Buffer.LineCount() ? f.m_Buffer.LineOffset(line) : f.m_Buffer.m_Length;
   f.SaveCursor();
   
   // focus selected line
@@ -1408,11 +1641,47 @@ static void ExecuteMacro()
   }
   else
   {
-    Info("Binds: Executing macro");
-    ::ExecuteMacro();
+    ::ExecuteMacro(1);
   }
 }
 
+static void ExecuteMacroRuns()
+{
+  if (IsRecordingMacro())
+  {
+    Info("Binds: Stopped recording macro");
+    StopRecordingMacro();
+    return;
+  }
+  
+  InstallNumberPromptBinds();
+  BeginPrompt("Execute macro times: ");
+  while (!g_Prompt.m_Status)
+  {
+    RenderPromptEditor();
+    
+    EChar key = ReadKey();
+    if (key.m_Codepoint < 128 && key.IsDigit())
+    {
+      PromptWrite(key, g_Prompt.m_Cursor);
+      ++g_Prompt.m_Cursor;
+    }
+  }
+  EndPrompt();
+  InstallBaseBinds();
+  
+  if (g_Prompt.m_Status == PROMPT_FAIL)
+  {
+    return;
+  }
+  
+  char* runsString  = PromptDataCString();
+  u64   runs        = strtoll(runsString, nullptr, 10);
+  free(runsString);
+  
+  ::ExecuteMacro(runs < UINT32_MAX ? runs : UINT32_MAX);
+}
+
 static void Help()
 {
   if (g_Editor.m_NFrames >= FUNCTIONAL::MAX_FILES)
@@ -1437,4 +1706,100 @@ static void Complete()
   CompletePromptPath();
 }
 
+// prompts aren't shown while a macro is executed, since it doesn't wait for them
+static void RenderPromptEditor()
+{
+  if (IsExecutingMacro())
+  {
+    return;
+  }
+  
+  RenderEditor();
+  RenderPrompt();
+  RenderPresent();
+}
+
+// the frame follows the match while the string is typed, and goes back to where it was if the search is quit
+static void SearchPrompt(const char* prompt, bool reverse)
+{
+  Frame&  f       = CurrentFrame();
+  u32     origin  = f.m_Cursor;
+  u32     start   = f.m_Start;
+  
+  IncrementalSearch search  {};
+  search.Begin(f.m_Buffer, origin, reverse);
+  
+  InstallPromptBinds();
+  BeginPrompt(prompt);
+  while (!g_Prompt.m_Status)
+  {
+    // input is handled as soon as it comes, and the search is carried on after
+    while (!search.Done() && !InputPending())
+    {
+      search.Step(f.m_Buffer);
+    }
+    
+    f.m_Cursor = search.m_Found ? search.m_Match : origin;
+    RenderPromptEditor();
+    
+    EChar key = ReadKey();
+    if (WritableToPrompt(key))
+    {
+      PromptWrite(key, g_Prompt.m_Cursor);
+      ++g_Prompt.m_Cursor;
+    }
+    
+    search.Update(PromptData());
+  }
+  EndPrompt();
+  InstallBaseBinds();
+  
+  while (g_Prompt.m_Status == PROMPT_SUCCESS && !search.Done())
+  {
+    search.Step(f.m_Buffer);
+  }
+  
+  // every match is highlighted from then on, or none if the string was left empty
+  if (g_Prompt.m_Status == PROMPT_SUCCESS)
+  {
+    f.m_MatchIndex.Reset(f.m_Buffer, search.m_String.Copy(), false);
+  }
+  
+  bool  found = g_Prompt.m_Status == PROMPT_SUCCESS && search.m_Found;
+  bool  empty = search.m_String.m_Length == 0;
+  f.m_Cursor = found ? search.m_Match : origin;
+  search.Free();
+  
+  if (found)
+  {
+    f.SaveCursor();
+    return;
+  }
+  
+  f.m_Start = start;
+  if (g_Prompt.m_Status == PROMPT_SUCCESS && !empty)
+  {
+    Info("Binds: Didn't find search string");
+    FailMacro();
+  }
+}
+
+static u32  WordBegin(const Frame& f, u32 pos)
+{
+  // cursor always sits on the character behind pos
+  BufferCursor  c = f.m_Buffer.Cursor(pos);
+  c.Prev();
+  while (pos > 0 && !c.Get().IsAlnum())
+  {
+    --pos;
+    c.Prev();
+  }
+  while (pos > 0 && c.Get().IsAlnum())
+  {
+    --pos;
+    c.Prev();
+  }
+  return (pos);
+}
+
 }
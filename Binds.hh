@@ -2,6 +2,7 @@
 
 #pragma once
 
+void  InitBinds();
 void  InstallBaseBinds();
 void  InstallWriteBinds();
 void  InstallPromptBinds();
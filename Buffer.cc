@@ -0,0 +1,1048 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include <Buffer.hh>
+#include <cstdlib>
+#include <cstring>
+
+extern "C"
+{
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+}
+
+static u8*    SanitizeUTF8(OWNS u8* data, IN_OUT u64& size);
+static void*  IndexSource(void* indexer);
+static void   StopIndexer(OWNS SourceIndexer* indexer, bool cancel);
+
+void  Source::Free()
+{
+  if (m_Indexer)
+  {
+    StopIndexer(m_Indexer, true);
+  }
+  
+  if (m_Mapped)
+  {
+    munmap(m_Data, m_Size);
+  }
+  else if (m_Data)
+  {
+    free(m_Data);
+  }
+  
+  if (m_Checkpoints)
+  {
+    free(m_Checkpoints);
+  }
+  
+  if (m_Newlines)
+  {
+    free(m_Newlines);
+  }
+  
+  *this = Source{};
+}
+
+void  Source::Append(const u8* data, u64 size)
+{
+  Reserve(m_Size + size);
+  memcpy(&m_Data[m_Size], data, size);
+  
+  u64 from  = m_Size;
+  m_Size += size;
+  Index(from);
+}
+
+void  Source::Append(const EChar* str, u32 length)
+{
+  Reserve(m_Size + 4 * (u64)length);
+  
+  u64 from  = m_Size;
+  for (u32 i = 0; i < length; ++i)
+  {
+    // the NUL character is the only one whose encoding has zero bytes
+    usize encodingLength  = str[i].EncodingLength();
+    encodingLength += !encodingLength;
+    
+    memcpy(&m_Data[m_Size], str[i].m_Encoding, encodingLength);
+    m_Size += encodingLength;
+  }
+  Index(from);
+}
+
+void  Source::Reserve(u64 size)
+{
+  if (size <= m_Capacity)
+  {
+    return;
+  }
+  
+  while (m_Capacity < size)
+  {
+    m_Capacity = m_Capacity ? 2 * m_Capacity : 64;
+  }
+  m_Data = (u8*)realloc(m_Data, m_Capacity);
+}
+
+void  Source::Index(u64 from)
+{
+  for (u64 i = from; i < m_Size; i += UTF8Length(m_Data[i]))
+  {
+    if (m_Length % SOURCE_CHECKPOINT == 0)
+    {
+      if (m_NCheckpoints >= m_CheckpointCapacity)
+      {
+        m_CheckpointCapacity = m_CheckpointCapacity ? 2 * m_CheckpointCapacity : 1;
+        m_Checkpoints = (u64*)reallocarray(m_Checkpoints, m_CheckpointCapacity, sizeof(u64));
+      }
+      m_Checkpoints[m_NCheckpoints++] = i;
+    }
+    
+    if (m_Data[i] == '\n')
+    {
+      if (m_NNewlines >= m_NewlineCapacity)
+      {
+        m_NewlineCapacity = m_NewlineCapacity ? 2 * m_NewlineCapacity : 1;
+        m_Newlines = (u32*)reallocarray(m_Newlines, m_NewlineCapacity, sizeof(u32));
+      }
+      m_Newlines[m_NNewlines++] = m_Length;
+    }
+    
+    ++m_Length;
+  }
+}
+
+u64 Source::ByteOffset(u32 pos) const
+{
+  // pure ASCII sources need no decoding at all
+  if (m_Size == m_Length)
+  {
+    return (pos);
+  }
+  
+  if (pos >= m_Length)
+  {
+    return (m_Size);
+  }
+  
+  Wait(pos + 1, 0);
+  
+  u64 byte  = m_Checkpoints[pos / SOURCE_CHECKPOINT];
+  for (u32 i = 0; i < pos % SOURCE_CHECKPOINT; ++i)
+  {
+    byte += UTF8Length(m_Data[byte]);
+  }
+  return (byte);
+}
+
+u32 Source::NewlinesBefore(u32 pos) const
+{
+  u32 low   = 0;
+  u32 high  = Wait(pos, 0);
+  while (low < high)
+  {
+    u32 mid = (low + high) / 2;
+    if (m_Newlines[mid] < pos)
+    {
+      low = mid + 1;
+    }
+    else
+    {
+      high = mid;
+    }
+  }
+  
+  return (low);
+}
+
+u32 Source::Newline(u32 idx) const
+{
+  Wait(0, idx + 1);
+  return (m_Newlines[idx]);
+}
+
+// returns how many newlines are safe to read
+u32 Source::Wait(u32 pos, u32 newlines) const
+{
+  if (!m_Indexer || __atomic_load_n(&m_Indexer->m_Done, __ATOMIC_ACQUIRE))
+  {
+    return (m_NNewlines);
+  }
+  
+  pthread_mutex_lock(&m_Indexer->m_Mutex);
+  while (!m_Indexer->m_Done && (m_Indexer->m_Length < pos || m_Indexer->m_NNewlines < newlines))
+  {
+    pthread_cond_wait(&m_Indexer->m_Progress, &m_Indexer->m_Mutex);
+  }
+  u32 indexed = m_Indexer->m_NNewlines;
+  pthread_mutex_unlock(&m_Indexer->m_Mutex);
+  
+  return (indexed);
+}
+
+// copies a mapped source into memory so that its file can be safely overwritten
+void  Source::Detach()
+{
+  if (!m_Mapped)
+  {
+    return;
+  }
+  
+  if (m_Indexer)
+  {
+    StopIndexer(m_Indexer, false);
+    m_Indexer = nullptr;
+  }
+  
+  u8* data  = (u8*)malloc(m_Size);
+  memcpy(data, m_Data, m_Size);
+  munmap(m_Data, m_Size);
+  m_Data = data;
+  m_Capacity = m_Size;
+  m_Mapped = false;
+}
+
+void  Buffer::Free()
+{
+  m_Original.Free();
+  m_Add.Free();
+  
+  if (m_Pieces)
+  {
+    free(m_Pieces);
+  }
+  
+  *this = Buffer{};
+}
+
+EChar Buffer::At(u32 pos) const
+{
+  BufferCursor  cursor  = Cursor(pos);
+  return (cursor.Get());
+}
+
+BufferCursor  Buffer::Cursor(u32 pos) const
+{
+  BufferCursor  cursor  =
+  {
+    .m_Buffer = this,
+    .m_Data   = nullptr,
+    .m_Pos    = pos,
+    .m_Piece  = 0,
+    .m_Byte   = 0
+  };
+  
+  if (m_NPieces)
+  {
+    cursor.EnterPiece(FindPiece(pos));
+    
+    const Piece&  piece = m_Pieces[cursor.m_Piece];
+    cursor.m_Byte = SourceOf(piece).ByteOffset(piece.m_Offset + pos - piece.m_Start);
+  }
+  
+  return (cursor);
+}
+
+u32 Buffer::FindPiece(u32 pos) const
+{
+  if (!m_NPieces)
+  {
+    return (0);
+  }
+  
+  // the final piece is also returned for the end of the buffer so that cursors can step back from it
+  u32 low   = 0;
+  u32 high  = m_NPieces - 1;
+  while (low < high)
+  {
+    u32 mid = (low + high + 1) / 2;
+    if (m_Pieces[mid].m_Start <= pos)
+    {
+      low = mid;
+    }
+    else
+    {
+      high = mid - 1;
+    }
+  }
+  
+  return (low);
+}
+
+u32 Buffer::LineBegin(u32 pos) const
+{
+  return (LineOffset(LineOf(pos)));
+}
+
+u32 Buffer::LineEnd(u32 pos) const
+{
+  u32 line  = LineOf(pos);
+  return (line < m_Newlines ? LineOffset(line + 1) - 1 : m_Length);
+}
+
+u32 Buffer::LineCount() const
+{
+  return (m_Newlines + 1);
+}
+
+// lines are 0-based
+u32 Buffer::LineOf(u32 pos) const
+{
+  if (pos >= m_Length)
+  {
+    return (m_Newlines);
+  }
+  
+  const Piece&  piece   = m_Pieces[FindPiece(pos)];
+  const Source& source  = SourceOf(piece);
+  return (piece.m_Line + source.NewlinesBefore(piece.m_Offset + pos - piece.m_Start) - source.NewlinesBefore(piece.m_Offset));
+}
+
+u32 Buffer::LineOffset(u32 line) const
+{
+  if (!line)
+  {
+    return (0);
+  }
+  
+  if (line > m_Newlines)
+  {
+    return (m_Length);
+  }
+  
+  // find the last piece which starts before the newline ending the previous line
+  u32 low   = 0;
+  u32 high  = m_NPieces - 1;
+  while (low < high)
+  {
+    u32 mid = (low + high + 1) / 2;
+    if (m_Pieces[mid].m_Line < line)
+    {
+      low = mid;
+    }
+    else
+    {
+      high = mid - 1;
+    }
+  }
+  
+  const Piece&  piece   = m_Pieces[low];
+  const Source& source  = SourceOf(piece);
+  u32           newline = source.Newline(source.NewlinesBefore(piece.m_Offset) + line - piece.m_Line - 1);
+  return (piece.m_Start + newline - piece.m_Offset + 1);
+}
+
+void  Buffer::Insert(const EChar* str, u32 length, u32 pos)
+{
+  if (!length)
+  {
+    return;
+  }
+  
+  u32 offset    = m_Add.m_Length;
+  u64 byte      = m_Add.m_Size;
+  u32 newlines  = m_Add.m_NNewlines;
+  m_Add.Append(str, length);
+  newlines = m_Add.m_NNewlines - newlines;
+  
+  // typing extends the previously inserted piece instead of creating a new one per character
+  u32     idx   = Split(pos);
+  Piece*  prev  = idx ? &m_Pieces[idx - 1] : nullptr;
+  if (prev && prev->m_Source == PIECE_ADD && prev->m_Offset + prev->m_Length == offset)
+  {
+    prev->m_Length += length;
+    prev->m_Size += m_Add.m_Size - byte;
+    prev->m_Newlines += newlines;
+  }
+  else
+  {
+    Piece piece =
+    {
+      .m_Offset = offset,
+      .m_Length = length,
+      .m_Start  = pos,
+      .m_Byte   = byte,
+      .m_Size     = m_Add.m_Size - byte,
+      .m_Newlines = newlines,
+      .m_Line     = idx < m_NPieces ? m_Pieces[idx].m_Line : m_Newlines,
+      .m_Source   = PIECE_ADD
+    };
+    InsertPiece(piece, idx);
+    ++idx;
+  }
+  
+  for (u32 i = idx; i < m_NPieces; ++i)
+  {
+    m_Pieces[i].m_Start += length;
+    m_Pieces[i].m_Line += newlines;
+  }
+  m_Length += length;
+  m_Newlines += newlines;
+}
+
+void  Buffer::Insert(const EString& str, u32 pos)
+{
+  Insert(str.m_Data, str.m_Length, pos);
+}
+
+void  Buffer::Erase(u32 lb, u32 ub)
+{
+  if (lb >= ub)
+  {
+    return;
+  }
+  
+  u32 first = Split(lb);
+  u32 last  = Split(ub);
+  
+  u32 newlines  = 0;
+  for (u32 i = first; i < last; ++i)
+  {
+    newlines += m_Pieces[i].m_Newlines;
+  }
+  
+  memmove(&m_Pieces[first], &m_Pieces[last], sizeof(Piece) * (m_NPieces - last));
+  m_NPieces -= last - first;
+  
+  for (u32 i = first; i < m_NPieces; ++i)
+  {
+    m_Pieces[i].m_Start -= ub - lb;
+    m_Pieces[i].m_Line -= newlines;
+  }
+  m_Length -= ub - lb;
+  m_Newlines -= newlines;
+}
+
+// replaces count ranges of length characters, starting at the given ascending positions, with the same text; the pieces
+// are rebuilt in one pass, and the text between ranges closer than REPLACE_COPY_GAP is copied into the add source
+// along with the replacements, so that dense replacements don't leave a piece per range
+void  Buffer::Replace(const u32* positions, u32 count, u32 length, const EChar* str, u32 strLength)
+{
+  if (!count)
+  {
+    return;
+  }
+  
+  // the NUL character is the only one whose encoding has zero bytes
+  u8* encoded     = (u8*)malloc(4 * (u64)strLength + 1);
+  u64 strSize     = 0;
+  u32 strNewlines = 0;
+  for (u32 i = 0; i < strLength; ++i)
+  {
+    usize encodingLength  = str[i].EncodingLength();
+    encodingLength += !encodingLength;
+    
+    memcpy(&encoded[strSize], str[i].m_Encoding, encodingLength);
+    strSize += encodingLength;
+    strNewlines += str[i].m_Codepoint == '\n';
+  }
+  
+  Piece*  pieces        = (Piece*)malloc(sizeof(Piece) * (m_NPieces + 2 * count + 1));
+  u32     nPieces       = 0;
+  u64     textCapacity  = 4096;
+  u8*     text          = (u8*)malloc(textCapacity);
+  u64     textSize      = 0;
+  u32     textLength    = 0;
+  u32     textNewlines  = 0;
+  u32     runLength     = 0;  // text before the run of copied text which is yet to get a piece
+  u64     runSize       = 0;
+  u32     runNewlines   = 0;
+  u32     idx           = 0;
+  
+  auto  reserveText = [&](u64 size)
+  {
+    while (textSize + size > textCapacity)
+    {
+      textCapacity *= 2;
+      text = (u8*)realloc(text, textCapacity);
+    }
+  };
+  
+  auto  endRun  = [&]()
+  {
+    if (textLength > runLength)
+    {
+      pieces[nPieces++] = Piece
+      {
+        .m_Offset   = m_Add.m_Length + runLength,
+        .m_Length   = textLength - runLength,
+        .m_Start    = 0,
+        .m_Byte     = m_Add.m_Size + runSize,
+        .m_Size     = textSize - runSize,
+        .m_Newlines = textNewlines - runNewlines,
+        .m_Line     = 0,
+        .m_Source   = PIECE_ADD
+      };
+    }
+    
+    runLength = textLength;
+    runSize = textSize;
+    runNewlines = textNewlines;
+  };
+  
+  // the old text from lb to ub either keeps its pieces or is copied
+  auto  keep  = [&](u32 lb, u32 ub, bool copy)
+  {
+    while (lb < ub)
+    {
+      while (m_Pieces[idx].m_Start + m_Pieces[idx].m_Length <= lb)
+      {
+        ++idx;
+      }
+      
+      const Piece&  piece     = m_Pieces[idx];
+      const Source& source    = SourceOf(piece);
+      u32           from      = lb - piece.m_Start;
+      u32           to        = ub - piece.m_Start < piece.m_Length ? ub - piece.m_Start : piece.m_Length;
+      u64           byteFrom  = from ? source.ByteOffset(piece.m_Offset + from) : piece.m_Byte;
+      u64           byteTo    = piece.m_Byte + piece.m_Size;
+      if (to < piece.m_Length)
+      {
+        byteTo = source.ByteOffset(piece.m_Offset + to);
+      }
+      u32           newlines  = piece.m_Newlines;
+      if (from || to < piece.m_Length)
+      {
+        newlines = source.NewlinesBefore(piece.m_Offset + to) - source.NewlinesBefore(piece.m_Offset + from);
+      }
+      
+      if (copy)
+      {
+        reserveText(byteTo - byteFrom);
+        memcpy(&text[textSize], &source.m_Data[byteFrom], byteTo - byteFrom);
+        textSize += byteTo - byteFrom;
+        textLength += to - from;
+        textNewlines += newlines;
+      }
+      else
+      {
+        pieces[nPieces++] = Piece
+        {
+          .m_Offset   = piece.m_Offset + from,
+          .m_Length   = to - from,
+          .m_Start    = 0,
+          .m_Byte     = byteFrom,
+          .m_Size     = byteTo - byteFrom,
+          .m_Newlines = newlines,
+          .m_Line     = 0,
+          .m_Source   = piece.m_Source
+        };
+      }
+      
+      lb += to - from;
+    }
+  };
+  
+  u32 pos = 0;
+  for (u32 i = 0; i < count; ++i)
+  {
+    bool  copy  = i && positions[i] - pos < REPLACE_COPY_GAP;
+    if (!copy)
+    {
+      endRun();
+    }
+    keep(pos, positions[i], copy);
+    
+    reserveText(strSize);
+    memcpy(&text[textSize], encoded, strSize);
+    textSize += strSize;
+    textLength += strLength;
+    textNewlines += strNewlines;
+    
+    pos = positions[i] + length;
+  }
+  endRun();
+  keep(pos, m_Length, false);
+  
+  if (textSize)
+  {
+    m_Add.Append(text, textSize);
+  }
+  free(text);
+  free(encoded);
+  
+  u32 start = 0;
+  u32 line  = 0;
+  for (u32 i = 0; i < nPieces; ++i)
+  {
+    pieces[i].m_Start = start;
+    pieces[i].m_Line = line;
+    start += pieces[i].m_Length;
+    line += pieces[i].m_Newlines;
+  }
+  
+  free(m_Pieces);
+  m_Pieces = pieces;
+  m_NPieces = nPieces;
+  m_PieceCapacity = m_NPieces + 2 * count + 1;
+  m_Length = start;
+  m_Newlines = line;
+}
+
+void  Buffer::Copy(OUT EChar* dst, u32 lb, u32 ub) const
+{
+  for (BufferCursor cursor = Cursor(lb); cursor.m_Pos < ub; cursor.Next())
+  {
+    *dst++ = cursor.Get();
+  }
+}
+
+EString Buffer::Substring(u32 lb, u32 ub) const
+{
+  EString newString {};
+  newString.m_Data      = (EChar*)calloc(ub - lb, sizeof(EChar));
+  newString.m_Length    = ub - lb;
+  newString.m_Capacity  = ub - lb;
+  Copy(newString.m_Data, lb, ub);
+  
+  return (newString);
+}
+
+// copies the UTF-8 encoding of a range of text
+u8* Buffer::Bytes(u32 lb, u32 ub, OUT u64& size) const
+{
+  size = 0;
+  if (lb >= ub)
+  {
+    return ((u8*)malloc(1));
+  }
+  
+  BufferCursor  begin = Cursor(lb);
+  BufferCursor  end   = Cursor(ub);
+  for (u32 i = begin.m_Piece; i <= end.m_Piece; ++i)
+  {
+    u64 from  = i == begin.m_Piece ? begin.m_Byte : m_Pieces[i].m_Byte;
+    u64 to    = i == end.m_Piece ? end.m_Byte : m_Pieces[i].m_Byte + m_Pieces[i].m_Size;
+    size += to - from;
+  }
+  
+  u8* data    = (u8*)malloc(size);
+  u64 offset  = 0;
+  for (u32 i = begin.m_Piece; i <= end.m_Piece; ++i)
+  {
+    u64 from  = i == begin.m_Piece ? begin.m_Byte : m_Pieces[i].m_Byte;
+    u64 to    = i == end.m_Piece ? end.m_Byte : m_Pieces[i].m_Byte + m_Pieces[i].m_Size;
+    memcpy(&data[offset], &SourceOf(m_Pieces[i]).m_Data[from], to - from);
+    offset += to - from;
+  }
+  
+  return (data);
+}
+
+i32 Buffer::Print(FILE* file) const
+{
+  for (u32 i = 0; i < m_NPieces; ++i)
+  {
+    const Piece&  piece = m_Pieces[i];
+    if (fwrite(&SourceOf(piece).m_Data[piece.m_Byte], 1, piece.m_Size, file) != piece.m_Size)
+    {
+      return (1);
+    }
+  }
+  return (0);
+}
+
+const Source& Buffer::SourceOf(const Piece& piece) const
+{
+  return (piece.m_Source == PIECE_ORIGINAL ? m_Original : m_Add);
+}
+
+u32 Buffer::Split(u32 pos)
+{
+  if (pos >= m_Length)
+  {
+    return (m_NPieces);
+  }
+  
+  u32     idx   = FindPiece(pos);
+  Piece*  piece = &m_Pieces[idx];
+  if (piece->m_Start == pos)
+  {
+    return (idx);
+  }
+  
+  const Source& source        = SourceOf(*piece);
+  u32           headLength    = pos - piece->m_Start;
+  u64           tailByte      = source.ByteOffset(piece->m_Offset + headLength);
+  u32           headNewlines  = source.NewlinesBefore(piece->m_Offset + headLength) - source.NewlinesBefore(piece->m_Offset);
+  Piece         tail          =
+  {
+    .m_Offset   = piece->m_Offset + headLength,
+    .m_Length   = piece->m_Length - headLength,
+    .m_Start    = pos,
+    .m_Byte     = tailByte,
+    .m_Size     = piece->m_Byte + piece->m_Size - tailByte,
+    .m_Newlines = piece->m_Newlines - headNewlines,
+    .m_Line     = piece->m_Line + headNewlines,
+    .m_Source   = piece->m_Source
+  };
+  piece->m_Length = headLength;
+  piece->m_Size = tailByte - piece->m_Byte;
+  piece->m_Newlines = headNewlines;
+  InsertPiece(tail, idx + 1);
+  
+  return (idx + 1);
+}
+
+void  Buffer::InsertPiece(Piece piece, u32 idx)
+{
+  if (m_NPieces >= m_PieceCapacity)
+  {
+    m_PieceCapacity = m_PieceCapacity ? 2 * m_PieceCapacity : 1;
+    m_Pieces = (Piece*)reallocarray(m_Pieces, m_PieceCapacity, sizeof(Piece));
+  }
+  
+  memmove(&m_Pieces[idx + 1], &m_Pieces[idx], sizeof(Piece) * (m_NPieces - idx));
+  m_Pieces[idx] = piece;
+  ++m_NPieces;
+}
+
+EChar BufferCursor::Get() const
+{
+  if (AtEnd())
+  {
+    return (EChar{});
+  }
+  
+  return (EChar{&m_Data[m_Byte]});
+}
+
+u32 BufferCursor::Codepoint() const
+{
+  if (AtEnd())
+  {
+    return (0);
+  }
+  
+  // avoid a full decode for the common case
+  if (m_Data[m_Byte] < 0x80)
+  {
+    return (m_Data[m_Byte]);
+  }
+  
+  return (EChar{&m_Data[m_Byte]}.m_Codepoint);
+}
+
+bool  BufferCursor::AtEnd() const
+{
+  return (m_Pos >= m_Buffer->m_Length);
+}
+
+void  BufferCursor::Next()
+{
+  if (AtEnd())
+  {
+    return;
+  }
+  
+  ++m_Pos;
+  m_Byte += UTF8Length(m_Data[m_Byte]);
+  
+  const Piece&  piece = m_Buffer->m_Pieces[m_Piece];
+  if (m_Pos >= piece.m_Start + piece.m_Length && m_Piece + 1 < m_Buffer->m_NPieces)
+  {
+    EnterPiece(m_Piece + 1);
+  }
+}
+
+void  BufferCursor::Prev()
+{
+  if (!m_Pos)
+  {
+    return;
+  }
+  
+  --m_Pos;
+  
+  if (m_Pos < m_Buffer->m_Pieces[m_Piece].m_Start)
+  {
+    EnterPiece(m_Piece - 1);
+    
+    const Piece&  piece = m_Buffer->m_Pieces[m_Piece];
+    m_Byte = piece.m_Byte + piece.m_Size;
+  }
+  
+  do
+  {
+    --m_Byte;
+  } while ((m_Data[m_Byte] & 0xc0) == 0x80);
+}
+
+void  BufferCursor::EnterPiece(u32 idx)
+{
+  const Piece&  piece = m_Buffer->m_Pieces[idx];
+  m_Piece = idx;
+  m_Data = m_Buffer->SourceOf(piece).m_Data;
+  m_Byte = piece.m_Byte;
+}
+
+// bytes left in the current piece, which can be scanned directly from m_Data + m_Byte
+u64 BufferCursor::Contiguous() const
+{
+  if (AtEnd())
+  {
+    return (0);
+  }
+  
+  const Piece&  piece = m_Buffer->m_Pieces[m_Piece];
+  return (piece.m_Byte + piece.m_Size - m_Byte);
+}
+
+// the skipped characters must be ASCII and within the current piece
+void  BufferCursor::SkipASCII(u32 n)
+{
+  m_Pos += n;
+  m_Byte += n;
+  
+  const Piece&  piece = m_Buffer->m_Pieces[m_Piece];
+  if (m_Pos >= piece.m_Start + piece.m_Length && m_Piece + 1 < m_Buffer->m_NPieces)
+  {
+    EnterPiece(m_Piece + 1);
+  }
+}
+
+void  EmptyBuffer(OUT Buffer& buffer)
+{
+  buffer = Buffer{};
+}
+
+void  StringBuffer(OUT Buffer& buffer, const char* str)
+{
+  UTF8Buffer(buffer, (u8*)strdup(str), strlen(str));
+}
+
+void  UTF8Buffer(OUT Buffer& buffer, OWNS u8* data, u64 size)
+{
+  buffer = Buffer{};
+  data = SanitizeUTF8(data, size);
+  if (!size)
+  {
+    free(data);
+    return;
+  }
+  
+  buffer.m_Original.m_Data = data;
+  buffer.m_Original.m_Size = size;
+  buffer.m_Original.m_Capacity = size;
+  buffer.m_Original.Index(0);
+  buffer.m_Length = buffer.m_Original.m_Length;
+  buffer.m_Newlines = buffer.m_Original.m_NNewlines;
+  
+  Piece piece =
+  {
+    .m_Offset   = 0,
+    .m_Length   = buffer.m_Original.m_Length,
+    .m_Start    = 0,
+    .m_Byte     = 0,
+    .m_Size     = size,
+    .m_Newlines = buffer.m_Original.m_NNewlines,
+    .m_Line     = 0,
+    .m_Source   = PIECE_ORIGINAL
+  };
+  buffer.InsertPiece(piece, 0);
+}
+
+i32 MappedBuffer(OUT Buffer& buffer, const char* path)
+{
+  int fd  = open(path, O_RDONLY);
+  if (fd == -1)
+  {
+    return (1);
+  }
+  
+  // anything that can't be mapped is left to be read normally
+  struct stat fileStat  {};
+  if (fstat(fd, &fileStat) || !S_ISREG(fileStat.st_mode) || !fileStat.st_size)
+  {
+    close(fd);
+    return (1);
+  }
+  
+  u64 size  = fileStat.st_size;
+  u8* data  = (u8*)mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED)
+  {
+    return (1);
+  }
+  
+  u32 length    = 0;
+  u32 newlines  = 0;
+  if (!ScanUTF8(data, size, length, newlines))
+  {
+    // malformed text needs replacing, which can't be done in place
+    u8* copy  = (u8*)malloc(size);
+    memcpy(copy, data, size);
+    munmap(data, size);
+    UTF8Buffer(buffer, copy, size);
+    return (0);
+  }
+  
+  SourceIndexer*  indexer = (SourceIndexer*)calloc(1, sizeof(SourceIndexer));
+  indexer->m_Data = data;
+  indexer->m_Size = size;
+  indexer->m_Newlines = (u32*)calloc(newlines ? newlines : 1, sizeof(u32));
+  if (length != size)
+  {
+    indexer->m_Checkpoints = (u64*)calloc(length / SOURCE_CHECKPOINT + 1, sizeof(u64));
+  }
+  pthread_mutex_init(&indexer->m_Mutex, nullptr);
+  pthread_cond_init(&indexer->m_Progress, nullptr);
+  
+  buffer = Buffer{};
+  buffer.m_Original =
+  {
+    .m_Data               = data,
+    .m_Size               = size,
+    .m_Capacity           = size,
+    .m_Length             = length,
+    .m_Checkpoints        = indexer->m_Checkpoints,
+    .m_NCheckpoints       = indexer->m_Checkpoints ? length / SOURCE_CHECKPOINT + 1 : 0,
+    .m_CheckpointCapacity = indexer->m_Checkpoints ? length / SOURCE_CHECKPOINT + 1 : 0,
+    .m_Newlines           = indexer->m_Newlines,
+    .m_NNewlines          = newlines,
+    .m_NewlineCapacity    = newlines ? newlines : 1,
+    .m_Indexer            = indexer,
+    .m_Mapped             = true
+  };
+  buffer.m_Length = length;
+  buffer.m_Newlines = newlines;
+  
+  Piece piece =
+  {
+    .m_Offset   = 0,
+    .m_Length   = length,
+    .m_Start    = 0,
+    .m_Byte     = 0,
+    .m_Size     = size,
+    .m_Newlines = newlines,
+    .m_Line     = 0,
+    .m_Source   = PIECE_ORIGINAL
+  };
+  buffer.InsertPiece(piece, 0);
+  
+  if (pthread_create(&indexer->m_Thread, nullptr, IndexSource, indexer))
+  {
+    // index synchronously if no thread could be started
+    IndexSource(indexer);
+    pthread_mutex_destroy(&indexer->m_Mutex);
+    pthread_cond_destroy(&indexer->m_Progress);
+    free(indexer);
+    buffer.m_Original.m_Indexer = nullptr;
+  }
+  
+  return (0);
+}
+
+static u8*  SanitizeUTF8(OWNS u8* data, IN_OUT u64& size)
+{
+  // malformed sequences are replaced byte by byte, which is only worked out once the text is known to need it
+  u32 length    = 0;
+  u32 newlines  = 0;
+  if (ScanUTF8(data, size, length, newlines))
+  {
+    return (data);
+  }
+  
+  u64 newSize = 0;
+  for (u64 i = 0; i < size;)
+  {
+    usize length  = ValidUTF8Length(&data[i], size - i);
+    newSize += length ? length : EChar{REPLACEMENT_CHAR}.EncodingLength();
+    i += length ? length : 1;
+  }
+  
+  if (newSize == size)
+  {
+    return (data);
+  }
+  
+  EChar replacement = REPLACEMENT_CHAR;
+  u8*   newData     = (u8*)malloc(newSize);
+  for (u64 i = 0, j = 0; i < size;)
+  {
+    usize length  = ValidUTF8Length(&data[i], size - i);
+    if (length)
+    {
+      memcpy(&newData[j], &data[i], length);
+      i += length;
+      j += length;
+    }
+    else
+    {
+      memcpy(&newData[j], replacement.m_Encoding, replacement.EncodingLength());
+      i += 1;
+      j += replacement.EncodingLength();
+    }
+  }
+  
+  free(data);
+  size = newSize;
+  return (newData);
+}
+
+static void*  IndexSource(void* indexer)
+{
+  SourceIndexer*  idx = (SourceIndexer*)indexer;
+  
+  u32 length        = 0;
+  u32 nNewlines     = 0;
+  u32 nCheckpoints  = 0;
+  for (u64 i = 0; i < idx->m_Size && !__atomic_load_n(&idx->m_Cancel, __ATOMIC_RELAXED);)
+  {
+    u64 blockEnd  = i + INDEX_BLOCK_SIZE < idx->m_Size ? i + INDEX_BLOCK_SIZE : idx->m_Size;
+    
+    // characters are bytes in pure ASCII sources, so only newlines need finding
+    for (; !idx->m_Checkpoints && i < blockEnd; ++i)
+    {
+      const u8* newline = (const u8*)memchr(&idx->m_Data[i], '\n', blockEnd - i);
+      if (!newline)
+      {
+        i = blockEnd;
+        break;
+      }
+      
+      i = newline - idx->m_Data;
+      idx->m_Newlines[nNewlines++] = i;
+    }
+    length = idx->m_Checkpoints ? length : i;
+    
+    for (; i < blockEnd; i += UTF8Length(idx->m_Data[i]))
+    {
+      if (idx->m_Checkpoints && length % SOURCE_CHECKPOINT == 0)
+      {
+        idx->m_Checkpoints[nCheckpoints++] = i;
+      }
+      
+      if (idx->m_Data[i] == '\n')
+      {
+        idx->m_Newlines[nNewlines++] = length;
+      }
+      
+      ++length;
+    }
+    
+    pthread_mutex_lock(&idx->m_Mutex);
+    idx->m_Length = length;
+    idx->m_NNewlines = nNewlines;
+    pthread_cond_broadcast(&idx->m_Progress);
+    pthread_mutex_unlock(&idx->m_Mutex);
+  }
+  
+  pthread_mutex_lock(&idx->m_Mutex);
+  __atomic_store_n(&idx->m_Done, true, __ATOMIC_RELEASE);
+  pthread_cond_broadcast(&idx->m_Progress);
+  pthread_mutex_unlock(&idx->m_Mutex);
+  
+  return (nullptr);
+}
+
+static void StopIndexer(OWNS SourceIndexer* indexer, bool cancel)
+{
+  __atomic_store_n(&indexer->m_Cancel, cancel, __ATOMIC_RELAXED);
+  pthread_join(indexer->m_Thread, nullptr);
+  pthread_mutex_destroy(&indexer->m_Mutex);
+  pthread_cond_destroy(&indexer->m_Progress);
+  free(indexer);
+}
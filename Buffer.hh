@@ -0,0 +1,140 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#pragma once
+
+#include <Encoding.hh>
+#include <Util.hh>
+
+extern "C"
+{
+#include <pthread.h>
+}
+
+enum PieceSource : u8
+{
+  PIECE_ORIGINAL = 0,
+  PIECE_ADD
+};
+
+constexpr u32 SOURCE_CHECKPOINT = 256;
+constexpr u64 INDEX_BLOCK_SIZE  = 1 << 20;
+constexpr u32 REPLACE_COPY_GAP  = 4096;
+
+// state shared with the thread indexing a mapped source; the arrays are allocated up front so that they never move
+// while being filled, and only entries covered by m_Length and m_NNewlines may be read
+struct SourceIndexer
+{
+  pthread_t       m_Thread;
+  pthread_mutex_t m_Mutex;
+  pthread_cond_t  m_Progress;
+  const u8*       m_Data;
+  u64             m_Size;
+  u64*            m_Checkpoints;
+  u32*            m_Newlines;
+  u32             m_Length;
+  u32             m_NNewlines;
+  bool            m_Done;
+  bool            m_Cancel;
+};
+
+// append-only, well-formed UTF-8 text; a checkpoint is kept every SOURCE_CHECKPOINT characters so that character
+// positions can be converted to byte offsets without decoding the source from the start, and the position of every
+// newline is kept so that lines can be found without scanning; mapped sources are indexed in the background, and
+// queries block until the part of the index they need is available
+struct Source
+{
+  u8*             m_Data;
+  u64             m_Size;
+  u64             m_Capacity;
+  u32             m_Length;
+  u64*            m_Checkpoints;
+  u32             m_NCheckpoints;
+  u32             m_CheckpointCapacity;
+  u32*            m_Newlines;
+  u32             m_NNewlines;
+  u32             m_NewlineCapacity;
+  SourceIndexer*  m_Indexer;  // only set while a mapped source is indexed
+  bool            m_Mapped;
+  
+  void  Free();
+  void  Append(const u8* data, u64 size);
+  void  Append(const EChar* str, u32 length);
+  void  Reserve(u64 size);
+  void  Index(u64 from);
+  u64   ByteOffset(u32 pos) const;
+  u32   NewlinesBefore(u32 pos) const;
+  u32   Newline(u32 idx) const;
+  u32   Wait(u32 pos, u32 newlines) const;
+  void  Detach();
+};
+
+struct Piece
+{
+  u32         m_Offset; // position in source
+  u32         m_Length;
+  u32         m_Start;  // position in buffer
+  u64         m_Byte;   // byte offset in source
+  u64         m_Size;
+  u32         m_Newlines;
+  u32         m_Line;   // newlines in buffer before piece
+  PieceSource m_Source;
+};
+
+struct BufferCursor;
+
+// piece table; the original text is never modified, and all inserted text is appended to the add source
+struct Buffer
+{
+  Source  m_Original;
+  Source  m_Add;
+  Piece*  m_Pieces;
+  u32     m_NPieces;
+  u32     m_PieceCapacity;
+  u32     m_Length;
+  u32     m_Newlines;
+  
+  void          Free();
+  EChar         At(u32 pos) const;
+  BufferCursor  Cursor(u32 pos) const;
+  u32           FindPiece(u32 pos) const;
+  u32           LineBegin(u32 pos) const;
+  u32           LineEnd(u32 pos) const;
+  u32           LineCount() const;
+  u32           LineOf(u32 pos) const;
+  u32           LineOffset(u32 line) const;
+  void          Insert(const EChar* str, u32 length, u32 pos);
+  void          Insert(const EString& str, u32 pos);
+  void          Erase(u32 lb, u32 ub);
+  void          Replace(const u32* positions, u32 count, u32 length, const EChar* str, u32 strLength);
+  void          Copy(OUT EChar* dst, u32 lb, u32 ub) const;
+  EString       Substring(u32 lb, u32 ub) const;
+  u8*           Bytes(u32 lb, u32 ub, OUT u64& size) const;
+  i32           Print(FILE* file) const;
+  const Source& SourceOf(const Piece& piece) const;
+  u32           Split(u32 pos);
+  void          InsertPiece(Piece piece, u32 idx);
+};
+
+// cursors are invalidated by any modification of their buffer
+struct BufferCursor
+{
+  const Buffer* m_Buffer;
+  const u8*     m_Data;   // data of the current piece's source
+  u32           m_Pos;
+  u32           m_Piece;
+  u64           m_Byte;   // byte offset in source
+  
+  EChar Get() const;
+  u32   Codepoint() const;
+  bool  AtEnd() const;
+  void  Next();
+  void  Prev();
+  void  EnterPiece(u32 idx);
+  u64   Contiguous() const;
+  void  SkipASCII(u32 n);
+};
+
+void  EmptyBuffer(OUT Buffer& buffer);
+void  StringBuffer(OUT Buffer& buffer, const char* str);
+void  UTF8Buffer(OUT Buffer& buffer, OWNS u8* data, u64 size);
+i32   MappedBuffer(OUT Buffer& buffer, const char* path);
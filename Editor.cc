@@ -4,9 +4,18 @@
 #include <Binds.hh>
 #include <cstring>
 #include <Editor.hh>
+#include <Highlight.hh>
 #include <Input.hh>
 #include <Render.hh>
 
+extern "C"
+{
+#include <poll.h>
+#include <unistd.h>
+}
+
+static void WaitInput();
+
 Editor  g_Editor;
 
 i32 InitEditor()
@@ -31,18 +40,34 @@ i32 InitEditor()
     StringFrame(g_Editor.m_Frames[g_Editor.m_NFrames++], FRAME::GREETER_TEXT);
   }
   
+  InitBinds();
   InstallBaseBinds();
   
   return (0);
 }
 
+// input which is already waiting is handled before anything is rendered, so that held keys and pastes aren't held back
+// by terminal output; while input keeps coming, the editor is still rendered at up to MaxFrameRate, and macros are
+// executed without rendering at all
 void  EditorLoop()
 {
+  u64   interval    = g_Options.m_MaxFrameRate ? 1000000000 / g_Options.m_MaxFrameRate : 0;
+  u64   lastPresent = 0;
+  bool  dirty       = true;
+  
   g_Editor.m_Running = true;
   while (g_Editor.m_Running)
   {
-    RenderEditor();
-    RenderPresent();
+    if (dirty && !IsExecutingMacro() && (!interval || MonotonicTime() - lastPresent >= interval || !InputPending()))
+    {
+      RenderEditor();
+      RenderPresent();
+      lastPresent = MonotonicTime();
+      dirty = false;
+    }
+    
+    WaitInput();
+    dirty = true;
     
     EChar input = ReadKey();
     if (g_Editor.m_WriteInput && WritableToEditor(input))
@@ -138,3 +163,66 @@ Frame&  CurrentFrame()
 {
   return (g_Editor.m_Frames[g_Editor.m_CurFrame]);
 }
+
+bool  InputPending()
+{
+  if (IsExecutingMacro() || PendingEChar())
+  {
+    return (true);
+  }
+  
+  pollfd  fd  = {.fd = STDIN_FILENO, .events = POLLIN, .revents = 0};
+  return (poll(&fd, 1, 0) > 0);
+}
+
+// highlighting finishes in the background, so the editor is redrawn whenever it does until there is input to handle;
+// search matches are indexed a slice at a time meanwhile, redrawing after each so that their count keeps up
+static void WaitInput()
+{
+  if (IsExecutingMacro() || PendingEChar())
+  {
+    return;
+  }
+  
+  for (;;)
+  {
+    bool  indexing  = false;
+    for (usize i = 0; i < g_Editor.m_NFrames; ++i)
+    {
+      indexing = indexing || !g_Editor.m_Frames[i].m_MatchIndex.Done(g_Editor.m_Frames[i].m_Buffer);
+    }
+    
+    pollfd  fds[2]  =
+    {
+      {.fd = STDIN_FILENO, .events = POLLIN, .revents = 0},
+      {.fd = HighlightNotifier(), .events = POLLIN, .revents = 0}
+    };
+    
+    if (poll(fds, 2, indexing ? 0 : -1) < 0 || fds[0].revents)
+    {
+      return;
+    }
+    
+    if (fds[1].revents)
+    {
+      u8  drain[64];
+      while (read(fds[1].fd, drain, sizeof(drain)) > 0)
+      {
+      }
+      
+      RenderEditor();
+      RenderPresent();
+    }
+    
+    if (indexing)
+    {
+      for (usize i = 0; i < g_Editor.m_NFrames; ++i)
+      {
+        g_Editor.m_Frames[i].m_MatchIndex.Step(g_Editor.m_Frames[i].m_Buffer);
+      }
+      
+      RenderEditor();
+      RenderPresent();
+    }
+  }
+}
@@ -24,5 +24,6 @@ void    EditorLoop();
 void    ArrangeFrame(usize idx, OUT u32& x, OUT u32& y, OUT u32& w, OUT u32& h);
 void    RenderEditor();
 bool    WritableToEditor(EChar ch);
+bool    InputPending();
 void    DestroyFrame(usize idx);
 Frame&  CurrentFrame();
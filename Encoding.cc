@@ -5,6 +5,100 @@
 #include <cstring>
 #include <Encoding.hh>
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#ifdef __x86_64__
+#include <immintrin.h>
+#define UTF8_DISPATCH
+#endif
+
+extern "C"
+{
+#include <unistd.h>
+}
+
+static u32  SequenceLength(u8 lead);
+static bool ScanUTF8Scalar(const u8* data, u64 size, OUT u32& length, OUT u32& newlines);
+#ifdef UTF8_DISPATCH
+static u64  SumBytes(__m128i counts);
+static u64  SumBytes(__m256i counts);
+static bool ScanUTF8SSSE3(const u8* data, u64 size, OUT u32& length, OUT u32& newlines);
+static bool ScanUTF8AVX2(const u8* data, u64 size, OUT u32& length, OUT u32& newlines);
+#endif
+
+// vector validation classifies every pair of adjacent bytes through three table lookups, by the high nibble of the
+// first byte, the low nibble of the first byte and the high nibble of the second byte; the results are ANDed, so that
+// any bit which survives marks an error, except for UTF8_TWO_CONTINUATIONS, which must survive exactly where the lead
+// byte two or three places back requires a third or fourth byte
+enum UTF8Error : u8
+{
+  UTF8_TOO_SHORT            = 0x1,  // lead byte not followed by a continuation byte
+  UTF8_TOO_LONG             = 0x2,  // continuation byte after ASCII
+  UTF8_OVERLONG_3           = 0x4,
+  UTF8_TOO_LARGE            = 0x8,  // above U+10FFFF
+  UTF8_SURROGATE            = 0x10,
+  UTF8_OVERLONG_2           = 0x20,
+  UTF8_TOO_LARGE_1000       = 0x40, // also marks 4 byte overlong encodings
+  UTF8_OVERLONG_4           = 0x40,
+  UTF8_TWO_CONTINUATIONS    = 0x80
+};
+
+constexpr u8  UTF8_CARRY  = UTF8_TOO_SHORT | UTF8_TOO_LONG | UTF8_TWO_CONTINUATIONS;
+
+constexpr u8  UTF8_BYTE_1_HIGH[16]  =
+{
+  UTF8_TOO_LONG, UTF8_TOO_LONG, UTF8_TOO_LONG, UTF8_TOO_LONG,
+  UTF8_TOO_LONG, UTF8_TOO_LONG, UTF8_TOO_LONG, UTF8_TOO_LONG,
+  UTF8_TWO_CONTINUATIONS, UTF8_TWO_CONTINUATIONS, UTF8_TWO_CONTINUATIONS, UTF8_TWO_CONTINUATIONS,
+  UTF8_TOO_SHORT | UTF8_OVERLONG_2,
+  UTF8_TOO_SHORT,
+  UTF8_TOO_SHORT | UTF8_OVERLONG_3 | UTF8_SURROGATE,
+  UTF8_TOO_SHORT | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000 | UTF8_OVERLONG_4
+};
+
+constexpr u8  UTF8_BYTE_1_LOW[16] =
+{
+  UTF8_CARRY | UTF8_OVERLONG_3 | UTF8_OVERLONG_2 | UTF8_OVERLONG_4,
+  UTF8_CARRY | UTF8_OVERLONG_2,
+  UTF8_CARRY,
+  UTF8_CARRY,
+  UTF8_CARRY | UTF8_TOO_LARGE,
+  UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+  UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+  UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+  UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+  UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+  UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+  UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+  UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+  UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000 | UTF8_SURROGATE,
+  UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+  UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000
+};
+
+constexpr u8  UTF8_BYTE_2_HIGH[16]  =
+{
+  UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT,
+  UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT,
+  UTF8_TOO_LONG | UTF8_OVERLONG_2 | UTF8_TWO_CONTINUATIONS | UTF8_OVERLONG_3 | UTF8_TOO_LARGE_1000 | UTF8_OVERLONG_4,
+  UTF8_TOO_LONG | UTF8_OVERLONG_2 | UTF8_TWO_CONTINUATIONS | UTF8_OVERLONG_3 | UTF8_TOO_LARGE,
+  UTF8_TOO_LONG | UTF8_OVERLONG_2 | UTF8_TWO_CONTINUATIONS | UTF8_SURROGATE | UTF8_TOO_LARGE,
+  UTF8_TOO_LONG | UTF8_OVERLONG_2 | UTF8_TWO_CONTINUATIONS | UTF8_SURROGATE | UTF8_TOO_LARGE,
+  UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT
+};
+
+// the largest values that the last three bytes of a block can take without starting a sequence that continues into the
+// next block
+constexpr u8  UTF8_INCOMPLETE[32] =
+{
+  0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+  0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xef, 0xdf, 0xbf
+};
+
+static UTF8Reader g_Input;  // m_FD starts out as 0, which is STDIN_FILENO
+
 bool  EChar::IsPrint() const
 {
   if (m_Codepoint <= 0x1f
@@ -275,9 +369,116 @@ EString::EString(const char* cString)
   m_Data = (EChar*)reallocarray(m_Data, m_Length, sizeof(EChar));
 }
 
+usize ValidUTF8Length(const u8* ptr, usize size)
+{
+  if (ptr[0] < 0x80)
+  {
+    return (1);
+  }
+  
+  usize length    {};
+  u32   minimum   {};
+  u32   codepoint {};
+  if ((ptr[0] & 0xe0) == 0xc0)
+  {
+    length = 2;
+    minimum = 0x80;
+    codepoint = ptr[0] & 0x1f;
+  }
+  else if ((ptr[0] & 0xf0) == 0xe0)
+  {
+    length = 3;
+    minimum = 0x800;
+    codepoint = ptr[0] & 0xf;
+  }
+  else if ((ptr[0] & 0xf8) == 0xf0)
+  {
+    length = 4;
+    minimum = 0x10000;
+    codepoint = ptr[0] & 0x7;
+  }
+  else
+  {
+    return (0);
+  }
+  
+  if (length > size)
+  {
+    return (0);
+  }
+  
+  for (usize i = 1; i < length; ++i)
+  {
+    if ((ptr[i] & 0xc0) != 0x80)
+    {
+      return (0);
+    }
+    codepoint = codepoint << 6 | (ptr[i] & 0x3f);
+  }
+  
+  // reject overlong encodings, surrogates and values beyond the unicode range
+  if (codepoint < minimum || codepoint > 0x10ffff || (codepoint >= 0xd800 && codepoint <= 0xdfff))
+  {
+    return (0);
+  }
+  
+  return (length);
+}
+
+// validates UTF-8 text and counts its characters and newlines, with the widest vector unit the processor supports
+bool  ScanUTF8(const u8* data, u64 size, OUT u32& length, OUT u32& newlines)
+{
+#ifdef UTF8_DISPATCH
+  using Scan  = bool (*)(const u8*, u64, u32&, u32&);
+  static const Scan scan  = __builtin_cpu_supports("avx2") ? ScanUTF8AVX2
+                            : __builtin_cpu_supports("ssse3") ? ScanUTF8SSSE3
+                            : ScanUTF8Scalar;
+  return (scan(data, size, length, newlines));
+#else
+  return (ScanUTF8Scalar(data, size, length, newlines));
+#endif
+}
+
+// counts the characters of well-formed UTF-8 text, which are its bytes other than continuation bytes
+u64 CountUTF8(const u8* data, u64 size)
+{
+  u64 count = 0;
+  u64 i     = 0;
+
+#ifdef __SSE2__
+  // per-lane counts are summed before they can overflow, every 255 blocks
+  const __m128i leads = _mm_set1_epi8(-65);
+  while (i + 16 <= size)
+  {
+    __m128i counts  = _mm_setzero_si128();
+    for (u32 block = 0; block < 255 && i + 16 <= size; ++block, i += 16)
+    {
+      __m128i input = _mm_loadu_si128((const __m128i*)&data[i]);
+      counts = _mm_sub_epi8(counts, _mm_cmpgt_epi8(input, leads));
+    }
+    
+    __m128i sums  = _mm_sad_epu8(counts, _mm_setzero_si128());
+    count += _mm_cvtsi128_si32(sums) + _mm_cvtsi128_si32(_mm_unpackhi_epi64(sums, sums));
+  }
+#endif
+
+  for (; i < size; ++i)
+  {
+    count += (i8)data[i] > -65;
+  }
+  
+  return (count);
+}
+
+// stdin is read through a reader, so that a burst of input such as a paste takes one read() rather than one per byte
 EChar ReadEChar()
 {
-  return (ReadEChar(stdin));
+  return (g_Input.Read());
+}
+
+bool  PendingEChar()
+{
+  return (g_Input.Pending());
 }
 
 EChar ReadEChar(FILE* file)
@@ -375,3 +576,349 @@ i32 PrintEChar(FILE* file, EChar ch)
   }
   return (0);
 }
+
+EChar UTF8Reader::Read()
+{
+  if (m_NextDecoded < m_NDecoded)
+  {
+    return (m_Decoded[m_NextDecoded++]);
+  }
+  
+  m_NextDecoded = 0;
+  m_NDecoded = Decode(m_Decoded, UTF8_READER_SIZE);
+  while (!m_NDecoded)
+  {
+    isize nRead = Fill();
+    if (nRead <= 0)
+    {
+      // a sequence cut short by the end of input can never be completed
+      m_Begin += nRead == 0 && m_Begin != m_End;
+      return (REPLACEMENT_CHAR);
+    }
+    
+    m_NDecoded = Decode(m_Decoded, UTF8_READER_SIZE);
+  }
+  
+  return (m_Decoded[m_NextDecoded++]);
+}
+
+// anything buffered is either decoded already or the start of a sequence whose rest is on the way
+bool  UTF8Reader::Pending() const
+{
+  return (m_NextDecoded < m_NDecoded || m_Begin != m_End);
+}
+
+// reads once into the free part of the ring buffer; interruptions by signals aren't retried, so that the caller gets a
+// chance to react to them like to any other failed read
+isize UTF8Reader::Fill()
+{
+  u32   at    = m_End % UTF8_READER_SIZE;
+  u32   space = UTF8_READER_SIZE - (m_End - m_Begin);
+  isize nRead = read(m_FD, &m_Data[at], space < UTF8_READER_SIZE - at ? space : UTF8_READER_SIZE - at);
+  if (nRead > 0)
+  {
+    m_End += nRead;
+  }
+  
+  return (nRead);
+}
+
+// decodes up to n whole codepoints, following the same rules as ReadEChar(FILE*) so that malformed input decodes the
+// same either way
+u32 UTF8Reader::Decode(OUT EChar* dst, u32 n)
+{
+  u32 count = 0;
+  while (count < n && m_Begin != m_End)
+  {
+    u32 at  = m_Begin % UTF8_READER_SIZE;
+
+#ifdef __SSE2__
+    // runs of ASCII are converted 16 bytes at a time
+    u32 contiguous  = m_End - m_Begin < UTF8_READER_SIZE - at ? m_End - m_Begin : UTF8_READER_SIZE - at;
+    if (contiguous >= sizeof(__m128i) && n - count >= sizeof(__m128i)
+        && !_mm_movemask_epi8(_mm_loadu_si128((const __m128i*)&m_Data[at])))
+    {
+      for (u32 i = 0; i < sizeof(__m128i); ++i)
+      {
+        dst[count + i] = EChar{(u32)m_Data[at + i]};
+      }
+      count += sizeof(__m128i);
+      m_Begin += sizeof(__m128i);
+      continue;
+    }
+#endif
+
+    u32 length  = SequenceLength(m_Data[at]);
+    if (length > m_End - m_Begin)
+    {
+      break;
+    }
+    
+    u8  sequence[4] {};
+    for (u32 i = 0; i < length; ++i)
+    {
+      sequence[i] = m_Data[(m_Begin + i) % UTF8_READER_SIZE];
+    }
+    dst[count++] = EChar{EChar{sequence}.m_Codepoint};
+    m_Begin += length;
+  }
+  
+  return (count);
+}
+
+// number of bytes ReadEChar(FILE*) takes for a lead byte; stray continuation bytes and invalid lead bytes stand alone
+static u32  SequenceLength(u8 lead)
+{
+  if (lead < 0xc0)
+  {
+    return (1);
+  }
+  else if (lead < 0xe0)
+  {
+    return (2);
+  }
+  else if (lead < 0xf0)
+  {
+    return (3);
+  }
+  else if (lead < 0xf8)
+  {
+    return (4);
+  }
+  else
+  {
+    return (1);
+  }
+}
+
+// skips over ASCII eight bytes at a time
+static bool ScanUTF8Scalar(const u8* data, u64 size, OUT u32& length, OUT u32& newlines)
+{
+  constexpr u64 HIGH_BITS = 0x8080808080808080;
+  constexpr u64 LOW_BITS  = 0x7f7f7f7f7f7f7f7f;
+  constexpr u64 NEWLINES  = 0x0a0a0a0a0a0a0a0a;
+  
+  length = 0;
+  newlines = 0;
+  for (u64 i = 0; i < size;)
+  {
+    u64 word  {};
+    if (i + sizeof(word) <= size)
+    {
+      memcpy(&word, &data[i], sizeof(word));
+      if (!(word & HIGH_BITS))
+      {
+        // exact zero byte test, since carries can't leave a byte without its high bit set
+        u64 match = word ^ NEWLINES;
+        match = ~(((match & LOW_BITS) + LOW_BITS) | match | LOW_BITS);
+        
+        newlines += __builtin_popcountll(match);
+        length += sizeof(word);
+        i += sizeof(word);
+        continue;
+      }
+    }
+    
+    // same rules as ValidUTF8Length, checked on the lead and second byte to avoid decoding
+    u8  lead    = data[i];
+    u8  second  = i + 1 < size ? data[i + 1] : 0;
+    if (lead < 0x80)
+    {
+      newlines += lead == '\n';
+      i += 1;
+    }
+    else if (lead >= 0xc2 && lead < 0xe0 && (second & 0xc0) == 0x80)
+    {
+      i += 2;
+    }
+    else if (lead >= 0xe0 && lead < 0xf0 && i + 2 < size
+             && (second & 0xc0) == 0x80 && (data[i + 2] & 0xc0) == 0x80
+             && (lead != 0xe0 || second >= 0xa0) && (lead != 0xed || second < 0xa0))
+    {
+      i += 3;
+    }
+    else if (lead >= 0xf0 && lead < 0xf5 && i + 3 < size
+             && (second & 0xc0) == 0x80 && (data[i + 2] & 0xc0) == 0x80 && (data[i + 3] & 0xc0) == 0x80
+             && (lead != 0xf0 || second >= 0x90) && (lead != 0xf4 || second < 0x90))
+    {
+      i += 4;
+    }
+    else
+    {
+      return (false);
+    }
+    
+    ++length;
+  }
+  
+  return (true);
+}
+
+#ifdef UTF8_DISPATCH
+// the text is handled in blocks of 16 bytes, the last of which is padded with zeros; padding is ASCII, so it also
+// ends any sequence left incomplete by the text
+__attribute__((target("ssse3")))
+static bool ScanUTF8SSSE3(const u8* data, u64 size, OUT u32& length, OUT u32& newlines)
+{
+  const __m128i byte1High   = _mm_loadu_si128((const __m128i*)UTF8_BYTE_1_HIGH);
+  const __m128i byte1Low    = _mm_loadu_si128((const __m128i*)UTF8_BYTE_1_LOW);
+  const __m128i byte2High   = _mm_loadu_si128((const __m128i*)UTF8_BYTE_2_HIGH);
+  const __m128i incomplete  = _mm_loadu_si128((const __m128i*)&UTF8_INCOMPLETE[16]);
+  const __m128i nibble      = _mm_set1_epi8(0xf);
+  const __m128i leads       = _mm_set1_epi8(-65);  // bytes greater than this as signed aren't continuations
+  const __m128i newline     = _mm_set1_epi8('\n');
+  
+  __m128i previous            = _mm_setzero_si128();
+  __m128i previousIncomplete  = _mm_setzero_si128();
+  __m128i error               = _mm_setzero_si128();
+  __m128i charCounts          = _mm_setzero_si128(); // per byte lane, emptied before they can overflow
+  __m128i newlineCounts       = _mm_setzero_si128();
+  u32     nCounted            = 0;
+  u64     nChars              = 0;
+  u64     nNewlines           = 0;
+  for (u64 i = 0; i <= size; i += sizeof(__m128i))
+  {
+    __m128i input {};
+    if (i + sizeof(__m128i) <= size)
+    {
+      input = _mm_loadu_si128((const __m128i*)&data[i]);
+    }
+    else
+    {
+      u8  tail[sizeof(__m128i)] {};
+      memcpy(tail, &data[i], size - i);
+      input = _mm_loadu_si128((const __m128i*)tail);
+      nChars -= sizeof(__m128i) - (size - i);
+    }
+    
+    charCounts = _mm_sub_epi8(charCounts, _mm_cmpgt_epi8(input, leads));
+    newlineCounts = _mm_sub_epi8(newlineCounts, _mm_cmpeq_epi8(input, newline));
+    if (++nCounted == 255 || i + sizeof(__m128i) > size)
+    {
+      nChars += SumBytes(charCounts);
+      nNewlines += SumBytes(newlineCounts);
+      charCounts = _mm_setzero_si128();
+      newlineCounts = _mm_setzero_si128();
+      nCounted = 0;
+    }
+    
+    if (!_mm_movemask_epi8(input))
+    {
+      // ASCII is valid as long as the previous block didn't end mid-sequence
+      error = _mm_or_si128(error, previousIncomplete);
+    }
+    else
+    {
+      __m128i prev1     = _mm_alignr_epi8(input, previous, sizeof(__m128i) - 1);
+      __m128i prev2     = _mm_alignr_epi8(input, previous, sizeof(__m128i) - 2);
+      __m128i prev3     = _mm_alignr_epi8(input, previous, sizeof(__m128i) - 3);
+      __m128i special   = _mm_and_si128(
+        _mm_and_si128(_mm_shuffle_epi8(byte1High, _mm_and_si128(_mm_srli_epi16(prev1, 4), nibble)),
+                      _mm_shuffle_epi8(byte1Low, _mm_and_si128(prev1, nibble))),
+        _mm_shuffle_epi8(byte2High, _mm_and_si128(_mm_srli_epi16(input, 4), nibble)));
+      __m128i third     = _mm_subs_epu8(prev2, _mm_set1_epi8(0xe0 - 0x80));
+      __m128i fourth    = _mm_subs_epu8(prev3, _mm_set1_epi8(0xf0 - 0x80));
+      __m128i required  = _mm_and_si128(_mm_or_si128(third, fourth), _mm_set1_epi8(0x80));
+      error = _mm_or_si128(error, _mm_xor_si128(required, special));
+    }
+    
+    previousIncomplete = _mm_subs_epu8(input, incomplete);
+    previous = input;
+  }
+  
+  length = nChars;
+  newlines = nNewlines;
+  return (_mm_movemask_epi8(_mm_cmpeq_epi8(error, _mm_setzero_si128())) == 0xffff);
+}
+
+// same as ScanUTF8SSSE3() with blocks of 32 bytes; shuffles only work within 16 byte lanes, so the tables are repeated
+// in both lanes, and the bytes preceding a lane are brought in from across lanes
+__attribute__((target("avx2")))
+static bool ScanUTF8AVX2(const u8* data, u64 size, OUT u32& length, OUT u32& newlines)
+{
+  const __m256i byte1High   = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)UTF8_BYTE_1_HIGH));
+  const __m256i byte1Low    = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)UTF8_BYTE_1_LOW));
+  const __m256i byte2High   = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)UTF8_BYTE_2_HIGH));
+  const __m256i incomplete  = _mm256_loadu_si256((const __m256i*)UTF8_INCOMPLETE);
+  const __m256i nibble      = _mm256_set1_epi8(0xf);
+  const __m256i leads       = _mm256_set1_epi8(-65);
+  const __m256i newline     = _mm256_set1_epi8('\n');
+  
+  __m256i previous            = _mm256_setzero_si256();
+  __m256i previousIncomplete  = _mm256_setzero_si256();
+  __m256i error               = _mm256_setzero_si256();
+  __m256i charCounts          = _mm256_setzero_si256(); // per byte lane, emptied before they can overflow
+  __m256i newlineCounts       = _mm256_setzero_si256();
+  u32     nCounted            = 0;
+  u64     nChars              = 0;
+  u64     nNewlines           = 0;
+  for (u64 i = 0; i <= size; i += sizeof(__m256i))
+  {
+    __m256i input {};
+    if (i + sizeof(__m256i) <= size)
+    {
+      input = _mm256_loadu_si256((const __m256i*)&data[i]);
+    }
+    else
+    {
+      u8  tail[sizeof(__m256i)] {};
+      memcpy(tail, &data[i], size - i);
+      input = _mm256_loadu_si256((const __m256i*)tail);
+      nChars -= sizeof(__m256i) - (size - i);
+    }
+    
+    charCounts = _mm256_sub_epi8(charCounts, _mm256_cmpgt_epi8(input, leads));
+    newlineCounts = _mm256_sub_epi8(newlineCounts, _mm256_cmpeq_epi8(input, newline));
+    if (++nCounted == 255 || i + sizeof(__m256i) > size)
+    {
+      nChars += SumBytes(charCounts);
+      nNewlines += SumBytes(newlineCounts);
+      charCounts = _mm256_setzero_si256();
+      newlineCounts = _mm256_setzero_si256();
+      nCounted = 0;
+    }
+    
+    if (!_mm256_movemask_epi8(input))
+    {
+      error = _mm256_or_si256(error, previousIncomplete);
+    }
+    else
+    {
+      __m256i shifted   = _mm256_permute2x128_si256(previous, input, 0x21);
+      __m256i prev1     = _mm256_alignr_epi8(input, shifted, sizeof(__m128i) - 1);
+      __m256i prev2     = _mm256_alignr_epi8(input, shifted, sizeof(__m128i) - 2);
+      __m256i prev3     = _mm256_alignr_epi8(input, shifted, sizeof(__m128i) - 3);
+      __m256i special   = _mm256_and_si256(
+        _mm256_and_si256(_mm256_shuffle_epi8(byte1High, _mm256_and_si256(_mm256_srli_epi16(prev1, 4), nibble)),
+                         _mm256_shuffle_epi8(byte1Low, _mm256_and_si256(prev1, nibble))),
+        _mm256_shuffle_epi8(byte2High, _mm256_and_si256(_mm256_srli_epi16(input, 4), nibble)));
+      __m256i third     = _mm256_subs_epu8(prev2, _mm256_set1_epi8(0xe0 - 0x80));
+      __m256i fourth    = _mm256_subs_epu8(prev3, _mm256_set1_epi8(0xf0 - 0x80));
+      __m256i required  = _mm256_and_si256(_mm256_or_si256(third, fourth), _mm256_set1_epi8(0x80));
+      error = _mm256_or_si256(error, _mm256_xor_si256(required, special));
+    }
+    
+    previousIncomplete = _mm256_subs_epu8(input, incomplete);
+    previous = input;
+  }
+  
+  length = nChars;
+  newlines = nNewlines;
+  return (_mm256_testz_si256(error, error));
+}
+
+__attribute__((target("ssse3")))
+static u64  SumBytes(__m128i counts)
+{
+  __m128i sums  = _mm_sad_epu8(counts, _mm_setzero_si128());
+  return (_mm_cvtsi128_si64(sums) + _mm_cvtsi128_si64(_mm_unpackhi_epi64(sums, sums)));
+}
+
+__attribute__((target("avx2")))
+static u64  SumBytes(__m256i counts)
+{
+  __m256i sums  = _mm256_sad_epu8(counts, _mm256_setzero_si256());
+  return (_mm256_extract_epi64(sums, 0) + _mm256_extract_epi64(sums, 1)
+          + _mm256_extract_epi64(sums, 2) + _mm256_extract_epi64(sums, 3));
+}
+#endif
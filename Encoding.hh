@@ -6,6 +6,7 @@
 #include <Util.hh>
 
 constexpr u32 REPLACEMENT_CHAR  = 0xfffd;
+constexpr u32 UTF8_READER_SIZE  = 4096;
 
 struct EChar
 {
@@ -126,7 +127,50 @@ struct EString
   EString(const char* cString);
 };
 
+// decodes UTF-8 read from a file descriptor in chunks of up to UTF8_READER_SIZE bytes; bytes stay in the ring buffer
+// until they make up a whole codepoint, so that sequences split between reads are decoded once the rest arrives
+struct UTF8Reader
+{
+  i32   m_FD;
+  u32   m_Begin;        // free-running positions in m_Data
+  u32   m_End;
+  u32   m_NDecoded;
+  u32   m_NextDecoded;
+  u8    m_Data[UTF8_READER_SIZE];
+  EChar m_Decoded[UTF8_READER_SIZE];
+  
+  EChar Read();
+  bool  Pending() const;
+  isize Fill();
+  u32   Decode(OUT EChar* dst, u32 n);
+};
+
+// byte length of a well-formed sequence given its lead byte
+constexpr usize UTF8Length(u8 lead)
+{
+  if (lead < 0x80)
+  {
+    return (1);
+  }
+  else if (lead < 0xe0)
+  {
+    return (2);
+  }
+  else if (lead < 0xf0)
+  {
+    return (3);
+  }
+  else
+  {
+    return (4);
+  }
+}
+
+usize ValidUTF8Length(const u8* ptr, usize size);
+bool  ScanUTF8(const u8* data, u64 size, OUT u32& length, OUT u32& newlines);
+u64   CountUTF8(const u8* data, u64 size);
 EChar ReadEChar();
+bool  PendingEChar();
 EChar ReadEChar(FILE* file);
 i32   PrintEChar(EChar ch);
 i32   PrintEChar(FILE* file, EChar ch);
@@ -1,29 +1,51 @@
 // SPDX-License-Identifier: GPL-3.0-or-later
 
+#include <cerrno>
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
 #include <Frame.hh>
 #include <Highlight.hh>
+#include <Journal.hh>
 #include <Render.hh>
 
+extern "C"
+{
+#include <fcntl.h>
+#include <unistd.h>
+}
+
+static i32  ReadFile(OUT Buffer& buffer, const char* path);
+static i32  InsertHistory(Frame& frame, const History& history);
+static void PushHistory(Frame& frame, HistoryType type, u32 lb, u32 ub);
+static i32  UndoHistory(Frame& frame);
+static i32  RedoHistory(Frame& frame, u32 child);
+static u32& RedoOf(Frame& frame, u32 node);
+static void ReadHistory(Frame& frame, const History& history, IN_OUT u64& offset, OUT EChar* dst, u32 length);
+static u32  ReadNumber(Frame& frame, const History& history, IN_OUT u64& offset);
+static u32  NumberLength(u32 value);
+static u32  ReadReplacement(Frame& frame, const History& history, OUT EString& old, OUT EString& str, OUT u32*& gaps);
+static i32  ReplaceHistory(Frame& frame, const History& history, bool undo);
+static i32  SpillChunk(HistoryChunk& chunk);
+static i32  LoadChunk(HistoryChunk& chunk);
+
+static FILE*  g_HistorySpill; // shared by all frames, and removed when the editor exits
+static bool   g_HistorySpillFailed;
+
 void  Frame::Free()
 {
   m_Buffer.Free();
+  m_HighlightCache.Free();
+  m_MatchIndex.Free();
   
   if (m_Source)
   {
     free(m_Source);
   }
   
-  for (u32 i = 0; i < m_HistoryLength; ++i)
-  {
-    if (m_History[i].m_Data)
-    {
-      free(m_History[i].m_Data);
-    }
-  }
   free(m_History);
+  m_HistoryLog.Free();
+  FreeJournal(*this);
 }
 
 void  Frame::Render(u32 x, u32 y, u32 w, u32 h, bool active) const
@@ -50,18 +72,31 @@ void  Frame::Render(u32 x, u32 y, u32 w, u32 h, bool active) const
   
   name.Free();
   
-  // fill frame and gutter
-  u32 startLine = 1;
-  for (u32 i = 0; i < m_Start; ++i)
+  // count matches of the last search up to the cursor, while they're still being found too
+  if (m_MatchIndex.m_String.m_Length)
   {
-    startLine += m_Buffer.m_Data[i].m_Codepoint == '\n';
+    const char* more    = m_MatchIndex.m_Next < m_Buffer.m_Length ? "+" : "";
+    u32         match   = m_MatchIndex.Find(m_Cursor);
+    char        counter[64] {};
+    if (match < m_MatchIndex.m_NMatches && m_MatchIndex.m_Matches[match].m_LowerBound <= m_Cursor)
+    {
+      snprintf(counter, sizeof(counter), "match %u of %u%s", match + 1, m_MatchIndex.m_NMatches, more);
+    }
+    else
+    {
+      snprintf(counter, sizeof(counter), "%u%s matches", m_MatchIndex.m_NMatches, more);
+    }
+    
+    u32 length  = strlen(counter);
+    for (u32 i = 0; length < w && i < length; ++i)
+    {
+      RenderPut((u32)counter[i], x + w - length + i, y);
+    }
   }
   
-  u32 lastLine  = 1;
-  for (u32 i = 0; i < m_Buffer.m_Length; ++i)
-  {
-    lastLine += m_Buffer.m_Data[i].m_Codepoint == '\n';
-  }
+  // fill frame and gutter
+  u32 startLine = m_Buffer.LineOf(m_Start) + 1;
+  u32 lastLine  = m_Buffer.LineCount();
   
   u32 lineNumberLength  = 0;
   while (lastLine)
@@ -89,18 +124,16 @@ void  Frame::Render(u32 x, u32 y, u32 w, u32 h, bool active) const
   u32 cursorY = -1;
   u32 curLine = startLine;
   
-  Region  highlight = FindHighlight(*this, 0);
-  while (highlight.m_UpperBound < m_Start)
-  {
-    highlight = FindHighlight(*this, highlight.m_UpperBound);
-  }
+  // highlight a screen above and below the visible one so that scrolling has something to show straight away
+  u32 line  = startLine - 1;
+  RequestHighlight(*this, m_Buffer.LineOffset(line > h ? line - h : 0), m_Buffer.LineOffset(line + 2 * h));
   
-  for (u32 i = m_Start; i < m_Buffer.m_Length; ++i)
+  // matches are walked along with the characters
+  u32 match = m_MatchIndex.Find(m_Start);
+  
+  for (BufferCursor c = m_Buffer.Cursor(m_Start); !c.AtEnd(); c.Next())
   {
-    if (i >= highlight.m_UpperBound)
-    {
-      highlight = FindHighlight(*this, highlight.m_UpperBound);
-    }
+    u32 i = c.m_Pos;
     
     if (!cx)
     {
@@ -133,8 +166,15 @@ void  Frame::Render(u32 x, u32 y, u32 w, u32 h, bool active) const
       cursorY = cy;
     }
     
-    u32 cw  {};
-    switch (m_Buffer.m_Data[i].m_Codepoint)
+    while (match < m_MatchIndex.m_NMatches && m_MatchIndex.m_Matches[match].m_UpperBound <= i)
+    {
+      ++match;
+    }
+    
+    EChar ch      = c.Get();
+    u32   cw      {};
+    bool  matched = match < m_MatchIndex.m_NMatches && m_MatchIndex.m_Matches[match].m_LowerBound <= i;
+    switch (ch.m_Codepoint)
     {
     case ('\n'):
       cx = 0;
@@ -145,15 +185,8 @@ void  Frame::Render(u32 x, u32 y, u32 w, u32 h, bool active) const
       break;
     default:
       cw = 1;
-      if (i >= highlight.m_LowerBound && i < highlight.m_UpperBound)
-      {
-        RenderPut(highlight.m_Color, x + leftPad + cx, y + cy + 1);
-      }
-      else
-      {
-        RenderPut(g_Options.m_Normal, x + leftPad + cx, y + cy + 1);
-      }
-      RenderPut(m_Buffer.m_Data[i].IsPrint() ? m_Buffer.m_Data[i] : REPLACEMENT_CHAR, x + leftPad + cx, y + cy + 1);
+      RenderPut(matched ? g_Options.m_SearchMatch : HighlightColor(*this, i), x + leftPad + cx, y + cy + 1);
+      RenderPut(ch.IsPrint() ? ch : REPLACEMENT_CHAR, x + leftPad + cx, y + cy + 1);
       break;
     }
     
@@ -183,6 +216,9 @@ i32 Frame::Save()
     return (1);
   }
   
+  // the file is about to be truncated, so it can no longer back the buffer
+  m_Buffer.m_Original.Detach();
+  
   FILE* file  = fopen(m_Source, "wb");
   if (!file)
   {
@@ -190,18 +226,16 @@ i32 Frame::Save()
     return (1);
   }
   
-  for (usize i = 0; i < m_Buffer.m_Length; ++i)
+  if (m_Buffer.Print(file))
   {
-    if (PrintEChar(file, m_Buffer.m_Data[i]))
-    {
-      Error("Frame: Failed to write file, take care not to lose data: %s!", m_Source);
-      fclose(file);
-      return (1);
-    }
+    Error("Frame: Failed to write file, take care not to lose data: %s!", m_Source);
+    fclose(file);
+    return (1);
   }
   
   fclose(file);
   m_Flags &= ~FRAME_UNSAVED;
+  SaveJournal(*this);
   
   return (0);
 }
@@ -218,35 +252,23 @@ void  Frame::Write(const EString& str, u32 pos)
 {
   // modify buffer
   m_Buffer.Insert(str, pos);
+  m_HighlightCache.Edit(pos, str.m_Length, 0);
+  m_MatchIndex.Edit(m_Buffer, pos, str.m_Length, 0);
   m_Flags |= FRAME_UNSAVED;
   
-  // push history entry
-  TruncateHistory();
-  History*  history = m_HistoryLength ? &m_History[m_HistoryLength - 1] : nullptr;
-  if (history && history->m_Type == HISTORY_WRITE && history->m_UpperBound == pos)
+  // push history entry, extending the current one if nothing was made on top of it yet
+  History*  history = m_CurHistory && m_CurHistory == m_HistoryLength ? &m_History[m_CurHistory - 1] : nullptr;
+  if (history && history->m_Type == HISTORY_WRITE && history->m_UpperBound == pos && !history->m_Journaled)
   {
-    u32 newUpperBound = pos + str.m_Length;
-    history->m_Data = (EChar*)reallocarray(history->m_Data, newUpperBound - history->m_LowerBound, sizeof(EChar));
-    memcpy(&history->m_Data[history->m_UpperBound - history->m_LowerBound], str.m_Data, sizeof(EChar) * str.m_Length);
-    history->m_UpperBound = newUpperBound;
+    // the last entry's text always ends the log
+    m_JournalSynced = m_JournalSynced < m_HistoryLength - 1 ? m_JournalSynced : m_HistoryLength - 1;
+    m_HistoryLog.Append(str.m_Data, str.m_Length);
+    history->m_UpperBound = pos + str.m_Length;
   }
   else
   {
-    if (m_HistoryLength >= m_HistoryCapacity)
-    {
-      m_HistoryCapacity *= 2;
-      m_History = (History*)reallocarray(m_History, m_HistoryCapacity, sizeof(History));
-    }
-    
-    m_History[m_HistoryLength] = (History)
-    {
-      .m_Data       = str.CopyData(),
-      .m_LowerBound = pos,
-      .m_UpperBound = pos + str.m_Length,
-      .m_Type       = HISTORY_WRITE
-    };
-    ++m_HistoryLength;
-    ++m_CurHistory;
+    PushHistory(*this, HISTORY_WRITE, pos, pos + str.m_Length);
+    m_HistoryLog.Append(str.m_Data, str.m_Length);
   }
 }
 
@@ -260,37 +282,23 @@ void  Frame::Write(const char* str, u32 pos)
 void  Frame::Erase(u32 lb, u32 ub)
 {
   // push history entry
-  History*  history = m_HistoryLength ? &m_History[m_HistoryLength - 1] : nullptr;
-  if (history && history->m_Type == HISTORY_ERASE && history->m_LowerBound == ub)
+  History*  history = m_CurHistory && m_CurHistory == m_HistoryLength ? &m_History[m_CurHistory - 1] : nullptr;
+  if (history && history->m_Type == HISTORY_ERASE && history->m_LowerBound == ub && !history->m_Journaled)
   {
-    history->m_Data = (EChar*)reallocarray(history->m_Data, history->m_UpperBound - lb, sizeof(EChar));
-    memmove(&history->m_Data[ub - lb], history->m_Data, sizeof(EChar) * (history->m_UpperBound - history->m_LowerBound));
-    memcpy(history->m_Data, &m_Buffer.m_Data[lb], sizeof(EChar) * (ub - lb));
+    m_JournalSynced = m_JournalSynced < m_HistoryLength - 1 ? m_JournalSynced : m_HistoryLength - 1;
+    m_HistoryLog.AppendReversed(m_Buffer, lb, ub);
     history->m_LowerBound = lb;
   }
   else
   {
-    if (m_HistoryLength >= m_HistoryCapacity)
-    {
-      m_HistoryCapacity *= 2;
-      m_History = (History*)reallocarray(m_History, m_HistoryCapacity, sizeof(History));
-    }
-    
-    EChar*  data  = (EChar*)calloc(ub - lb, sizeof(EChar));
-    memcpy(data, &m_Buffer.m_Data[lb], sizeof(EChar) * (ub - lb));
-    m_History[m_HistoryLength] = (History)
-    {
-      .m_Data       = data,
-      .m_LowerBound = lb,
-      .m_UpperBound = ub,
-      .m_Type       = HISTORY_ERASE
-    };
-    ++m_HistoryLength;
-    ++m_CurHistory;
+    PushHistory(*this, HISTORY_ERASE, lb, ub);
+    m_HistoryLog.AppendReversed(m_Buffer, lb, ub);
   }
   
   // modify buffer
   m_Buffer.Erase(lb, ub);
+  m_HighlightCache.Edit(lb, 0, ub - lb);
+  m_MatchIndex.Edit(m_Buffer, lb, 0, ub - lb);
   m_Flags |= FRAME_UNSAVED;
 }
 
@@ -299,119 +307,175 @@ void  Frame::Erase(u32 pos)
   Erase(pos, pos + 1);
 }
 
-void  Frame::Undo()
+// replaces count ranges which hold the same text of length characters, starting at the given ascending positions,
+// with str, as one edit and a single history entry; the entry's text is the replaced length, the replacing length, the
+// number of ranges and the number of characters taken by the gaps, then the replaced and the replacing text, then the
+// gap before each range, counted from the end of the one before it; numbers are written 15 bits to a character, most
+// significant first, with 0x8000 set on all but the last character of each, so that they survive being spilled or
+// journaled as UTF-8 like any other text
+void  Frame::Replace(const u32* positions, u32 count, u32 length, const EString& str)
 {
-  if (m_HistoryLength == 0)
+  if (!count)
   {
     return;
   }
   
-  while (m_CurHistory > 0 && m_History[m_CurHistory - 1].m_Type == HISTORY_BREAK)
+  u32     lb    = positions[0];
+  u32     ub    = positions[count - 1] + length;
+  EChar*  text  = (EChar*)malloc(sizeof(EChar) * (12 + (u64)length + str.m_Length + 3 * (u64)count));
+  u32     n     = 0;
+  u32     gaps  = 0;
+  for (u32 i = 0, end = lb; i < count; end = positions[i++] + length)
   {
-    --m_CurHistory;
+    gaps += NumberLength(positions[i] - end);
   }
   
-  if (m_CurHistory == 0)
+  auto  number  = [&](u32 value)
   {
-    return;
-  }
+    u32 shift = 30;
+    while (shift && !(value >> shift))
+    {
+      shift -= 15;
+    }
+    
+    for (; shift; shift -= 15)
+    {
+      text[n++] = EChar{0x8000 | (value >> shift & 0x7fff)};
+    }
+    text[n++] = EChar{value & 0x7fff};
+  };
   
-  const History*  history = &m_History[m_CurHistory - 1];
-  switch (history->m_Type)
+  number(length);
+  number(str.m_Length);
+  number(count);
+  number(gaps);
+  m_Buffer.Copy(&text[n], lb, lb + length);
+  n += length;
+  for (u32 i = 0; i < str.m_Length; ++i)
   {
-  case (HISTORY_WRITE):
-    m_Buffer.Erase(history->m_LowerBound, history->m_UpperBound);
-    m_Cursor = history->m_LowerBound;
-    m_Flags |= FRAME_UNSAVED;
-    break;
-  case (HISTORY_ERASE):
-    m_Buffer.Insert(history->m_Data, history->m_UpperBound - history->m_LowerBound, history->m_LowerBound);
-    m_Cursor = history->m_UpperBound;
-    m_Flags |= FRAME_UNSAVED;
-    break;
-  default:
-    break;
+    text[n++] = str.m_Data[i];
+  }
+  for (u32 i = 0, end = lb; i < count; end = positions[i++] + length)
+  {
+    number(positions[i] - end);
   }
   
-  --m_CurHistory;
+  PushHistory(*this, HISTORY_REPLACE, lb, ub);
+  m_HistoryLog.Append(text, n);
+  free(text);
+  
+  // modify buffer
+  u32 newUb = ub + count * (str.m_Length - length);
+  m_Buffer.Replace(positions, count, length, str.m_Data, str.m_Length);
+  m_HighlightCache.Edit(lb, newUb - lb, ub - lb);
+  m_MatchIndex.Edit(m_Buffer, lb, newUb - lb, ub - lb);
+  m_Flags |= FRAME_UNSAVED;
 }
 
-void  Frame::Redo()
+void  Frame::Undo()
 {
-  while (m_CurHistory < m_HistoryLength && m_History[m_CurHistory].m_Type == HISTORY_BREAK)
+  while (m_CurHistory > 0 && m_History[m_CurHistory - 1].m_Type == HISTORY_BREAK)
   {
-    ++m_CurHistory;
+    UndoHistory(*this);
   }
   
-  if (m_CurHistory == m_HistoryLength)
+  if (m_CurHistory == 0)
   {
     return;
   }
   
-  const History*  history = &m_History[m_CurHistory];
-  switch (history->m_Type)
+  UndoHistory(*this);
+}
+
+void  Frame::Redo()
+{
+  while (RedoOf(*this, m_CurHistory) && m_History[RedoOf(*this, m_CurHistory) - 1].m_Type == HISTORY_BREAK)
   {
-  case (HISTORY_ERASE):
-    m_Buffer.Erase(history->m_LowerBound, history->m_UpperBound);
-    m_Cursor = history->m_LowerBound;
-    m_Flags |= FRAME_UNSAVED;
-    break;
-  case (HISTORY_WRITE):
-    m_Buffer.Insert(history->m_Data, history->m_UpperBound - history->m_LowerBound, history->m_LowerBound);
-    m_Cursor = history->m_UpperBound;
-    m_Flags |= FRAME_UNSAVED;
-    break;
-  default:
-    break;
+    RedoHistory(*this, RedoOf(*this, m_CurHistory));
+  }
+  
+  if (!RedoOf(*this, m_CurHistory))
+  {
+    return;
   }
   
-  ++m_CurHistory;
+  RedoHistory(*this, RedoOf(*this, m_CurHistory));
 }
 
 void  Frame::BreakHistory()
 {
-  if (m_HistoryLength >= m_HistoryCapacity)
+  PushHistory(*this, HISTORY_BREAK, 0, 0);
+}
+
+// undoes up to the closest common ancestor of the current entry and the target, collecting the path down to the target
+// on the way, and then redoes along that path; this only ever visits entries between the two, and stops at the first
+// one whose text can't be read
+void  Frame::GotoHistory(u32 target)
+{
+  auto  depthOf = [&](u32 node)
+  {
+    return (node ? m_History[node - 1].m_Depth : 0);
+  };
+  
+  u32*  path  = (u32*)malloc(sizeof(u32) * (depthOf(target) ? depthOf(target) : 1));
+  u32   nPath = 0;
+  
+  bool  failed  = false;
+  
+  while (!failed && depthOf(m_CurHistory) > depthOf(target))
   {
-    m_HistoryCapacity *= 2;
-    m_History = (History*)reallocarray(m_History, m_HistoryCapacity, sizeof(History));
+    failed = UndoHistory(*this);
   }
   
-  TruncateHistory();
-  m_History[m_HistoryLength] = (History)
+  while (depthOf(target) > depthOf(m_CurHistory))
   {
-    .m_Data       = nullptr,
-    .m_LowerBound = 0,
-    .m_UpperBound = 0,
-    .m_Type       = HISTORY_BREAK
-  };
-  ++m_HistoryLength;
-  ++m_CurHistory;
+    path[nPath++] = target;
+    target = m_History[target - 1].m_Parent;
+  }
+  
+  while (!failed && m_CurHistory != target)
+  {
+    failed = UndoHistory(*this);
+    path[nPath++] = target;
+    target = m_History[target - 1].m_Parent;
+  }
+  
+  while (!failed && nPath)
+  {
+    failed = RedoHistory(*this, path[--nPath]);
+  }
+  
+  free(path);
 }
 
-void  Frame::TruncateHistory()
+// returns the next (or previous) entry made on top of the same state as the current one, in the order they were made;
+// siblings are found by scanning, since switching branches is rare next to undoing and redoing
+u32 Frame::NextBranch(bool reverse) const
 {
-  for (usize i = m_CurHistory; i < m_HistoryLength; ++i)
+  if (m_CurHistory == 0)
   {
-    if (m_History[i].m_Data)
+    return (0);
+  }
+  
+  u32 parent  = m_History[m_CurHistory - 1].m_Parent;
+  for (u32 i = 1; i < m_HistoryLength; ++i)
+  {
+    u32 idx = (m_CurHistory - 1 + (reverse ? m_HistoryLength - i : i)) % m_HistoryLength;
+    if (m_History[idx].m_Parent == parent)
     {
-      free(m_History[i].m_Data);
+      return (idx + 1);
     }
   }
-  m_HistoryLength = m_CurHistory;
+  
+  return (m_CurHistory);
 }
 
 void  Frame::SaveCursor()
 {
-  u32 lineBegin = m_Cursor;
-  while (lineBegin > 0 && m_Buffer.m_Data[lineBegin - 1].m_Codepoint != '\n')
-  {
-    --lineBegin;
-  }
-  
   u32 cx = 0;
-  for (u32 i = lineBegin; i < m_Cursor; ++i)
+  for (BufferCursor c = m_Buffer.Cursor(m_Buffer.LineBegin(m_Cursor)); c.m_Pos < m_Cursor; c.Next())
   {
-    switch (m_Buffer.m_Data[i].m_Codepoint)
+    switch (c.Codepoint())
     {
     case ('\t'):
       cx += g_Options.m_TabSize - cx % g_Options.m_TabSize;
@@ -427,16 +491,10 @@ void  Frame::SaveCursor()
 
 void  Frame::LoadCursor()
 {
-  u32 lineBegin = m_Cursor;
-  while (lineBegin > 0 && m_Buffer.m_Data[lineBegin - 1].m_Codepoint != '\n')
-  {
-    --lineBegin;
-  }
-  
-  u32 i = lineBegin;
-  for (u32 cx = 0; i < m_Buffer.m_Length && m_Buffer.m_Data[i].m_Codepoint != '\n' && cx < m_SavedCursorX; ++i)
+  BufferCursor  c = m_Buffer.Cursor(m_Buffer.LineBegin(m_Cursor));
+  for (u32 cx = 0; !c.AtEnd() && c.Codepoint() != '\n' && cx < m_SavedCursorX; c.Next())
   {
-    switch (m_Buffer.m_Data[i].m_Codepoint)
+    switch (c.Codepoint())
     {
     case ('\t'):
       cx += g_Options.m_TabSize - cx % g_Options.m_TabSize;
@@ -447,26 +505,18 @@ void  Frame::LoadCursor()
     }
   }
   
-  m_Cursor = i;
+  m_Cursor = c.m_Pos;
 }
 
 void  Frame::ComputeBounds(u32 w, u32 h)
 {
   if (m_Cursor < m_Start)
   {
-    m_Start = m_Cursor;
-    while (m_Start > 0 && m_Buffer.m_Data[m_Start - 1].m_Codepoint != '\n')
-    {
-      --m_Start;
-    }
+    m_Start = m_Buffer.LineBegin(m_Cursor);
     return;
   }
   
-  u32 lastLine  = 1;
-  for (u32 i = 0; i < m_Buffer.m_Length; ++i)
-  {
-    lastLine += m_Buffer.m_Data[i].m_Codepoint == '\n';
-  }
+  u32 lastLine  = m_Buffer.LineCount();
   
   u32 lineNumberLength  = 0;
   while (lastLine)
@@ -479,7 +529,7 @@ void  Frame::ComputeBounds(u32 w, u32 h)
   
   u32 cx  = 0;
   u32 cy  = 0;
-  for (usize i = m_Start; i < m_Cursor; ++i)
+  for (BufferCursor c = m_Buffer.Cursor(m_Start); c.m_Pos < m_Cursor; c.Next())
   {
     if (leftPad + cx >= w)
     {
@@ -488,7 +538,7 @@ void  Frame::ComputeBounds(u32 w, u32 h)
     }
     
     u32 cw  {};
-    switch (m_Buffer.m_Data[i].m_Codepoint)
+    switch (c.Codepoint())
     {
     case ('\n'):
       cx = 0;
@@ -505,7 +555,8 @@ void  Frame::ComputeBounds(u32 w, u32 h)
     cx += cw;
   }
   
-  for (cx = 0; cy + 1 >= h; ++m_Start)
+  BufferCursor  start = m_Buffer.Cursor(m_Start);
+  for (cx = 0; cy + 1 >= h; start.Next(), m_Start = start.m_Pos)
   {
     if (leftPad + cx >= w)
     {
@@ -514,7 +565,7 @@ void  Frame::ComputeBounds(u32 w, u32 h)
     }
     
     u32 cw  {};
-    switch (m_Buffer.m_Data[m_Start].m_Codepoint)
+    switch (start.Codepoint())
     {
     case ('\n'):
       cx = 0;
@@ -536,13 +587,7 @@ u32 Frame::Tabulate(u32 at)
 {
   if (g_Options.m_TabSpaces)
   {
-    u32 lineBegin = at;
-    while (lineBegin && m_Buffer.m_Data[lineBegin - 1].m_Codepoint != '\n')
-    {
-      --lineBegin;
-    }
-    
-    u32 linePos = at - lineBegin;
+    u32 linePos = at - m_Buffer.LineBegin(at);
     u32 nSpaces = g_Options.m_TabSize - linePos % g_Options.m_TabSize;
     while (nSpaces)
     {
@@ -560,11 +605,156 @@ u32 Frame::Tabulate(u32 at)
   }
 }
 
+void  HistoryLog::Free()
+{
+  for (u32 i = 0; i < m_NChunks; ++i)
+  {
+    if (m_Chunks[i].m_Data)
+    {
+      free(m_Chunks[i].m_Data);
+    }
+  }
+  
+  if (m_Chunks)
+  {
+    free(m_Chunks);
+  }
+  
+  *this = HistoryLog{};
+}
+
+void  HistoryLog::Append(const EChar* data, u32 length)
+{
+  while (length)
+  {
+    EChar*  chunk   = Chunk(m_Length / INTERNAL::HISTORY_CHUNK_SIZE, true);
+    u32     offset  = m_Length % INTERNAL::HISTORY_CHUNK_SIZE;
+    u32     n       = INTERNAL::HISTORY_CHUNK_SIZE - offset < length ? INTERNAL::HISTORY_CHUNK_SIZE - offset : length;
+    memcpy(&chunk[offset], data, sizeof(EChar) * n);
+    data += n;
+    length -= n;
+    m_Length += n;
+  }
+  
+  Spill();
+}
+
+void  HistoryLog::AppendReversed(const Buffer& buffer, u32 lb, u32 ub)
+{
+  BufferCursor  c = buffer.Cursor(ub);
+  while (c.m_Pos > lb)
+  {
+    c.Prev();
+    
+    EChar*  chunk = Chunk(m_Length / INTERNAL::HISTORY_CHUNK_SIZE, true);
+    chunk[m_Length % INTERNAL::HISTORY_CHUNK_SIZE] = c.Get();
+    ++m_Length;
+  }
+  
+  Spill();
+}
+
+// the text read must be resident, which Load() makes sure of for text that may have been spilled
+void  HistoryLog::Read(OUT EChar* dst, u64 offset, u32 length)
+{
+  while (length)
+  {
+    EChar*  chunk     = Chunk(offset / INTERNAL::HISTORY_CHUNK_SIZE, false);
+    u32     position  = offset % INTERNAL::HISTORY_CHUNK_SIZE;
+    u32     n         = INTERNAL::HISTORY_CHUNK_SIZE - position < length ? INTERNAL::HISTORY_CHUNK_SIZE - position : length;
+    memcpy(dst, &chunk[position], sizeof(EChar) * n);
+    dst += n;
+    offset += n;
+    length -= n;
+  }
+}
+
+// pages in every chunk over a range of the log, failing if one of them can't be read back from the spill file
+i32 HistoryLog::Load(u64 offset, u64 length)
+{
+  if (!length)
+  {
+    return (0);
+  }
+  
+  u64 last  = (offset + length - 1) / INTERNAL::HISTORY_CHUNK_SIZE;
+  for (u64 idx = offset / INTERNAL::HISTORY_CHUNK_SIZE; idx <= last; ++idx)
+  {
+    if (!Chunk(idx, false))
+    {
+      return (1);
+    }
+  }
+  
+  return (0);
+}
+
+// returns the text of a chunk, paging it in or allocating it if needed, or null if it can't be paged in; chunks to be
+// modified lose their spilled copy
+EChar*  HistoryLog::Chunk(u32 idx, bool modify)
+{
+  if (idx >= m_NChunks)
+  {
+    if (m_NChunks >= m_ChunkCapacity)
+    {
+      m_ChunkCapacity = m_ChunkCapacity ? 2 * m_ChunkCapacity : 1;
+      m_Chunks = (HistoryChunk*)reallocarray(m_Chunks, m_ChunkCapacity, sizeof(HistoryChunk));
+    }
+    m_Chunks[m_NChunks++] = HistoryChunk{};
+  }
+  
+  HistoryChunk& chunk = m_Chunks[idx];
+  if (!chunk.m_Data)
+  {
+    chunk.m_Data = (EChar*)malloc(sizeof(EChar) * INTERNAL::HISTORY_CHUNK_SIZE);
+    ++m_NResident;
+    m_Oldest = idx < m_Oldest ? idx : m_Oldest;
+    
+    if (chunk.m_Spilled && LoadChunk(chunk))
+    {
+      free(chunk.m_Data);
+      chunk.m_Data = nullptr;
+      --m_NResident;
+      return (nullptr);
+    }
+  }
+  
+  if (modify)
+  {
+    chunk.m_Spilled = false;
+  }
+  
+  return (chunk.m_Data);
+}
+
+// the chunk being appended to is always kept, even if it alone is over the memory budget
+void  HistoryLog::Spill()
+{
+  u64 budget  = 1024 * (u64)g_Options.m_HistoryMemory / (sizeof(EChar) * INTERNAL::HISTORY_CHUNK_SIZE);
+  u32 last    = m_Length / INTERNAL::HISTORY_CHUNK_SIZE;
+  while (m_NResident > budget && m_NResident > 1 && m_Oldest < last)
+  {
+    HistoryChunk& chunk = m_Chunks[m_Oldest];
+    if (chunk.m_Data)
+    {
+      if (!chunk.m_Spilled && SpillChunk(chunk))
+      {
+        return;
+      }
+      
+      free(chunk.m_Data);
+      chunk.m_Data = nullptr;
+      --m_NResident;
+    }
+    ++m_Oldest;
+  }
+}
+
 void  EmptyFrame(OUT Frame& frame)
 {
   frame = (Frame)
   {
-    .m_Buffer           = EString{},
+    .m_Buffer           = Buffer{},
     .m_Source           = nullptr,
     .m_Start            = 0,
     .m_Cursor           = 0,
@@ -573,15 +763,26 @@ void  EmptyFrame(OUT Frame& frame)
     .m_History          = (History*)calloc(1, sizeof(History)),
     .m_HistoryLength    = 0,
     .m_HistoryCapacity  = 1,
-    .m_CurHistory       = 0
+    .m_CurHistory       = 0,
+    .m_RootRedo         = 0,
+    .m_Journal          = nullptr,
+    .m_JournalSize      = 0,
+    .m_JournalRecord    = 0,
+    .m_JournalSynced    = 0,
+    .m_HistoryLog       = HistoryLog{},
+    .m_HighlightCache   = HighlightCache{},
+    .m_MatchIndex       = MatchIndex{}
   };
 }
 
 void  StringFrame(OUT Frame& frame, const char* str)
 {
+  Buffer  buffer  {};
+  StringBuffer(buffer, str);
+  
   frame = (Frame)
   {
-    .m_Buffer           = EString{str},
+    .m_Buffer           = buffer,
     .m_Source           = nullptr,
     .m_Start            = 0,
     .m_Cursor           = 0,
@@ -590,54 +791,452 @@ void  StringFrame(OUT Frame& frame, const char* str)
     .m_History          = (History*)calloc(1, sizeof(History)),
     .m_HistoryLength    = 0,
     .m_HistoryCapacity  = 1,
-    .m_CurHistory       = 0
+    .m_CurHistory       = 0,
+    .m_RootRedo         = 0,
+    .m_Journal          = nullptr,
+    .m_JournalSize      = 0,
+    .m_JournalRecord    = 0,
+    .m_JournalSynced    = 0,
+    .m_HistoryLog       = HistoryLog{},
+    .m_HighlightCache   = HighlightCache{},
+    .m_MatchIndex       = MatchIndex{}
   };
 }
 
 i32 FileFrame(OUT Frame& frame, const char* path)
 {
-  FILE* file  = fopen(path, "rb");
-  if (!file)
+  Buffer  buffer  {};
+  if (MappedBuffer(buffer, path) && ReadFile(buffer, path))
+  {
+    return (1);
+  }
+  
+  frame = (Frame)
+  {
+    .m_Buffer           = buffer,
+    .m_Source           = strdup(path),
+    .m_Start            = 0,
+    .m_Cursor           = 0,
+    .m_SavedCursorX     = 0,
+    .m_Flags            = 0,
+    .m_History          = (History*)calloc(1, sizeof(History)),
+    .m_HistoryLength    = 0,
+    .m_HistoryCapacity  = 1,
+    .m_CurHistory       = 0,
+    .m_RootRedo         = 0,
+    .m_Journal          = nullptr,
+    .m_JournalSize      = 0,
+    .m_JournalRecord    = 0,
+    .m_JournalSynced    = 0,
+    .m_HistoryLog       = HistoryLog{},
+    .m_HighlightCache   = HighlightCache{},
+    .m_MatchIndex       = MatchIndex{}
+  };
+  
+  LoadJournal(frame);
+  return (0);
+}
+
+// returns the number of characters an entry keeps in the history log; a replacement's are counted from its header
+u32 HistoryLength(Frame& frame, const History& history)
+{
+  switch (history.m_Type)
+  {
+  case (HISTORY_WRITE):
+  case (HISTORY_ERASE):
+    return (history.m_UpperBound - history.m_LowerBound);
+  case (HISTORY_REPLACE):
+    break;
+  default:
+    return (0);
+  }
+  
+  u64 offset    = history.m_Offset;
+  u32 length    = ReadNumber(frame, history, offset);
+  u32 strLength = ReadNumber(frame, history, offset);
+  u32 count     = ReadNumber(frame, history, offset);
+  u32 gaps      = ReadNumber(frame, history, offset);
+  
+  return (NumberLength(length) + NumberLength(strLength) + NumberLength(count) + NumberLength(gaps)
+          + length + strLength + gaps);
+}
+
+// pages in the text an entry keeps in the history log, failing if some of it can't be read back from the spill file; a
+// replacement's header, of at most four numbers of three characters, comes first since its length is counted from it
+i32 LoadHistory(Frame& frame, const History& history)
+{
+  if (history.m_Journaled)
+  {
+    return (0);
+  }
+  
+  HistoryLog& log     = frame.m_HistoryLog;
+  u64         header  = history.m_Type == HISTORY_REPLACE ? 12 : 0;
+  header = log.m_Length - history.m_Offset < header ? log.m_Length - history.m_Offset : header;
+  if (log.Load(history.m_Offset, header) || log.Load(history.m_Offset, HistoryLength(frame, history)))
+  {
+    return (1);
+  }
+  
+  return (0);
+}
+
+// files which can't be mapped are read straight into the buffer's data with read(), in chunks that grow with the file
+static i32  ReadFile(OUT Buffer& buffer, const char* path)
+{
+  i32 fd  = open(path, O_RDONLY);
+  if (fd == -1)
   {
     Error("Frame: Failed to open file to read: %s!", path);
     return (1);
   }
   
-  EString buffer  {};
+  u8* data      = nullptr;
+  u64 size      = 0;
+  u64 capacity  = 0;
   for (;;)
   {
-    EChar ch  = ReadEChar(file);
+    if (size >= capacity)
+    {
+      capacity = capacity ? 2 * capacity : 4096;
+      data = (u8*)realloc(data, capacity);
+    }
     
-    if (feof(file))
+    isize nRead = read(fd, &data[size], capacity - size);
+    if (nRead == 0)
     {
       break;
     }
     
-    if (ferror(file))
+    if (nRead < 0 && errno != EINTR)
     {
       Error("Frame: Experienced a read failure for file: %s!", path);
-      fclose(file);
-      buffer.Free();
+      close(fd);
+      free(data);
       return (1);
     }
     
-    buffer.Insert(ch, buffer.m_Length);
+    size += nRead > 0 ? nRead : 0;
   }
   
-  fclose(file);
+  close(fd);
   
-  frame = (Frame)
+  UTF8Buffer(buffer, data, size);
+  return (0);
+}
+
+// undoing an erase or redoing a write inserts the entry's text back into the buffer, unless it can't be read
+static i32  InsertHistory(Frame& frame, const History& history)
+{
+  if (LoadHistory(frame, history))
   {
-    .m_Buffer           = buffer,
-    .m_Source           = strdup(path),
-    .m_Start            = 0,
-    .m_Cursor           = 0,
-    .m_SavedCursorX     = 0,
-    .m_Flags            = 0,
-    .m_History          = (History*)calloc(1, sizeof(History)),
-    .m_HistoryLength    = 0,
-    .m_HistoryCapacity  = 1,
-    .m_CurHistory       = 0
+    return (1);
+  }
+  
+  u32     length  = history.m_UpperBound - history.m_LowerBound;
+  EChar*  data    = (EChar*)malloc(sizeof(EChar) * (length ? length : 1));
+  if (history.m_Journaled)
+  {
+    const u8* text  = &frame.m_Journal[history.m_Offset];
+    for (u32 i = 0; i < length; ++i)
+    {
+      data[i] = EChar{text};
+      text += UTF8Length(*text);
+    }
+  }
+  else
+  {
+    frame.m_HistoryLog.Read(data, history.m_Offset, length);
+  }
+  
+  if (history.m_Type == HISTORY_ERASE && !history.m_Journaled)
+  {
+    for (u32 i = 0; i < length / 2; ++i)
+    {
+      EChar tmp = data[i];
+      data[i] = data[length - i - 1];
+      data[length - i - 1] = tmp;
+    }
+  }
+  
+  frame.m_Buffer.Insert(data, length, history.m_LowerBound);
+  free(data);
+  return (0);
+}
+
+// new entries are made on top of the current one, and become the ones followed by redoing it
+static void PushHistory(Frame& frame, HistoryType type, u32 lb, u32 ub)
+{
+  if (frame.m_HistoryLength >= frame.m_HistoryCapacity)
+  {
+    frame.m_HistoryCapacity *= 2;
+    frame.m_History = (History*)reallocarray(frame.m_History, frame.m_HistoryCapacity, sizeof(History));
+  }
+  
+  u32 parent  = frame.m_CurHistory;
+  frame.m_History[frame.m_HistoryLength] = (History)
+  {
+    .m_Offset     = frame.m_HistoryLog.m_Length,
+    .m_LowerBound = lb,
+    .m_UpperBound = ub,
+    .m_Parent     = parent,
+    .m_Redo       = 0,
+    .m_Depth      = parent ? frame.m_History[parent - 1].m_Depth + 1 : 1,
+    .m_Type       = type,
+    .m_Journaled  = false
   };
+  ++frame.m_HistoryLength;
+  frame.m_CurHistory = frame.m_HistoryLength;
+  RedoOf(frame, parent) = frame.m_CurHistory;
+}
+
+// reverts the current entry, moving to its parent; redoing afterwards comes back to the same entry, and an entry whose
+// text can't be read is left as it is
+static i32  UndoHistory(Frame& frame)
+{
+  const History&  history = frame.m_History[frame.m_CurHistory - 1];
+  switch (history.m_Type)
+  {
+  case (HISTORY_WRITE):
+    frame.m_Buffer.Erase(history.m_LowerBound, history.m_UpperBound);
+    frame.m_HighlightCache.Edit(history.m_LowerBound, 0, history.m_UpperBound - history.m_LowerBound);
+    frame.m_MatchIndex.Edit(frame.m_Buffer, history.m_LowerBound, 0, history.m_UpperBound - history.m_LowerBound);
+    frame.m_Cursor = history.m_LowerBound;
+    frame.m_Flags |= FRAME_UNSAVED;
+    break;
+  case (HISTORY_ERASE):
+    if (InsertHistory(frame, history))
+    {
+      return (1);
+    }
+    frame.m_HighlightCache.Edit(history.m_LowerBound, history.m_UpperBound - history.m_LowerBound, 0);
+    frame.m_MatchIndex.Edit(frame.m_Buffer, history.m_LowerBound, history.m_UpperBound - history.m_LowerBound, 0);
+    frame.m_Cursor = history.m_UpperBound;
+    frame.m_Flags |= FRAME_UNSAVED;
+    break;
+  case (HISTORY_REPLACE):
+    if (ReplaceHistory(frame, history, true))
+    {
+      return (1);
+    }
+    break;
+  default:
+    break;
+  }
+  
+  RedoOf(frame, history.m_Parent) = frame.m_CurHistory;
+  frame.m_CurHistory = history.m_Parent;
+  return (0);
+}
+
+// reapplies a child of the current entry, moving to it, unless its text can't be read
+static i32  RedoHistory(Frame& frame, u32 child)
+{
+  const History&  history = frame.m_History[child - 1];
+  switch (history.m_Type)
+  {
+  case (HISTORY_ERASE):
+    frame.m_Buffer.Erase(history.m_LowerBound, history.m_UpperBound);
+    frame.m_HighlightCache.Edit(history.m_LowerBound, 0, history.m_UpperBound - history.m_LowerBound);
+    frame.m_MatchIndex.Edit(frame.m_Buffer, history.m_LowerBound, 0, history.m_UpperBound - history.m_LowerBound);
+    frame.m_Cursor = history.m_LowerBound;
+    frame.m_Flags |= FRAME_UNSAVED;
+    break;
+  case (HISTORY_WRITE):
+    if (InsertHistory(frame, history))
+    {
+      return (1);
+    }
+    frame.m_HighlightCache.Edit(history.m_LowerBound, history.m_UpperBound - history.m_LowerBound, 0);
+    frame.m_MatchIndex.Edit(frame.m_Buffer, history.m_LowerBound, history.m_UpperBound - history.m_LowerBound, 0);
+    frame.m_Cursor = history.m_UpperBound;
+    frame.m_Flags |= FRAME_UNSAVED;
+    break;
+  case (HISTORY_REPLACE):
+    if (ReplaceHistory(frame, history, false))
+    {
+      return (1);
+    }
+    break;
+  default:
+    break;
+  }
+  
+  RedoOf(frame, frame.m_CurHistory) = child;
+  frame.m_CurHistory = child;
+  return (0);
+}
+
+static u32& RedoOf(Frame& frame, u32 node)
+{
+  return (node ? frame.m_History[node - 1].m_Redo : frame.m_RootRedo);
+}
+
+// reads characters of an entry's text from where offset is, moving it past them; journaled text is UTF-8, which is
+// decoded a character at a time
+static void ReadHistory(Frame& frame, const History& history, IN_OUT u64& offset, OUT EChar* dst, u32 length)
+{
+  if (!history.m_Journaled)
+  {
+    frame.m_HistoryLog.Read(dst, offset, length);
+    offset += length;
+    return;
+  }
+  
+  for (u32 i = 0; i < length; ++i)
+  {
+    dst[i] = EChar{&frame.m_Journal[offset]};
+    offset += UTF8Length(frame.m_Journal[offset]);
+  }
+}
+
+// reads a number of a replacement, written as described at Frame::Replace()
+static u32  ReadNumber(Frame& frame, const History& history, IN_OUT u64& offset)
+{
+  u32   value = 0;
+  EChar ch    {};
+  do
+  {
+    ReadHistory(frame, history, offset, &ch, 1);
+    value = value << 15 | (ch.m_Codepoint & 0x7fff);
+  } while (ch.m_Codepoint & 0x8000);
+  
+  return (value);
+}
+
+// a number takes as many characters as it has 15-bit digits
+static u32  NumberLength(u32 value)
+{
+  return (value >> 30 ? 3 : value >> 15 ? 2 : 1);
+}
+
+// decodes the text of a replacement, laid out as described at Frame::Replace(), returning the number of ranges
+static u32  ReadReplacement(Frame& frame, const History& history, OUT EString& old, OUT EString& str, OUT u32*& gaps)
+{
+  u64 offset  = history.m_Offset;
+  
+  old = EString{};
+  str = EString{};
+  old.m_Length = ReadNumber(frame, history, offset);
+  str.m_Length = ReadNumber(frame, history, offset);
+  u32 count = ReadNumber(frame, history, offset);
+  ReadNumber(frame, history, offset);
+  
+  old.m_Data = (EChar*)malloc(sizeof(EChar) * (old.m_Length ? old.m_Length : 1));
+  str.m_Data = (EChar*)malloc(sizeof(EChar) * (str.m_Length ? str.m_Length : 1));
+  old.m_Capacity = old.m_Length;
+  str.m_Capacity = str.m_Length;
+  ReadHistory(frame, history, offset, old.m_Data, old.m_Length);
+  ReadHistory(frame, history, offset, str.m_Data, str.m_Length);
+  
+  gaps = (u32*)malloc(sizeof(u32) * count);
+  for (u32 i = 0; i < count; ++i)
+  {
+    gaps[i] = ReadNumber(frame, history, offset);
+  }
+  
+  return (count);
+}
+
+// undoing a replacement puts the replaced text back at the ranges as they were left by it, unless it can't be read
+static i32  ReplaceHistory(Frame& frame, const History& history, bool undo)
+{
+  if (LoadHistory(frame, history))
+  {
+    return (1);
+  }
+  
+  EString old;
+  EString str;
+  u32*    positions;
+  u32     count = ReadReplacement(frame, history, old, str, positions);
+  
+  // the gaps become positions in place
+  const EString&  from  = undo ? str : old;
+  const EString&  to    = undo ? old : str;
+  for (u32 i = 0, end = history.m_LowerBound; i < count; ++i)
+  {
+    positions[i] += end;
+    end = positions[i] + from.m_Length;
+  }
+  
+  // spans of the ranges before and after, from the start of the first to the end of the last
+  u32 erased    = positions[count - 1] + from.m_Length - history.m_LowerBound;
+  u32 inserted  = erased + count * (to.m_Length - from.m_Length);
+  frame.m_Buffer.Replace(positions, count, from.m_Length, to.m_Data, to.m_Length);
+  frame.m_HighlightCache.Edit(history.m_LowerBound, inserted, erased);
+  frame.m_MatchIndex.Edit(frame.m_Buffer, history.m_LowerBound, inserted, erased);
+  frame.m_Cursor = history.m_LowerBound;
+  frame.m_Flags |= FRAME_UNSAVED;
+  
+  old.Free();
+  str.Free();
+  free(positions);
+  return (0);
+}
+
+// chunks are spilled as UTF-8, which takes a fraction of the space of their characters; once spilling fails the file
+// is kept for the chunks already in it, and no more are spilled
+static i32  SpillChunk(HistoryChunk& chunk)
+{
+  if (!g_HistorySpill && !g_HistorySpillFailed)
+  {
+    // unbuffered, so that a failed write leaves nothing behind to fail again when seeking to read
+    g_HistorySpill = tmpfile();
+    if (!g_HistorySpill || setvbuf(g_HistorySpill, nullptr, _IONBF, 0))
+    {
+      Error("Frame: Failed to create history spill file, keeping all history in memory!");
+      g_HistorySpillFailed = true;
+    }
+  }
+  
+  if (g_HistorySpillFailed)
+  {
+    return (1);
+  }
+  
+  u8* data  = (u8*)malloc(4 * INTERNAL::HISTORY_CHUNK_SIZE);
+  u32 size  = 0;
+  for (u32 i = 0; i < INTERNAL::HISTORY_CHUNK_SIZE; ++i)
+  {
+    usize length  = UTF8Length(chunk.m_Data[i].m_Encoding[0]);
+    memcpy(&data[size], chunk.m_Data[i].m_Encoding, length);
+    size += length;
+  }
+  
+  fseek(g_HistorySpill, 0, SEEK_END);
+  i64 offset  = ftell(g_HistorySpill);
+  if (offset < 0 || fwrite(data, 1, size, g_HistorySpill) != size)
+  {
+    Error("Frame: Failed to spill history, keeping new history in memory!");
+    g_HistorySpillFailed = true;
+    free(data);
+    return (1);
+  }
+  free(data);
+  
+  chunk.m_SpillOffset = offset;
+  chunk.m_SpillSize = size;
+  chunk.m_Spilled = true;
+  return (0);
+}
+
+static i32  LoadChunk(HistoryChunk& chunk)
+{
+  u8* data  = (u8*)malloc(chunk.m_SpillSize);
+  if (fseek(g_HistorySpill, chunk.m_SpillOffset, SEEK_SET)
+      || fread(data, 1, chunk.m_SpillSize, g_HistorySpill) != chunk.m_SpillSize)
+  {
+    Error("Frame: Failed to read spilled history!");
+    free(data);
+    return (1);
+  }
+  
+  for (u32 i = 0, byte = 0; i < INTERNAL::HISTORY_CHUNK_SIZE; ++i)
+  {
+    chunk.m_Data[i] = EChar{&data[byte]};
+    byte += UTF8Length(data[byte]);
+  }
+  free(data);
   return (0);
 }
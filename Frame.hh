@@ -2,7 +2,10 @@
 
 #pragma once
 
+#include <Buffer.hh>
 #include <Encoding.hh>
+#include <Options.hh>
+#include <Search.hh>
 #include <Util.hh>
 
 enum FrameFlag : u64
@@ -14,20 +17,85 @@ enum HistoryType : u8
 {
   HISTORY_WRITE = 0,
   HISTORY_ERASE,
-  HISTORY_BREAK
+  HISTORY_BREAK,
+  HISTORY_REPLACE
 };
 
+// the text of an entry is normally kept in its frame's history log; erased text is stored back to front, so that erasing
+// backwards extends the last entry by appending to the log; entries are never discarded, and form a tree in which each
+// entry was made on top of the state left by its parent; a replacement spans from the first replaced range to the end
+// of the last one, and its text is laid out as described at Frame::Replace()
 struct History
 {
-  EChar*      m_Data;
+  u64         m_Offset;     // position of text in history log, or in the frame's journal if journaled
   u32         m_LowerBound;
   u32         m_UpperBound;
+  u32         m_Parent;     // 1-based, or 0 for the unmodified text
+  u32         m_Redo;       // child followed by redoing, 1-based, or 0
+  u32         m_Depth;      // number of ancestors, including itself
   HistoryType m_Type;
+  bool        m_Journaled;  // loaded from the journal, which holds the text front to back as UTF-8
+};
+
+// a chunk which isn't resident is paged back in from the spill file when needed
+struct HistoryChunk
+{
+  EChar*  m_Data;         // null while not resident
+  u64     m_SpillOffset;  // position of UTF-8 text in spill file
+  u32     m_SpillSize;
+  bool    m_Spilled;      // whether the spill file holds the current text of the chunk
+};
+
+// append-only log of history text in chunks of INTERNAL::HISTORY_CHUNK_SIZE characters; chunks never move, so that
+// appending never copies text which is already logged, and the oldest ones are spilled to disk once the log takes more
+// memory than allowed by the HistoryMemory option
+struct HistoryLog
+{
+  HistoryChunk* m_Chunks;
+  u32           m_NChunks;
+  u32           m_ChunkCapacity;
+  u32           m_NResident;
+  u32           m_Oldest; // no chunk before this one is resident, other than the last
+  u64           m_Length;
+  
+  void    Free();
+  void    Append(const EChar* data, u32 length);
+  void    AppendReversed(const Buffer& buffer, u32 lb, u32 ub);
+  void    Read(OUT EChar* dst, u64 offset, u32 length);
+  i32     Load(u64 offset, u64 length);
+  EChar*  Chunk(u32 idx, bool modify);
+  void    Spill();
+};
+
+struct HighlightEdit
+{
+  u32 m_Pos;
+  u32 m_Inserted;
+  u32 m_Erased;
+};
+
+struct HighlightState;
+
+// positions at which highlighting can resume, in ascending order, along with the recent edits needed to make sense of
+// highlights computed for older versions of the text; see RequestHighlight()
+struct HighlightCache
+{
+  u32*            m_Checkpoints;
+  u32             m_NCheckpoints;
+  u32             m_CheckpointCapacity;
+  u64             m_Version;  // number of edits so far
+  HighlightEdit   m_Edits[INTERNAL::HIGHLIGHT_EDITS];
+  HighlightState* m_State;    // shared with the highlighting thread
+  
+  void  Free();
+  void  Edit(u32 pos, u32 inserted, u32 erased);
+  u32   Resume(u32 pos) const;
+  void  Insert(u32 pos);
 };
 
 struct Frame
 {
-  EString   m_Buffer;
+  Buffer    m_Buffer;
   char*     m_Source;
   u32       m_Start;
   u32       m_Cursor;
@@ -37,6 +105,15 @@ struct Frame
   u32       m_HistoryLength;
   u32       m_HistoryCapacity;
   u32       m_CurHistory; // 1-based
+  u32       m_RootRedo;   // child of the unmodified text followed by redoing, 1-based, or 0
+  u8*       m_Journal;    // mapped undo journal of the source, see LoadJournal()
+  u64       m_JournalSize;
+  u64       m_JournalRecord;  // last journal record saved or loaded, or 0
+  u32       m_JournalSynced;  // leading history entries held by that record
+  
+  HistoryLog              m_HistoryLog;
+  mutable HighlightCache  m_HighlightCache;
+  MatchIndex              m_MatchIndex;
   
   void  Free();
   void  Render(u32 x, u32 y, u32 w, u32 h, bool active) const;
@@ -46,10 +123,12 @@ struct Frame
   void  Write(const char* str, u32 pos);
   void  Erase(u32 lb, u32 ub);
   void  Erase(u32 pos);
+  void  Replace(const u32* positions, u32 count, u32 length, const EString& str);
   void  Undo();
   void  Redo();
   void  BreakHistory();
-  void  TruncateHistory();
+  void  GotoHistory(u32 target);
+  u32   NextBranch(bool reverse) const;
   void  SaveCursor();
   void  LoadCursor();
   void  ComputeBounds(u32 w, u32 h);
@@ -59,3 +138,5 @@ struct Frame
 void  EmptyFrame(OUT Frame& frame);
 void  StringFrame(OUT Frame& frame, const char* str);
 i32   FileFrame(OUT Frame& frame, const char* path);
+u32   HistoryLength(Frame& frame, const History& history);
+i32   LoadHistory(Frame& frame, const History& history);
@@ -1,9 +1,20 @@
 // SPDX-License-Identifier: GPL-3.0-or-later
 
-#include <cctype>
+#include <cerrno>
+#include <cstdlib>
 #include <cstring>
 #include <Highlight.hh>
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+extern "C"
+{
+#include <fcntl.h>
+#include <pthread.h>
+}
+
 constexpr const char* NUMBER_INIT   = "0123456789";
 constexpr const char* NUMBER        = "xob+-.0123456789aAbBcCdDeEfF_";
 constexpr const char* C_SPECIAL     = "!%&()*+,-./:;<=>?[\\]^{|}~";
@@ -22,25 +33,159 @@ constexpr const char* PY_SPECIAL    = "+=-*/%&|^<>@:~()[]{},!;@";
 constexpr const char* PY_WORD_INIT  = C_WORD_INIT;
 constexpr const char* PY_WORD       = C_WORD;
 
+enum CharClass : u8
+{
+  CHAR_NUMBER_INIT  = 0x1,
+  CHAR_NUMBER       = 0x2,
+  CHAR_SPECIAL      = 0x4,
+  CHAR_WORD_INIT    = 0x8,
+  CHAR_WORD         = 0x10,
+  CHAR_LOWER        = 0x20,
+  CHAR_UPPER        = 0x40,
+  CHAR_SPACE        = 0x80
+};
+
+// classes of every ASCII character in a language mode; anything else belongs to no class
+struct CharClasses
+{
+  u8  m_Classes[128];
+};
+
+constexpr CharClasses MakeCharClasses(const char* special, const char* wordInit, const char* word)
+{
+  CharClasses classes {};
+  
+  auto  add = [&](const char* chars, u8 cls)
+  {
+    for (; *chars; ++chars)
+    {
+      classes.m_Classes[(u8)*chars] |= cls;
+    }
+  };
+  add(NUMBER_INIT, CHAR_NUMBER_INIT);
+  add(NUMBER, CHAR_NUMBER);
+  add(special, CHAR_SPECIAL);
+  add(wordInit, CHAR_WORD_INIT);
+  add(word, CHAR_WORD);
+  add("abcdefghijklmnopqrstuvwxyz", CHAR_LOWER);
+  add("ABCDEFGHIJKLMNOPQRSTUVWXYZ", CHAR_UPPER);
+  add(" \t\n\v\f\r", CHAR_SPACE);
+  
+  return (classes);
+}
+
+// indexed by LangMode
+constexpr CharClasses CHAR_CLASSES[LANG_MODE_END] =
+{
+  MakeCharClasses(C_SPECIAL, C_WORD_INIT, C_WORD),
+  MakeCharClasses(SH_SPECIAL, SH_WORD_INIT, SH_WORD),
+  MakeCharClasses(JS_SPECIAL, JS_WORD_INIT, JS_WORD),
+  MakeCharClasses(CC_SPECIAL, CC_WORD_INIT, CC_WORD),
+  MakeCharClasses(PY_SPECIAL, PY_WORD_INIT, PY_WORD)
+};
+
+// the vectorized word scan only knows about alphanumerics, underscores and dollar signs
+constexpr bool  VectorizableWords(const CharClasses& classes)
+{
+  for (u32 i = 0; i < 128; ++i)
+  {
+    bool  alnum = (i >= 'a' && i <= 'z') || (i >= 'A' && i <= 'Z') || (i >= '0' && i <= '9') || i == '_';
+    bool  word  = classes.m_Classes[i] & CHAR_WORD;
+    if (word != alnum && i != '$')
+    {
+      return (false);
+    }
+  }
+  return (true);
+}
+
+static_assert(VectorizableWords(CHAR_CLASSES[LANG_MODE_C]));
+static_assert(VectorizableWords(CHAR_CLASSES[LANG_MODE_SH]));
+static_assert(VectorizableWords(CHAR_CLASSES[LANG_MODE_JS]));
+static_assert(VectorizableWords(CHAR_CLASSES[LANG_MODE_CC]));
+static_assert(VectorizableWords(CHAR_CLASSES[LANG_MODE_PY]));
+
+// regions found for one version of a frame's text
+struct HighlightSnapshot
+{
+  u64     m_Version;
+  u32     m_LowerBound;
+  u32     m_UpperBound;
+  Region* m_Regions;
+  u32     m_NRegions;
+  u32     m_RegionCapacity;
+  u32*    m_Checkpoints;  // resume points found on the way
+  u32     m_NCheckpoints;
+  u32     m_CheckpointCapacity;
+};
+
+// the text is copied so that the frame can keep being edited while the job is worked on
+struct HighlightJob
+{
+  u64   m_Version;
+  char* m_Source;
+  u8*   m_Text;
+  u64   m_Size;
+  u32   m_Offset; // position of the copied text in the frame
+  u32   m_LowerBound;
+  u32   m_UpperBound;
+};
+
+// everything but the shown snapshot and the last request is guarded by g_HighlightMutex
+struct HighlightState
+{
+  HighlightJob      m_Job;
+  HighlightSnapshot m_Done;
+  HighlightState*   m_Next;
+  bool              m_HasJob;
+  bool              m_HasDone;
+  bool              m_Queued;
+  bool              m_Dead;
+  HighlightSnapshot m_Shown;
+  bool              m_Requested;
+  u32               m_RequestedFrom;
+  u64               m_RequestedVersion;
+  u32               m_RequestedLowerBound;
+  u32               m_RequestedUpperBound;
+};
+
 static Region FindC(const Frame& frame, u32 from);
 static Region FindCC(const Frame& frame, u32 from);
 static Region FindSh(const Frame& frame, u32 from);
 static Region FindJS(const Frame& frame, u32 from);
 static Region FindPy(const Frame& frame, u32 from);
-static bool   CompareString(const Frame& f, const char* cmp, u32 at);
-static bool   CompareAny(const Frame& f, const char* cmp, u32 at);
-static Region LineComment(const Frame& f, u32 from);
-static Region Number(const Frame& f, u32 from);
-static Region String(const Frame& f, u32 from, bool escape, bool newline);
-static Region Special(const Frame& f, u32 from, const char* special);
-static bool   TryKeyword(OUT Region& region, const Frame& f, u32 from, u32 end, LangMode lang);
-static Region CPreproc(const Frame& f, u32 from);
-static Region CComment(const Frame& f, u32 from);
-static Region CWord(const Frame& f, u32 from);
-static Region ShWord(const Frame& f, u32 from);
-static Region JSWord(const Frame& f, u32 from);
-static Region CCWord(const Frame& f, u32 from);
-static Region PyWord(const Frame& f, u32 from);
+static bool   CompareString(BufferCursor c, const char* cmp);
+static bool   CompareAny(BufferCursor c, const char* cmp);
+static bool   IsClass(BufferCursor c, LangMode lang, u8 cls);
+static void   SkipSpace(IN_OUT BufferCursor& c);
+static u32    SkipWord(IN_OUT BufferCursor& c, LangMode lang);
+static bool   CompareWord(BufferCursor c, const EString& word);
+static Region LineComment(BufferCursor c);
+static Region Number(BufferCursor c, LangMode lang);
+static Region String(BufferCursor c, bool escape, bool newline);
+static Region Special(BufferCursor c, LangMode lang);
+static bool   TryKeyword(OUT Region& region, BufferCursor c, u32 end, LangMode lang);
+static Region CPreproc(BufferCursor c);
+static Region CComment(BufferCursor c);
+static Region CWord(BufferCursor c);
+static Region ShWord(BufferCursor c);
+static Region JSWord(BufferCursor c);
+static Region CCWord(BufferCursor c);
+static Region PyWord(BufferCursor c);
+static void*  HighlightThread(void* arg);
+static void   ProcessJob(OWNS HighlightJob& job, OUT HighlightSnapshot& snapshot);
+static void   FreeJob(HighlightJob& job);
+static void   FreeSnapshot(HighlightSnapshot& snapshot);
+static void   FreeState(HighlightState* state);
+
+static pthread_t        g_HighlightThread;
+static pthread_mutex_t  g_HighlightMutex    = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t   g_HighlightCond     = PTHREAD_COND_INITIALIZER;
+static HighlightState*  g_HighlightQueue;
+static HighlightState*  g_HighlightWorking;
+static bool             g_HighlightStarted;
+static bool             g_HighlightFailed;
+static int              g_HighlightPipe[2]  = {-1, -1};
 
 Region  FindHighlight(const Frame& frame, u32 from)
 {
@@ -93,43 +238,479 @@ Region  FindHighlight(const Frame& frame, u32 from)
   }
 }
 
+// requests are served in the background from a copy of the text, so the frame can keep being edited meanwhile and
+// renders with whatever was last finished; no more than INTERNAL::HIGHLIGHT_MAX_COPY characters are copied before the
+// requested range, and if the last resume point is further back than that, the copy only serves to find resume points
+// closer to it for the requests that follow
+void  RequestHighlight(const Frame& frame, u32 lb, u32 ub)
+{
+  if (!frame.m_Source)
+  {
+    return;
+  }
+  
+  HighlightCache& cache = frame.m_HighlightCache;
+  if (!cache.m_State)
+  {
+    cache.m_State = (HighlightState*)calloc(1, sizeof(HighlightState));
+  }
+  HighlightState* state = cache.m_State;
+  
+  // take the newest finished snapshot, whose resume points are still of use up to the first edit made since
+  pthread_mutex_lock(&g_HighlightMutex);
+  if (state->m_HasDone)
+  {
+    FreeSnapshot(state->m_Shown);
+    state->m_Shown = state->m_Done;
+    state->m_HasDone = false;
+    
+    if (cache.m_Version - state->m_Shown.m_Version <= INTERNAL::HIGHLIGHT_EDITS)
+    {
+      u32 limit = UINT32_MAX;
+      for (u64 version = state->m_Shown.m_Version; version < cache.m_Version; ++version)
+      {
+        const HighlightEdit&  edit  = cache.m_Edits[version % INTERNAL::HIGHLIGHT_EDITS];
+        u32                   pos   = edit.m_Pos > 2 ? edit.m_Pos - 2 : 0;
+        limit = pos < limit ? pos : limit;
+      }
+      
+      for (u32 i = 0; i < state->m_Shown.m_NCheckpoints && state->m_Shown.m_Checkpoints[i] < limit; ++i)
+      {
+        cache.Insert(state->m_Shown.m_Checkpoints[i]);
+      }
+    }
+  }
+  pthread_mutex_unlock(&g_HighlightMutex);
+  
+  // a copy cut short is asked for again only once it gave resume points further on, or the text changed
+  u32   from  = cache.Resume(lb);
+  bool  cut   = lb - from > INTERNAL::HIGHLIGHT_MAX_COPY;
+  if (state->m_Requested
+      && state->m_RequestedVersion == cache.m_Version
+      && ((state->m_RequestedLowerBound <= lb && state->m_RequestedUpperBound >= ub)
+          || (cut && state->m_RequestedFrom == from)))
+  {
+    return;
+  }
+  
+  // the copy reaches past the requested range since some regions look ahead to decide on their color; a copy cut short
+  // is requested as the empty range a lookahead short of its end, so that every resume point found in it is sound
+  u32 to  = ub + INTERNAL::HIGHLIGHT_LOOKAHEAD < frame.m_Buffer.m_Length
+          ? ub + INTERNAL::HIGHLIGHT_LOOKAHEAD
+          : frame.m_Buffer.m_Length;
+  if (cut)
+  {
+    to = from + INTERNAL::HIGHLIGHT_MAX_COPY;
+    lb = to - INTERNAL::HIGHLIGHT_LOOKAHEAD;
+    ub = lb;
+  }
+  
+  HighlightJob  job   =
+  {
+    .m_Version    = cache.m_Version,
+    .m_Source     = strdup(frame.m_Source),
+    .m_Text       = nullptr,
+    .m_Size       = 0,
+    .m_Offset     = from,
+    .m_LowerBound = lb,
+    .m_UpperBound = ub
+  };
+  job.m_Text = frame.m_Buffer.Bytes(from, to, job.m_Size);
+  
+  state->m_Requested = true;
+  state->m_RequestedFrom = from;
+  state->m_RequestedVersion = cache.m_Version;
+  state->m_RequestedLowerBound = lb;
+  state->m_RequestedUpperBound = ub;
+  
+  if (!g_HighlightStarted)
+  {
+    g_HighlightStarted = true;
+    if (pipe(g_HighlightPipe) || pthread_create(&g_HighlightThread, nullptr, HighlightThread, nullptr))
+    {
+      Error("Highlight: Failed to start highlighting thread!");
+      g_HighlightFailed = true;
+    }
+    else
+    {
+      fcntl(g_HighlightPipe[0], F_SETFL, O_NONBLOCK);
+      fcntl(g_HighlightPipe[1], F_SETFL, O_NONBLOCK);
+    }
+  }
+  
+  // without a thread, the job is done right away
+  if (g_HighlightFailed)
+  {
+    FreeSnapshot(state->m_Shown);
+    ProcessJob(job, state->m_Shown);
+    return;
+  }
+  
+  pthread_mutex_lock(&g_HighlightMutex);
+  if (state->m_HasJob)
+  {
+    FreeJob(state->m_Job);
+  }
+  state->m_Job = job;
+  state->m_HasJob = true;
+  
+  if (!state->m_Queued)
+  {
+    HighlightState** tail = &g_HighlightQueue;
+    while (*tail)
+    {
+      tail = &(*tail)->m_Next;
+    }
+    *tail = state;
+    state->m_Next = nullptr;
+    state->m_Queued = true;
+  }
+  pthread_cond_signal(&g_HighlightCond);
+  pthread_mutex_unlock(&g_HighlightMutex);
+}
+
+// characters which can't be traced back to the last finished snapshot are left unhighlighted until the next one
+Color HighlightColor(const Frame& frame, u32 pos)
+{
+  const HighlightCache& cache = frame.m_HighlightCache;
+  if (!cache.m_State || !cache.m_State->m_Shown.m_Regions)
+  {
+    return (g_Options.m_Normal);
+  }
+  
+  const HighlightSnapshot&  snapshot  = cache.m_State->m_Shown;
+  if (cache.m_Version - snapshot.m_Version > INTERNAL::HIGHLIGHT_EDITS)
+  {
+    return (g_Options.m_Normal);
+  }
+  
+  // undo the effect of every edit since the snapshot on the position
+  for (u64 version = cache.m_Version; version > snapshot.m_Version; --version)
+  {
+    const HighlightEdit&  edit  = cache.m_Edits[(version - 1) % INTERNAL::HIGHLIGHT_EDITS];
+    if (pos < edit.m_Pos)
+    {
+      continue;
+    }
+    
+    if (pos < edit.m_Pos + edit.m_Inserted)
+    {
+      return (g_Options.m_Normal);
+    }
+    
+    pos = pos - edit.m_Inserted + edit.m_Erased;
+  }
+  
+  if (pos < snapshot.m_LowerBound || pos >= snapshot.m_UpperBound)
+  {
+    return (g_Options.m_Normal);
+  }
+  
+  u32 low   = 0;
+  u32 high  = snapshot.m_NRegions;
+  while (low < high)
+  {
+    u32 mid = (low + high) / 2;
+    if (snapshot.m_Regions[mid].m_UpperBound <= pos)
+    {
+      low = mid + 1;
+    }
+    else
+    {
+      high = mid;
+    }
+  }
+  
+  if (low < snapshot.m_NRegions && snapshot.m_Regions[low].m_LowerBound <= pos)
+  {
+    return (snapshot.m_Regions[low].m_Color);
+  }
+  
+  return (g_Options.m_Normal);
+}
+
+i32 HighlightNotifier()
+{
+  return (g_HighlightPipe[0]);
+}
+
+void  HighlightCache::Free()
+{
+  if (m_State)
+  {
+    // a state still being worked on is left to the highlighting thread to free
+    pthread_mutex_lock(&g_HighlightMutex);
+    HighlightState**  queued  = &g_HighlightQueue;
+    while (*queued && *queued != m_State)
+    {
+      queued = &(*queued)->m_Next;
+    }
+    
+    if (*queued)
+    {
+      *queued = m_State->m_Next;
+    }
+    
+    FreeSnapshot(m_State->m_Shown);
+    if (g_HighlightWorking == m_State)
+    {
+      m_State->m_Dead = true;
+    }
+    else
+    {
+      FreeState(m_State);
+    }
+    pthread_mutex_unlock(&g_HighlightMutex);
+  }
+  
+  if (m_Checkpoints)
+  {
+    free(m_Checkpoints);
+  }
+  
+  *this = HighlightCache{};
+}
+
+void  HighlightCache::Edit(u32 pos, u32 inserted, u32 erased)
+{
+  m_Edits[m_Version % INTERNAL::HIGHLIGHT_EDITS] = HighlightEdit
+  {
+    .m_Pos      = pos,
+    .m_Inserted = inserted,
+    .m_Erased   = erased
+  };
+  ++m_Version;
+  
+  // region bounds depend on at most a couple of characters past them
+  pos = pos > 2 ? pos - 2 : 0;
+  while (m_NCheckpoints && m_Checkpoints[m_NCheckpoints - 1] >= pos)
+  {
+    --m_NCheckpoints;
+  }
+}
+
+u32 HighlightCache::Resume(u32 pos) const
+{
+  u32 low   = 0;
+  u32 high  = m_NCheckpoints;
+  while (low < high)
+  {
+    u32 mid = (low + high) / 2;
+    if (m_Checkpoints[mid] <= pos)
+    {
+      low = mid + 1;
+    }
+    else
+    {
+      high = mid;
+    }
+  }
+  
+  return (low ? m_Checkpoints[low - 1] : 0);
+}
+
+void  HighlightCache::Insert(u32 pos)
+{
+  if (m_NCheckpoints && m_Checkpoints[m_NCheckpoints - 1] >= pos)
+  {
+    return;
+  }
+  
+  if (m_NCheckpoints >= m_CheckpointCapacity)
+  {
+    m_CheckpointCapacity = m_CheckpointCapacity ? 2 * m_CheckpointCapacity : 1;
+    m_Checkpoints = (u32*)reallocarray(m_Checkpoints, m_CheckpointCapacity, sizeof(u32));
+  }
+  m_Checkpoints[m_NCheckpoints++] = pos;
+}
+
+static void*  HighlightThread(void* arg)
+{
+  (void)arg;
+  
+  for (;;)
+  {
+    pthread_mutex_lock(&g_HighlightMutex);
+    while (!g_HighlightQueue)
+    {
+      pthread_cond_wait(&g_HighlightCond, &g_HighlightMutex);
+    }
+    
+    HighlightState* state = g_HighlightQueue;
+    g_HighlightQueue = state->m_Next;
+    state->m_Queued = false;
+    state->m_HasJob = false;
+    g_HighlightWorking = state;
+    HighlightJob    job   = state->m_Job;
+    pthread_mutex_unlock(&g_HighlightMutex);
+    
+    HighlightSnapshot snapshot  {};
+    ProcessJob(job, snapshot);
+    
+    pthread_mutex_lock(&g_HighlightMutex);
+    g_HighlightWorking = nullptr;
+    if (state->m_Dead)
+    {
+      FreeSnapshot(snapshot);
+      FreeState(state);
+    }
+    else
+    {
+      if (state->m_HasDone)
+      {
+        FreeSnapshot(state->m_Done);
+      }
+      state->m_Done = snapshot;
+      state->m_HasDone = true;
+    }
+    pthread_mutex_unlock(&g_HighlightMutex);
+    
+    // the main thread only learns that it has to redraw through the pipe; a full pipe already tells it so
+    while (write(g_HighlightPipe[1], "", 1) < 0 && errno == EINTR)
+    {
+    }
+  }
+  
+  return (nullptr);
+}
+
+static void ProcessJob(OWNS HighlightJob& job, OUT HighlightSnapshot& snapshot)
+{
+  Frame frame {};
+  frame.m_Source = job.m_Source;
+  UTF8Buffer(frame.m_Buffer, job.m_Text, job.m_Size);
+  
+  snapshot = HighlightSnapshot
+  {
+    .m_Version            = job.m_Version,
+    .m_LowerBound         = job.m_LowerBound,
+    .m_UpperBound         = job.m_UpperBound,
+    .m_Regions            = (Region*)malloc(sizeof(Region)),
+    .m_NRegions           = 0,
+    .m_RegionCapacity     = 1,
+    .m_Checkpoints        = nullptr,
+    .m_NCheckpoints       = 0,
+    .m_CheckpointCapacity = 0
+  };
+  
+  // positions within the copy are relative to where it was taken from
+  u32     lb        = job.m_LowerBound - job.m_Offset;
+  u32     ub        = job.m_UpperBound - job.m_Offset;
+  u32     last      = 0;
+  Region  region    = FindHighlight(frame, 0);
+  while (region.m_LowerBound < ub && region.m_LowerBound < frame.m_Buffer.m_Length)
+  {
+    if (region.m_UpperBound < lb && region.m_UpperBound >= last + INTERNAL::HIGHLIGHT_INTERVAL)
+    {
+      if (snapshot.m_NCheckpoints >= snapshot.m_CheckpointCapacity)
+      {
+        snapshot.m_CheckpointCapacity = snapshot.m_CheckpointCapacity ? 2 * snapshot.m_CheckpointCapacity : 1;
+        snapshot.m_Checkpoints = (u32*)reallocarray(snapshot.m_Checkpoints, snapshot.m_CheckpointCapacity, sizeof(u32));
+      }
+      snapshot.m_Checkpoints[snapshot.m_NCheckpoints++] = job.m_Offset + region.m_UpperBound;
+      last = region.m_UpperBound;
+    }
+    
+    if (region.m_UpperBound > lb)
+    {
+      if (snapshot.m_NRegions >= snapshot.m_RegionCapacity)
+      {
+        snapshot.m_RegionCapacity *= 2;
+        snapshot.m_Regions = (Region*)reallocarray(snapshot.m_Regions, snapshot.m_RegionCapacity, sizeof(Region));
+      }
+      
+      region.m_LowerBound += job.m_Offset;
+      region.m_UpperBound += job.m_Offset;
+      snapshot.m_Regions[snapshot.m_NRegions++] = region;
+      region.m_UpperBound -= job.m_Offset;
+    }
+    
+    region = FindHighlight(frame, region.m_UpperBound);
+  }
+  
+  frame.Free();
+}
+
+static void FreeJob(HighlightJob& job)
+{
+  free(job.m_Source);
+  free(job.m_Text);
+}
+
+static void FreeSnapshot(HighlightSnapshot& snapshot)
+{
+  if (snapshot.m_Regions)
+  {
+    free(snapshot.m_Regions);
+  }
+  
+  if (snapshot.m_Checkpoints)
+  {
+    free(snapshot.m_Checkpoints);
+  }
+  
+  snapshot = HighlightSnapshot{};
+}
+
+static void FreeState(HighlightState* state)
+{
+  if (state->m_HasJob)
+  {
+    FreeJob(state->m_Job);
+  }
+  
+  if (state->m_HasDone)
+  {
+    FreeSnapshot(state->m_Done);
+  }
+  
+  FreeSnapshot(state->m_Shown);
+  free(state);
+}
+
 static Region FindC(const Frame& frame, u32 from)
 {
-  for (u32 i = from; i < frame.m_Buffer.m_Length; ++i)
+  for (BufferCursor c = frame.m_Buffer.Cursor(from); !c.AtEnd(); c.Next())
   {
-    if (CompareString(frame, "//", i))
+    SkipSpace(c);
+    if (c.AtEnd())
+    {
+      break;
+    }
+    
+    if (CompareString(c, "//"))
     {
-      Region  region  = LineComment(frame, i);
+      Region  region  = LineComment(c);
       return (region);
     }
-    else if (CompareString(frame, "/*", i))
+    else if (CompareString(c, "/*"))
     {
-      Region  region  = CComment(frame, i);
+      Region  region  = CComment(c);
       return (region);
     }
-    else if (CompareAny(frame, NUMBER_INIT, i))
+    else if (IsClass(c, LANG_MODE_C, CHAR_NUMBER_INIT))
     {
-      Region  region  = Number(frame, i);
+      Region  region  = Number(c, LANG_MODE_C);
       return (region);
     }
-    else if (CompareString(frame, "#", i))
+    else if (CompareString(c, "#"))
     {
-      Region  region  = CPreproc(frame, i);
+      Region  region  = CPreproc(c);
       return (region);
     }
-    else if (CompareAny(frame, C_SPECIAL, i))
+    else if (IsClass(c, LANG_MODE_C, CHAR_SPECIAL))
     {
-      Region  region  = Special(frame, i, C_SPECIAL);
+      Region  region  = Special(c, LANG_MODE_C);
       return (region);
     }
-    else if (CompareAny(frame, C_WORD_INIT, i))
+    else if (IsClass(c, LANG_MODE_C, CHAR_WORD_INIT))
     {
-      Region  region  = CWord(frame, i);
+      Region  region  = CWord(c);
       return (region);
     }
-    else if (CompareAny(frame, "\"'", i))
+    else if (CompareAny(c, "\"'"))
     {
-      Region  region  = String(frame, i, true, false);
+      Region  region  = String(c, true, false);
       return (region);
     }
   }
@@ -145,41 +726,47 @@ static Region FindC(const Frame& frame, u32 from)
 
 static Region FindCC(const Frame& frame, u32 from)
 {
-  for (u32 i = from; i < frame.m_Buffer.m_Length; ++i)
+  for (BufferCursor c = frame.m_Buffer.Cursor(from); !c.AtEnd(); c.Next())
   {
-    if (CompareString(frame, "//", i))
+    SkipSpace(c);
+    if (c.AtEnd())
+    {
+      break;
+    }
+    
+    if (CompareString(c, "//"))
     {
-      Region  region  = LineComment(frame, i);
+      Region  region  = LineComment(c);
       return (region);
     }
-    else if (CompareString(frame, "/*", i))
+    else if (CompareString(c, "/*"))
     {
-      Region  region  = CComment(frame, i);
+      Region  region  = CComment(c);
       return (region);
     }
-    else if (CompareAny(frame, NUMBER_INIT, i))
+    else if (IsClass(c, LANG_MODE_CC, CHAR_NUMBER_INIT))
     {
-      Region  region  = Number(frame, i);
+      Region  region  = Number(c, LANG_MODE_CC);
       return (region);
     }
-    else if (CompareString(frame, "#", i))
+    else if (CompareString(c, "#"))
     {
-      Region  region  = CPreproc(frame, i);
+      Region  region  = CPreproc(c);
       return (region);
     }
-    else if (CompareAny(frame, CC_SPECIAL, i))
+    else if (IsClass(c, LANG_MODE_CC, CHAR_SPECIAL))
     {
-      Region  region  = Special(frame, i, CC_SPECIAL);
+      Region  region  = Special(c, LANG_MODE_CC);
       return (region);
     }
-    else if (CompareAny(frame, CC_WORD_INIT, i))
+    else if (IsClass(c, LANG_MODE_CC, CHAR_WORD_INIT))
     {
-      Region  region  = CCWord(frame, i);
+      Region  region  = CCWord(c);
       return (region);
     }
-    else if (CompareAny(frame, "\"'", i))
+    else if (CompareAny(c, "\"'"))
     {
-      Region  region  = String(frame, i, true, false);
+      Region  region  = String(c, true, false);
       return (region);
     }
   }
@@ -195,36 +782,42 @@ static Region FindCC(const Frame& frame, u32 from)
 
 static Region FindSh(const Frame& frame, u32 from)
 {
-  for (u32 i = from; i < frame.m_Buffer.m_Length; ++i)
+  for (BufferCursor c = frame.m_Buffer.Cursor(from); !c.AtEnd(); c.Next())
   {
-    if (CompareString(frame, "#", i))
+    SkipSpace(c);
+    if (c.AtEnd())
     {
-      Region  region  = LineComment(frame, i);
+      break;
+    }
+    
+    if (CompareString(c, "#"))
+    {
+      Region  region  = LineComment(c);
       return (region);
     }
-    else if (CompareAny(frame, NUMBER_INIT, i))
+    else if (IsClass(c, LANG_MODE_SH, CHAR_NUMBER_INIT))
     {
-      Region  region  = Number(frame, i);
+      Region  region  = Number(c, LANG_MODE_SH);
       return (region);
     }
-    else if (CompareString(frame, "'", i))
+    else if (CompareString(c, "'"))
     {
-      Region  region  = String(frame, i, false, true);
+      Region  region  = String(c, false, true);
       return (region);
     }
-    else if (CompareString(frame, "\"", i))
+    else if (CompareString(c, "\""))
     {
-      Region  region  = String(frame, i, true, true);
+      Region  region  = String(c, true, true);
       return (region);
     }
-    else if (CompareAny(frame, SH_SPECIAL, i))
+    else if (IsClass(c, LANG_MODE_SH, CHAR_SPECIAL))
     {
-      Region  region  = Special(frame, i, SH_SPECIAL);
+      Region  region  = Special(c, LANG_MODE_SH);
       return (region);
     }
-    else if (CompareAny(frame, SH_WORD_INIT, i))
+    else if (IsClass(c, LANG_MODE_SH, CHAR_WORD_INIT))
     {
-      Region  region  = ShWord(frame, i);
+      Region  region  = ShWord(c);
       return (region);
     }
   }
@@ -240,36 +833,42 @@ static Region FindSh(const Frame& frame, u32 from)
 
 static Region FindJS(const Frame& frame, u32 from)
 {
-  for (u32 i = from; i < frame.m_Buffer.m_Length; ++i)
+  for (BufferCursor c = frame.m_Buffer.Cursor(from); !c.AtEnd(); c.Next())
   {
-    if (CompareString(frame, "//", i) || CompareString(frame, "#!", i))
+    SkipSpace(c);
+    if (c.AtEnd())
     {
-      Region  region  = LineComment(frame, i);
+      break;
+    }
+    
+    if (CompareString(c, "//") || CompareString(c, "#!"))
+    {
+      Region  region  = LineComment(c);
       return (region);
     }
-    else if (CompareString(frame, "/*", i))
+    else if (CompareString(c, "/*"))
     {
-      Region  region  = CComment(frame, i);
+      Region  region  = CComment(c);
       return (region);
     }
-    else if (CompareAny(frame, NUMBER_INIT, i))
+    else if (IsClass(c, LANG_MODE_JS, CHAR_NUMBER_INIT))
     {
-      Region  region  = Number(frame, i);
+      Region  region  = Number(c, LANG_MODE_JS);
       return (region);
     }
-    else if (CompareAny(frame, JS_WORD_INIT, i))
+    else if (IsClass(c, LANG_MODE_JS, CHAR_WORD_INIT))
     {
-      Region  region  = JSWord(frame, i);
+      Region  region  = JSWord(c);
       return (region);
     }
-    else if (CompareAny(frame, "\"'`", i))
+    else if (CompareAny(c, "\"'`"))
     {
-      Region  region  = String(frame, i, true, false);
+      Region  region  = String(c, true, false);
       return (region);
     }
-    else if (CompareAny(frame, JS_SPECIAL, i))
+    else if (IsClass(c, LANG_MODE_JS, CHAR_SPECIAL))
     {
-      Region  region  = Special(frame, i, JS_SPECIAL);
+      Region  region  = Special(c, LANG_MODE_JS);
       return (region);
     }
   }
@@ -285,31 +884,37 @@ static Region FindJS(const Frame& frame, u32 from)
 
 static Region FindPy(const Frame& frame, u32 from)
 {
-  for (u32 i = from; i < frame.m_Buffer.m_Length; ++i)
+  for (BufferCursor c = frame.m_Buffer.Cursor(from); !c.AtEnd(); c.Next())
   {
-    if (CompareString(frame, "#", i))
+    SkipSpace(c);
+    if (c.AtEnd())
     {
-      Region  region  = LineComment(frame, i);
+      break;
+    }
+    
+    if (CompareString(c, "#"))
+    {
+      Region  region  = LineComment(c);
       return (region);
     }
-    else if (CompareAny(frame, NUMBER_INIT, i))
+    else if (IsClass(c, LANG_MODE_PY, CHAR_NUMBER_INIT))
     {
-      Region  region  = Number(frame, i);
+      Region  region  = Number(c, LANG_MODE_PY);
       return (region);
     }
-    else if (CompareAny(frame, PY_SPECIAL, i))
+    else if (IsClass(c, LANG_MODE_PY, CHAR_SPECIAL))
     {
-      Region  region  = Special(frame, i, PY_SPECIAL);
+      Region  region  = Special(c, LANG_MODE_PY);
       return (region);
     }
-    else if (CompareAny(frame, PY_WORD_INIT, i))
+    else if (IsClass(c, LANG_MODE_PY, CHAR_WORD_INIT))
     {
-      Region  region  = PyWord(frame, i);
+      Region  region  = PyWord(c);
       return (region);
     }
-    else if (CompareAny(frame, "\"'", i))
+    else if (CompareAny(c, "\"'"))
     {
-      Region  region  = String(frame, i, true, false);
+      Region  region  = String(c, true, false);
       return (region);
     }
   }
@@ -323,11 +928,11 @@ static Region FindPy(const Frame& frame, u32 from)
   return (region);
 }
 
-static bool CompareString(const Frame& f, const char* cmp, u32 at)
+static bool CompareString(BufferCursor c, const char* cmp)
 {
-  for (; *cmp && at < f.m_Buffer.m_Length; ++at, ++cmp)
+  for (; *cmp && !c.AtEnd(); c.Next(), ++cmp)
   {
-    if ((u32)*cmp != f.m_Buffer.m_Data[at].m_Codepoint)
+    if ((u32)*cmp != c.Codepoint())
     {
       return (false);
     }
@@ -335,11 +940,12 @@ static bool CompareString(const Frame& f, const char* cmp, u32 at)
   return (!*cmp);
 }
 
-static bool CompareAny(const Frame& f, const char* cmp, u32 at)
+static bool CompareAny(BufferCursor c, const char* cmp)
 {
+  u32 codepoint = c.Codepoint();
   for (; *cmp; ++cmp)
   {
-    if ((u32)*cmp == f.m_Buffer.m_Data[at].m_Codepoint)
+    if ((u32)*cmp == codepoint)
     {
       return (true);
     }
@@ -347,118 +953,230 @@ static bool CompareAny(const Frame& f, const char* cmp, u32 at)
   return (false);
 }
 
-static Region LineComment(const Frame& f, u32 from)
+static bool IsClass(BufferCursor c, LangMode lang, u8 cls)
+{
+  u32 codepoint = c.Codepoint();
+  return (!c.AtEnd() && codepoint < 128 && CHAR_CLASSES[lang].m_Classes[codepoint] & cls);
+}
+
+#ifdef __SSE2__
+// bit i is set if byte i lies within [lo, hi]; bytes past 0x7f compare as negative and never match
+static u32  RangeMask(__m128i block, char lo, char hi)
+{
+  __m128i above = _mm_cmpgt_epi8(block, _mm_set1_epi8(lo - 1));
+  __m128i below = _mm_cmplt_epi8(block, _mm_set1_epi8(hi + 1));
+  return (_mm_movemask_epi8(_mm_and_si128(above, below)));
+}
+
+static u32  ByteMask(__m128i block, char ch)
+{
+  return (_mm_movemask_epi8(_mm_cmpeq_epi8(block, _mm_set1_epi8(ch))));
+}
+#endif
+
+static void SkipSpace(IN_OUT BufferCursor& c)
+{
+  while (!c.AtEnd())
+  {
+#ifdef __SSE2__
+    // whitespace often comes in long runs of indentation, so it is skipped 16 bytes at a time
+    const u8* data  = &c.m_Data[c.m_Byte];
+    u64       size  = c.Contiguous();
+    u32       n     = 0;
+    while (n + 16 <= size)
+    {
+      __m128i block = _mm_loadu_si128((const __m128i*)&data[n]);
+      u32     space = ByteMask(block, ' ') | RangeMask(block, '\t', '\r');
+      if (space != 0xffff)
+      {
+        c.SkipASCII(n + __builtin_ctz(~space));
+        return;
+      }
+      n += 16;
+    }
+    
+    if (n)
+    {
+      c.SkipASCII(n);
+      continue;
+    }
+#endif
+
+    if (!IsClass(c, LANG_MODE_C, CHAR_SPACE))
+    {
+      return;
+    }
+    c.Next();
+  }
+}
+
+// returns the number of lowercase letters skipped
+static u32  SkipWord(IN_OUT BufferCursor& c, LangMode lang)
 {
-  u32 end = from;
-  while (end < f.m_Buffer.m_Length && f.m_Buffer.m_Data[end].m_Codepoint != '\n')
+  u32 nLower  = 0;
+  while (!c.AtEnd())
+  {
+#ifdef __SSE2__
+    const u8* data    = &c.m_Data[c.m_Byte];
+    u64       size    = c.Contiguous();
+    bool      dollar  = CHAR_CLASSES[lang].m_Classes['$'] & CHAR_WORD;
+    u32       n       = 0;
+    while (n + 16 <= size)
+    {
+      __m128i block = _mm_loadu_si128((const __m128i*)&data[n]);
+      u32     lower = RangeMask(block, 'a', 'z');
+      u32     word  = lower
+                      | RangeMask(block, 'A', 'Z')
+                      | RangeMask(block, '0', '9')
+                      | ByteMask(block, '_')
+                      | (dollar ? ByteMask(block, '$') : 0);
+      if (word != 0xffff)
+      {
+        u32 length  = __builtin_ctz(~word);
+        nLower += __builtin_popcount(lower & ((1u << length) - 1));
+        c.SkipASCII(n + length);
+        return (nLower);
+      }
+      nLower += __builtin_popcount(lower);
+      n += 16;
+    }
+    
+    if (n)
+    {
+      c.SkipASCII(n);
+      continue;
+    }
+#endif
+
+    if (!IsClass(c, lang, CHAR_WORD))
+    {
+      break;
+    }
+    nLower += IsClass(c, lang, CHAR_LOWER);
+    c.Next();
+  }
+  
+  return (nLower);
+}
+
+static bool CompareWord(BufferCursor c, const EString& word)
+{
+  for (u32 i = 0; i < word.m_Length; ++i, c.Next())
   {
-    ++end;
+    if (word.m_Data[i].m_Codepoint != c.Codepoint())
+    {
+      return (false);
+    }
+  }
+  return (true);
+}
+
+static Region LineComment(BufferCursor c)
+{
+  u32 from  = c.m_Pos;
+  while (!c.AtEnd() && c.Codepoint() != '\n')
+  {
+    c.Next();
   }
   
   Region  region  =
   {
     .m_LowerBound = from,
-    .m_UpperBound = end,
+    .m_UpperBound = c.m_Pos,
     .m_Color      = g_Options.m_Comment
   };
   return (region);
 }
 
-static Region Number(const Frame& f, u32 from)
+static Region Number(BufferCursor c, LangMode lang)
 {
-  u32 end = from;
-  while (end < f.m_Buffer.m_Length && strchr(NUMBER, f.m_Buffer.m_Data[end].m_Codepoint))
+  u32 from  = c.m_Pos;
+  while (IsClass(c, lang, CHAR_NUMBER))
   {
-    ++end;
+    c.Next();
   }
   
   Region  region  =
   {
     .m_LowerBound = from,
-    .m_UpperBound = end,
+    .m_UpperBound = c.m_Pos,
     .m_Color      = g_Options.m_Number
   };
   return (region);
 }
 
-static Region String(const Frame& f, u32 from, bool escape, bool newline)
+static Region String(BufferCursor c, bool escape, bool newline)
 {
-  u32 quote = f.m_Buffer.m_Data[from].m_Codepoint;
-  u32 end   = from + 1;
-  while (end < f.m_Buffer.m_Length)
+  u32 from  = c.m_Pos;
+  u32 quote = c.Codepoint();
+  c.Next();
+  while (!c.AtEnd())
   {
-    if (!newline && f.m_Buffer.m_Data[end].m_Codepoint == '\n')
+    if (!newline && c.Codepoint() == '\n')
     {
       break;
     }
     
-    if (f.m_Buffer.m_Data[end].m_Codepoint == quote)
+    if (c.Codepoint() == quote)
     {
-      ++end;
+      c.Next();
       break;
     }
     
-    end += (escape && f.m_Buffer.m_Data[end].m_Codepoint == '\\') + 1;
+    if (escape && c.Codepoint() == '\\')
+    {
+      c.Next();
+    }
+    c.Next();
   }
   
   Region  region  =
   {
     .m_LowerBound = from,
-    .m_UpperBound = end,
+    .m_UpperBound = c.m_Pos,
     .m_Color      = g_Options.m_String
   };
   return (region);
 }
 
-static Region Special(const Frame& f, u32 from, const char* special)
+static Region Special(BufferCursor c, LangMode lang)
 {
-  u32 end = from;
-  while (end < f.m_Buffer.m_Length && strchr(special, f.m_Buffer.m_Data[end].m_Codepoint))
+  u32 from  = c.m_Pos;
+  while (IsClass(c, lang, CHAR_SPECIAL))
   {
-    ++end;
+    c.Next();
   }
   
   Region  region  =
   {
     .m_LowerBound = from,
-    .m_UpperBound = end,
+    .m_UpperBound = c.m_Pos,
     .m_Color      = g_Options.m_Special
   };
   return (region);
 }
 
-static bool TryKeyword(OUT Region& region, const Frame& f, u32 from, u32 end, LangMode lang)
+static bool TryKeyword(OUT Region& region, BufferCursor c, u32 end, LangMode lang)
 {
-  for (usize i = 0; i < g_Options.m_Lang[lang].m_NKeywords; ++i)
+  const auto& words   = g_Options.m_Lang[lang];
+  u32         length  = end - c.m_Pos;
+  if (!words.m_Words || length > words.m_MaxWordLength)
   {
-    const EChar*  keyword = g_Options.m_Lang[lang].m_Keywords[i].m_Data;
-    u32           length  = g_Options.m_Lang[lang].m_Keywords[i].m_Length;
-    
-    if (end - from != length)
-    {
-      continue;
-    }
-    
-    if (!memcmp(keyword, &f.m_Buffer.m_Data[from], sizeof(EChar) * length))
-    {
-      region.m_Color = g_Options.m_Keyword;
-      return (true);
-    }
+    return (false);
   }
   
-  for (usize i = 0; i < g_Options.m_Lang[lang].m_NPrimitives; ++i)
+  u32 hash  = WORD_HASH_SEED;
+  for (BufferCursor it = c; it.m_Pos < end; it.Next())
   {
-    const EChar*  primitive = g_Options.m_Lang[lang].m_Primitives[i].m_Data;
-    u32           length    = g_Options.m_Lang[lang].m_Primitives[i].m_Length;
-    
-    if (end - from != length)
-    {
-      continue;
-    }
-    
-    if (!memcmp(primitive, &f.m_Buffer.m_Data[from], sizeof(EChar) * length))
+    hash = HashCodepoint(hash, it.Codepoint());
+  }
+  
+  for (u32 slot = hash & words.m_WordMask; words.m_Words[slot].m_Word; slot = (slot + 1) & words.m_WordMask)
+  {
+    const LangWord& word  = words.m_Words[slot];
+    if (word.m_Hash == hash && word.m_Word->m_Length == length && CompareWord(c, *word.m_Word))
     {
-      region.m_Color = g_Options.m_Primitive;
+      region.m_Color = word.m_Primitive ? g_Options.m_Primitive : g_Options.m_Keyword;
       return (true);
     }
   }
@@ -466,55 +1184,56 @@ static bool TryKeyword(OUT Region& region, const Frame& f, u32 from, u32 end, La
   return (false);
 }
 
-static Region CPreproc(const Frame& f, u32 from)
+static Region CPreproc(BufferCursor c)
 {
-  u32   end       = from;
+  u32   from      = c.m_Pos;
   bool  continue_ = false;
-  while (end < f.m_Buffer.m_Length && (continue_ || f.m_Buffer.m_Data[end].m_Codepoint != '\n'))
+  while (!c.AtEnd() && (continue_ || c.Codepoint() != '\n'))
   {
-    if (!f.m_Buffer.m_Data[end].IsSpace())
+    EChar ch  = c.Get();
+    if (!ch.IsSpace())
     {
-      continue_ = f.m_Buffer.m_Data[end].m_Codepoint == '\\';
+      continue_ = ch.m_Codepoint == '\\';
     }
-    ++end;
+    c.Next();
   }
   
   Region  region  =
   {
     .m_LowerBound = from,
-    .m_UpperBound = end,
+    .m_UpperBound = c.m_Pos,
     .m_Color      = g_Options.m_Macro
   };
   return (region);
 }
 
-static Region CComment(const Frame& f, u32 from)
+static Region CComment(BufferCursor c)
 {
-  u32 end = from + 2;
-  while (end < f.m_Buffer.m_Length && !CompareString(f, "*/", end))
+  u32 from  = c.m_Pos;
+  c.Next();
+  c.Next();
+  while (!c.AtEnd() && !CompareString(c, "*/"))
   {
-    ++end;
+    c.Next();
   }
-  end += 2 * (end < f.m_Buffer.m_Length);
+  c.Next();
+  c.Next();
   
   Region  region  =
   {
     .m_LowerBound = from,
-    .m_UpperBound = end,
+    .m_UpperBound = c.m_Pos,
     .m_Color      = g_Options.m_Comment
   };
   return (region);
 }
 
-static Region CWord(const Frame& f, u32 from)
+static Region CWord(BufferCursor c)
 {
-  i32 nLower  = 0;
-  u32 end     = from;
-  while (end < f.m_Buffer.m_Length && strchr(C_WORD, f.m_Buffer.m_Data[end].m_Codepoint))
-  {
-    nLower += islower(f.m_Buffer.m_Data[end].m_Codepoint);
-    ++end;
-  }
+  BufferCursor  begin   = c;
+  u32           from    = c.m_Pos;
+  u32           nLower  = SkipWord(c, LANG_MODE_C);
+  u32           end     = c.m_Pos;
   
   Region  region  =
   {
@@ -523,12 +1242,12 @@ static Region CWord(const Frame& f, u32 from)
     .m_Color      = g_Options.m_Normal
   };
   
-  if (TryKeyword(region, f, from, end, LANG_MODE_C))
+  if (TryKeyword(region, begin, end, LANG_MODE_C))
   {
     return (region);
   }
   
-  if (end - from >= 2 && f.m_Buffer.m_Data[end - 1].m_Codepoint == 't' && f.m_Buffer.m_Data[end - 2].m_Codepoint == '_')
+  if (end - from >= 2 && c.m_Buffer->At(end - 1).m_Codepoint == 't' && c.m_Buffer->At(end - 2).m_Codepoint == '_')
   {
     region.m_Color = g_Options.m_Type;
     return (region);
@@ -540,19 +1259,18 @@ static Region CWord(const Frame& f, u32 from)
     return (region);
   }
   
-  u32 next  = end;
-  while (next < f.m_Buffer.m_Length && f.m_Buffer.m_Data[next].IsSpace())
+  while (!c.AtEnd() && c.Get().IsSpace())
   {
-    ++next;
+    c.Next();
   }
   
-  if (next < f.m_Buffer.m_Length && f.m_Buffer.m_Data[next].m_Codepoint == '(')
+  if (c.Codepoint() == '(')
   {
     region.m_Color = g_Options.m_Emphasis;
     return (region);
   }
   
-  if (isupper(f.m_Buffer.m_Data[from].m_Codepoint))
+  if (IsClass(begin, LANG_MODE_C, CHAR_UPPER))
   {
     region.m_Color = g_Options.m_Type;
     return (region);
@@ -561,15 +1279,12 @@ static Region CWord(const Frame& f, u32 from)
   return (region);
 }
 
-static Region ShWord(const Frame& f, u32 from)
+static Region ShWord(BufferCursor c)
 {
-  i32 nLower  = 0;
-  u32 end     = from;
-  while (end < f.m_Buffer.m_Length && strchr(SH_WORD, f.m_Buffer.m_Data[end].m_Codepoint))
-  {
-    nLower += islower(f.m_Buffer.m_Data[end].m_Codepoint);
-    ++end;
-  }
+  BufferCursor  begin   = c;
+  u32           from    = c.m_Pos;
+  u32           nLower  = SkipWord(c, LANG_MODE_SH);
+  u32           end     = c.m_Pos;
   
   Region  region  =
   {
@@ -578,7 +1293,7 @@ static Region ShWord(const Frame& f, u32 from)
     .m_Color      = g_Options.m_Normal
   };
   
-  if (TryKeyword(region, f, from, end, LANG_MODE_SH))
+  if (TryKeyword(region, begin, end, LANG_MODE_SH))
   {
     return (region);
   }
@@ -592,13 +1307,12 @@ static Region ShWord(const Frame& f, u32 from)
   return (region);
 }
 
-static Region JSWord(const Frame& f, u32 from)
+static Region JSWord(BufferCursor c)
 {
-  u32 end = from;
-  while (end < f.m_Buffer.m_Length && strchr(JS_WORD, f.m_Buffer.m_Data[end].m_Codepoint))
-  {
-    ++end;
-  }
+  BufferCursor  begin = c;
+  u32           from  = c.m_Pos;
+  SkipWord(c, LANG_MODE_JS);
+  u32           end   = c.m_Pos;
   
   Region  region  =
   {
@@ -607,12 +1321,12 @@ static Region JSWord(const Frame& f, u32 from)
     .m_Color      = g_Options.m_Normal
   };
   
-  if (TryKeyword(region, f, from, end, LANG_MODE_JS))
+  if (TryKeyword(region, begin, end, LANG_MODE_JS))
   {
     return (region);
   }
   
-  if (isupper(f.m_Buffer.m_Data[from].m_Codepoint))
+  if (IsClass(begin, LANG_MODE_JS, CHAR_UPPER))
   {
     region.m_Color = g_Options.m_Emphasis;
     return (region);
@@ -621,15 +1335,12 @@ static Region JSWord(const Frame& f, u32 from)
   return (region);
 }
 
-static Region CCWord(const Frame& f, u32 from)
+static Region CCWord(BufferCursor c)
 {
-  i32 nLower  = 0;
-  u32 end     = from;
-  while (end < f.m_Buffer.m_Length && strchr(CC_WORD, f.m_Buffer.m_Data[end].m_Codepoint))
-  {
-    nLower += islower(f.m_Buffer.m_Data[end].m_Codepoint);
-    ++end;
-  }
+  BufferCursor  begin   = c;
+  u32           from    = c.m_Pos;
+  u32           nLower  = SkipWord(c, LANG_MODE_CC);
+  u32           end     = c.m_Pos;
   
   Region  region  =
   {
@@ -638,12 +1349,12 @@ static Region CCWord(const Frame& f, u32 from)
     .m_Color      = g_Options.m_Normal
   };
   
-  if (TryKeyword(region, f, from, end, LANG_MODE_CC))
+  if (TryKeyword(region, begin, end, LANG_MODE_CC))
   {
     return (region);
   }
   
-  if (end - from >= 2 && f.m_Buffer.m_Data[end - 1].m_Codepoint == 't' && f.m_Buffer.m_Data[end - 2].m_Codepoint == '_')
+  if (end - from >= 2 && c.m_Buffer->At(end - 1).m_Codepoint == 't' && c.m_Buffer->At(end - 2).m_Codepoint == '_')
   {
     region.m_Color = g_Options.m_Type;
     return (region);
@@ -655,35 +1366,34 @@ static Region CCWord(const Frame& f, u32 from)
     return (region);
   }
   
-  u32 next  = end;
-  while (next < f.m_Buffer.m_Length && f.m_Buffer.m_Data[next].IsSpace())
+  while (!c.AtEnd() && c.Get().IsSpace())
   {
-    ++next;
+    c.Next();
   }
   
   // very dumb way of diong checks for template parameters; only works for "well behaved" code, but honestly good enough
-  if (next < f.m_Buffer.m_Length && f.m_Buffer.m_Data[next].m_Codepoint == '<')
+  if (c.Codepoint() == '<')
   {
-    ++next;
-    for (u32 nOpen = 1; next < f.m_Buffer.m_Length && nOpen > 0; ++next)
+    c.Next();
+    for (u32 nOpen = 1; !c.AtEnd() && nOpen > 0; c.Next())
     {
-      nOpen += f.m_Buffer.m_Data[next].m_Codepoint == '<';
-      nOpen -= f.m_Buffer.m_Data[next].m_Codepoint == '>';
+      nOpen += c.Codepoint() == '<';
+      nOpen -= c.Codepoint() == '>';
     }
   }
   
-  while (next < f.m_Buffer.m_Length && f.m_Buffer.m_Data[next].IsSpace())
+  while (!c.AtEnd() && c.Get().IsSpace())
   {
-    ++next;
+    c.Next();
   }
   
-  if (next < f.m_Buffer.m_Length && f.m_Buffer.m_Data[next].m_Codepoint == '(')
+  if (c.Codepoint() == '(')
   {
     region.m_Color = g_Options.m_Emphasis;
     return (region);
   }
   
-  if (isupper(f.m_Buffer.m_Data[from].m_Codepoint))
+  if (IsClass(begin, LANG_MODE_CC, CHAR_UPPER))
   {
     region.m_Color = g_Options.m_Type;
     return (region);
@@ -692,15 +1402,12 @@ static Region CCWord(const Frame& f, u32 from)
   return (region);
 }
 
-static Region PyWord(const Frame& f, u32 from)
+static Region PyWord(BufferCursor c)
 {
-  i32 nLower  = 0;
-  u32 end     = from;
-  while (end < f.m_Buffer.m_Length && strchr(PY_WORD, f.m_Buffer.m_Data[end].m_Codepoint))
-  {
-    nLower += islower(f.m_Buffer.m_Data[end].m_Codepoint);
-    ++end;
-  }
+  BufferCursor  begin   = c;
+  u32           from    = c.m_Pos;
+  u32           nLower  = SkipWord(c, LANG_MODE_PY);
+  u32           end     = c.m_Pos;
   
   Region  region  =
   {
@@ -709,7 +1416,7 @@ static Region PyWord(const Frame& f, u32 from)
     .m_Color      = g_Options.m_Normal
   };
   
-  if (TryKeyword(region, f, from, end, LANG_MODE_PY))
+  if (TryKeyword(region, begin, end, LANG_MODE_PY))
   {
     return (region);
   }
@@ -720,19 +1427,18 @@ static Region PyWord(const Frame& f, u32 from)
     return (region);
   }
   
-  u32 next  = end;
-  while (next < f.m_Buffer.m_Length && f.m_Buffer.m_Data[next].IsSpace())
+  while (!c.AtEnd() && c.Get().IsSpace())
   {
-    ++next;
+    c.Next();
   }
   
-  if (next < f.m_Buffer.m_Length && f.m_Buffer.m_Data[next].m_Codepoint == '(')
+  if (c.Codepoint() == '(')
   {
     region.m_Color = g_Options.m_Emphasis;
     return (region);
   }
   
-  if (isupper(f.m_Buffer.m_Data[from].m_Codepoint))
+  if (IsClass(begin, LANG_MODE_PY, CHAR_UPPER))
   {
     region.m_Color = g_Options.m_Type;
     return (region);
@@ -14,3 +14,6 @@ struct Region
 };
 
 Region  FindHighlight(const Frame& frame, u32 from);
+void    RequestHighlight(const Frame& frame, u32 lb, u32 ub);
+Color   HighlightColor(const Frame& frame, u32 pos);
+i32     HighlightNotifier();
@@ -12,82 +12,71 @@ enum MacroMode : u8
   EXECUTING_MACRO
 };
 
-struct BindData
-{
-  const EChar*  m_Bind;
-  usize         m_Length;
-  void          (*m_Function)();
-};
-
 static int  CompareBinds(const void* lhs, const void* rhs);
+static void BuildKeymapNode(IN_OUT Keymap& keymap, u32 node, const KeymapBind* binds, usize nBinds, usize depth);
+static void EndMacro(bool failed);
 
-static BindData   g_Binds[FUNCTIONAL::MAX_BINDS];
-static usize      g_NBinds;
-static EChar      g_CurBind[FUNCTIONAL::MAX_BIND_LENGTH];
-static usize      g_CurBindLength;
-static MacroMode  g_MacroMode;
-static EString    g_Macro;
-static usize      g_CurMacroInstruction;
-
-void  Unbind()
-{
-  g_NBinds = 0;
-  g_CurBindLength = 0;
-}
+static const Keymap*  g_Keymap;
+static u32            g_CurNode;
+static usize          g_CurBindLength;
+static MacroMode      g_MacroMode;
+static EString        g_Macro;
+static usize          g_CurMacroInstruction;
+static u32            g_MacroRun;   // 0-based
+static u32            g_MacroRuns;
+static u64            g_MacroStart;
 
-i32 Bind(const EChar* bind, void (*function)())
+Keymap  CompileKeymap(const KeymapBind* binds, usize nBinds)
 {
-  if (g_NBinds >= FUNCTIONAL::MAX_BINDS)
-  {
-    Error("Input: Cannot register more than %u keybinds!", FUNCTIONAL::MAX_BINDS);
-    return (1);
-  }
-  
-  usize length  = 0;
-  while (bind[length].m_Codepoint)
-  {
-    ++length;
-  }
-  
-  for (usize i = 0; i < g_NBinds; ++i)
+  // every character of every bind adds at most one node
+  usize maxNodes  = 1;
+  for (usize i = 0; i < nBinds; ++i)
   {
-    if (g_Binds[i].m_Length == length && !memcmp(bind, g_Binds[i].m_Bind, sizeof(EChar) * length))
+    for (const EChar* ch = binds[i].m_Bind; ch->m_Codepoint; ++ch)
     {
-      g_Binds[i].m_Function = function;
-      return (0);
+      ++maxNodes;
     }
   }
   
-  g_Binds[g_NBinds].m_Bind      = bind;
-  g_Binds[g_NBinds].m_Length    = length;
-  g_Binds[g_NBinds].m_Function  = function;
-  ++g_NBinds;
+  KeymapBind* sorted  = (KeymapBind*)calloc(nBinds ? nBinds : 1, sizeof(KeymapBind));
+  memcpy(sorted, binds, sizeof(KeymapBind) * nBinds);
+  qsort(sorted, nBinds, sizeof(KeymapBind), CompareBinds);
+  
+  Keymap  keymap  =
+  {
+    .m_Nodes  = (KeymapNode*)calloc(maxNodes, sizeof(KeymapNode)),
+    .m_NNodes = 1
+  };
+  BuildKeymapNode(keymap, 0, sorted, nBinds, 0);
+  free(sorted);
   
-  return (0);
+  keymap.m_Nodes = (KeymapNode*)reallocarray(keymap.m_Nodes, keymap.m_NNodes, sizeof(KeymapNode));
+  return (keymap);
 }
 
-void  OrganizeInputs()
+void  UseKeymap(const Keymap* keymap)
 {
-  qsort(g_Binds, g_NBinds, sizeof(BindData), CompareBinds);
+  g_Keymap = keymap;
+  g_CurNode = 0;
 }
 
 EChar ReadRawKey()
 {
   if (g_MacroMode == EXECUTING_MACRO)
   {
-    // the +1 handles the last key of the macro, which would just infinitely repeat the macro if executed
-    if (g_CurMacroInstruction + 1 < g_Macro.m_Length)
+    if (g_CurMacroInstruction >= g_Macro.m_Length && ++g_MacroRun < g_MacroRuns)
     {
-      EChar ch  = g_Macro.m_Data[g_CurMacroInstruction++];
-      return (ch);
+      g_CurMacroInstruction = 0;
     }
-    else
+    
+    if (g_CurMacroInstruction < g_Macro.m_Length)
     {
-      g_MacroMode = NO_MACRO;
-      g_CurBindLength = 0;
-      EChar ch  = ReadEChar();
-      return (ch);
+      return (g_Macro.m_Data[g_CurMacroInstruction++]);
     }
+    
+    // a key which does nothing is given once the macro is done, so that the editor is rendered before waiting for input
+    EndMacro(false);
+    return (REPLACEMENT_CHAR);
   }
   
   EChar ch  = ReadEChar();
@@ -103,63 +92,83 @@ EChar ReadRawKey()
 EChar ReadKey()
 {
   EChar ch  = ReadRawKey();
-  if (!g_NBinds)
+  if (!g_Keymap)
   {
     return (ch);
   }
   
-  if (g_CurBindLength < FUNCTIONAL::MAX_BIND_LENGTH)
+  const KeymapNode& node      = g_Keymap->m_Nodes[g_CurNode];
+  const KeymapNode* children  = &g_Keymap->m_Nodes[node.m_Children];
+  u32               low       = 0;
+  u32               high      = node.m_NChildren;
+  while (low < high)
   {
-    g_CurBind[g_CurBindLength++] = ch;
+    u32 mid = (low + high) / 2;
+    if (children[mid].m_Codepoint < ch.m_Codepoint)
+    {
+      low = mid + 1;
+    }
+    else
+    {
+      high = mid;
+    }
   }
-  else
+  
+  if (low == node.m_NChildren || children[low].m_Codepoint != ch.m_Codepoint)
   {
+    g_CurNode = 0;
     g_CurBindLength = 0;
+    return (ch);
   }
   
-  isize low   = 0;
-  isize high  = g_NBinds - 1;
-  isize mid   {};
-  while (low <= high)
+  ++g_CurBindLength;
+  if (!children[low].m_Function)
   {
-    mid = (low + high) / 2;
-    
-    BindData  otherBind =
-    {
-      .m_Bind     = g_CurBind,
-      .m_Length   = g_CurBindLength,
-      .m_Function = nullptr
-    };
-    
-    switch (CompareBinds(&otherBind, &g_Binds[mid]))
-    {
-    case (-1):
-      high = mid - 1;
-      break;
-    case (0):
-      goto found;
-    case (1):
-      low = mid + 1;
-      break;
-    }
+    g_CurNode = node.m_Children + low;
+    return (REPLACEMENT_CHAR);
   }
   
-  mid = -1;
-found:
-  if (mid != -1)
+  // binds may read keys themselves, e.g. for prompts, so those start from the root
+  g_CurNode = 0;
+  children[low].m_Function();
+  g_CurBindLength = 0;
+  
+  return (REPLACEMENT_CHAR);
+}
+
+// reads the text of a bracketed paste up to the sequence ending it; terminals send line breaks as carriage returns, which
+// are turned back into newlines
+EString ReadPaste()
+{
+  EString paste       {};
+  usize   matched     = 0;  // leading characters of the end sequence read last
+  bool    afterReturn = false;
+  for (;;)
   {
-    const BindData* bind  = &g_Binds[mid];
-    if (bind->m_Length == g_CurBindLength)
+    EChar ch  = ReadRawKey();
+    if (ch.m_Codepoint == KEYBIND::BRACKETED_PASTE_END[matched].m_Codepoint)
     {
-      bind->m_Function();
-      g_CurBindLength = 0;
+      if (!KEYBIND::BRACKETED_PASTE_END[++matched].m_Codepoint)
+      {
+        return (paste);
+      }
+      continue;
     }
     
-    return (REPLACEMENT_CHAR);
+    // the end sequence only starts with an escape, so a partial match is text up to the current character
+    paste.Insert(KEYBIND::BRACKETED_PASTE_END, matched, paste.m_Length);
+    matched = ch.m_Codepoint == KEYBIND::BRACKETED_PASTE_END[0].m_Codepoint;
+    if (matched)
+    {
+      continue;
+    }
+    
+    if (ch.m_Codepoint != '\n' || !afterReturn)
+    {
+      paste.Insert(ch.m_Codepoint == '\r' ? EChar{'\n'} : ch, paste.m_Length);
+    }
+    afterReturn = ch.m_Codepoint == '\r';
   }
-  
-  g_CurBindLength = 0;
-  return (ch);
 }
 
 void  RecordMacro()
@@ -168,9 +177,11 @@ void  RecordMacro()
   g_MacroMode = RECORDING_MACRO;
 }
 
+// recording is stopped by a bind, which isn't part of the macro
 void  StopRecordingMacro()
 {
   g_MacroMode = NO_MACRO;
+  g_Macro.Erase(g_Macro.m_Length - g_CurBindLength, g_Macro.m_Length);
 }
 
 bool  IsRecordingMacro()
@@ -178,28 +189,111 @@ bool  IsRecordingMacro()
   return (g_MacroMode == RECORDING_MACRO);
 }
 
-void  ExecuteMacro()
+bool  IsExecutingMacro()
+{
+  return (g_MacroMode == EXECUTING_MACRO);
+}
+
+void  ExecuteMacro(u32 runs)
 {
+  if (!g_Macro.m_Length || !runs)
+  {
+    Info("Input: Nothing to execute");
+    return;
+  }
+  
   g_MacroMode = EXECUTING_MACRO;
   g_CurMacroInstruction = 0;
+  g_MacroRun = 0;
+  g_MacroRuns = runs;
+  g_MacroStart = MonotonicTime();
+}
+
+// stops a macro partway, when something it does can't be done
+void  FailMacro()
+{
+  if (g_MacroMode == EXECUTING_MACRO)
+  {
+    EndMacro(true);
+  }
+}
+
+static void EndMacro(bool failed)
+{
+  g_MacroMode = NO_MACRO;
+  g_CurBindLength = 0;
+  
+  f64 elapsed = (MonotonicTime() - g_MacroStart) / 1e9;
+  if (failed)
+  {
+    Info("Input: Macro stopped on run %u of %u after %.3fs", g_MacroRun + 1, g_MacroRuns, elapsed);
+  }
+  else if (g_MacroRuns == 1)
+  {
+    Info("Input: Executed macro in %.3fs", elapsed);
+  }
+  else
+  {
+    Info("Input: Executed macro %u times in %.3fs", g_MacroRuns, elapsed);
+  }
 }
 
 static int  CompareBinds(const void* lhs, const void* rhs)
 {
-  const BindData* lhsBind = (BindData*)lhs;
-  const BindData* rhsBind = (BindData*)rhs;
+  const EChar*  lhsBind = ((KeymapBind*)lhs)->m_Bind;
+  const EChar*  rhsBind = ((KeymapBind*)rhs)->m_Bind;
   
-  for (usize i = 0; i < lhsBind->m_Length && i < rhsBind->m_Length; ++i)
+  for (usize i = 0;; ++i)
   {
-    if (lhsBind->m_Bind[i].m_Codepoint > rhsBind->m_Bind[i].m_Codepoint)
+    if (lhsBind[i].m_Codepoint > rhsBind[i].m_Codepoint)
     {
       return (1);
     }
-    else if (lhsBind->m_Bind[i].m_Codepoint < rhsBind->m_Bind[i].m_Codepoint)
+    else if (lhsBind[i].m_Codepoint < rhsBind[i].m_Codepoint)
     {
       return (-1);
     }
+    else if (!lhsBind[i].m_Codepoint)
+    {
+      return (0);
+    }
   }
+}
+
+// adds the children of a node from the sorted binds starting with its prefix of depth characters; the children of a node
+// are all added before any of their own children, so that they are contiguous
+static void BuildKeymapNode(IN_OUT Keymap& keymap, u32 node, const KeymapBind* binds, usize nBinds, usize depth)
+{
+  // a bind ending at a node sorts before those going through it, and shadows them
+  usize first = 0;
+  while (first < nBinds && !binds[first].m_Bind[depth].m_Codepoint)
+  {
+    keymap.m_Nodes[node].m_Function = binds[first].m_Function;
+    ++first;
+  }
+  
+  u32 children    = keymap.m_NNodes;
+  for (usize i = first; i < nBinds; ++i)
+  {
+    u32 codepoint = binds[i].m_Bind[depth].m_Codepoint;
+    if (i == first || codepoint != binds[i - 1].m_Bind[depth].m_Codepoint)
+    {
+      keymap.m_Nodes[keymap.m_NNodes++].m_Codepoint = codepoint;
+    }
+  }
+  u32 childrenEnd = keymap.m_NNodes;
+  keymap.m_Nodes[node].m_Children = children;
+  keymap.m_Nodes[node].m_NChildren = childrenEnd - children;
   
-  return (0);
+  for (u32 child = children; child < childrenEnd; ++child)
+  {
+    usize last  = first;
+    while (last < nBinds && binds[last].m_Bind[depth].m_Codepoint == keymap.m_Nodes[child].m_Codepoint)
+    {
+      ++last;
+    }
+    
+    BuildKeymapNode(keymap, child, binds + first, last - first, depth + 1);
+    first = last;
+  }
 }
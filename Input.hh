@@ -5,12 +5,36 @@
 #include <Encoding.hh>
 #include <Util.hh>
 
-void  Unbind();
-i32   Bind(const EChar* bind, void (*function)());
-void  OrganizeInputs();
-EChar ReadRawKey();
-EChar ReadKey();
-void  RecordMacro();
-void  StopRecordingMacro();
-bool  IsRecordingMacro();
-void  ExecuteMacro();
+struct KeymapBind
+{
+  const EChar*  m_Bind;
+  void          (*m_Function)();
+};
+
+struct KeymapNode
+{
+  u32   m_Codepoint;
+  u32   m_Children;   // index of first child
+  u32   m_NChildren;
+  void  (*m_Function)();
+};
+
+// trie of the binds of a mode, compiled once and never modified; the root is the first node, and the children of a node
+// are contiguous and sorted by codepoint
+struct Keymap
+{
+  KeymapNode* m_Nodes;
+  u32         m_NNodes;
+};
+
+Keymap  CompileKeymap(const KeymapBind* binds, usize nBinds);
+void    UseKeymap(const Keymap* keymap);
+EChar   ReadRawKey();
+EChar   ReadKey();
+EString ReadPaste();
+void    RecordMacro();
+void    StopRecordingMacro();
+bool    IsRecordingMacro();
+bool    IsExecutingMacro();
+void    ExecuteMacro(u32 runs);
+void    FailMacro();
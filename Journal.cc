@@ -0,0 +1,699 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include <cerrno>
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <Journal.hh>
+#include <Options.hh>
+
+extern "C"
+{
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+}
+
+constexpr u64 JOURNAL_MAGIC         = 0x324a44454d504d4e; // "NMPMEDJ2"
+constexpr u64 JOURNAL_RECORD_MAGIC  = 0x44524f434552554e; // "NURECORD"
+constexpr u32 JOURNAL_MAX_RECORDS   = 1024;               // how far back a matching record is looked for
+
+// a journal starts with JOURNAL_MAGIC, followed by one record per save; every record holds the history of its frame at
+// the time, as the leading entries of the previous record of the same frame followed by entries of its own, and is
+// followed by its own offset, so that the newest record can be found from the end of the journal
+struct JournalRecord
+{
+  u64 m_Magic;
+  u64 m_Previous;   // offset of the previous record, or 0
+  u64 m_Hash;       // of the file content after the save
+  u64 m_Size;       // bytes of entries following the record
+  u32 m_Keep;       // leading entries kept from the previous record
+  u32 m_NEntries;   // entries following the record
+  u32 m_CurHistory;
+  u32 m_Reserved;
+};
+
+// followed by the UTF-8 text of the entry, front to back
+struct JournalEntry
+{
+  u32 m_LowerBound;
+  u32 m_UpperBound;
+  u32 m_Parent;
+  u32 m_Size;
+  u32 m_Type;
+};
+
+// hashes 8 bytes at a time, carrying leftover bytes between updates so that the hash doesn't depend on how the
+// content is split
+struct JournalHash
+{
+  u64 m_Hash;
+  u64 m_Word;
+  u32 m_NBytes;
+  u64 m_Length;
+  
+  void  Update(const u8* data, u64 size);
+  u64   Finish();
+  void  Mix(u64 word);
+};
+
+static i32  JournalPath(const Frame& frame, OUT char path[]);
+static i32  LockJournal(const char* path);
+static u64  HashBuffer(const Buffer& buffer);
+static void AppendJournal(IN_OUT u8*& data, IN_OUT u64& size, IN_OUT u64& capacity, const void* src, u64 n);
+static bool ValidText(const u8* text, u32 size, u32 length);
+static bool ValidReplacement(const u8* text, u32 size, u32 lb, u32 ub, OUT i64& growth);
+
+void  LoadJournal(Frame& frame)
+{
+  char  path[PATH_MAX]  {};
+  if (JournalPath(frame, path))
+  {
+    return;
+  }
+  
+  i32 fd  = open(path, O_RDONLY);
+  if (fd == -1)
+  {
+    return;
+  }
+  
+  struct stat journalStat {};
+  if (fstat(fd, &journalStat) || (u64)journalStat.st_size < sizeof(u64) + sizeof(JournalRecord) + sizeof(u64))
+  {
+    close(fd);
+    return;
+  }
+  
+  // only the records and entries which are needed get paged in
+  u64 size  = journalStat.st_size;
+  u8* data  = (u8*)mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED || *(const u64*)data != JOURNAL_MAGIC)
+  {
+    if (data != MAP_FAILED)
+    {
+      munmap(data, size);
+    }
+    return;
+  }
+  
+  auto  validRecord = [&](u64 offset)
+  {
+    if (offset < sizeof(u64) || offset > size - sizeof(JournalRecord) - sizeof(u64) || offset % sizeof(u64))
+    {
+      return (false);
+    }
+    
+    // records only ever refer back, so following them always ends
+    const JournalRecord*  record  = (const JournalRecord*)&data[offset];
+    return (record->m_Magic == JOURNAL_RECORD_MAGIC
+            && record->m_Previous < offset
+            && record->m_Size <= size - offset - sizeof(JournalRecord) - sizeof(u64)
+            && record->m_Keep + record->m_NEntries >= record->m_Keep
+            && record->m_CurHistory <= record->m_Keep + record->m_NEntries);
+  };
+  
+  // find the newest record of the file's current content
+  u64 hash    = HashBuffer(frame.m_Buffer);
+  u64 offset  = *(const u64*)&data[size - sizeof(u64)];
+  for (u32 i = 0; i < JOURNAL_MAX_RECORDS && validRecord(offset); ++i)
+  {
+    const JournalRecord*  record  = (const JournalRecord*)&data[offset];
+    if (record->m_Hash == hash)
+    {
+      break;
+    }
+    offset = record->m_Previous;
+  }
+  
+  if (!validRecord(offset) || ((const JournalRecord*)&data[offset])->m_Hash != hash)
+  {
+    munmap(data, size);
+    return;
+  }
+  
+  // every entry takes up room in a record no further than the end of the one found, which bounds how many there can be
+  // before anything is allocated for them
+  const JournalRecord*  found   = (const JournalRecord*)&data[offset];
+  u32                   count   = found->m_Keep + found->m_NEntries;
+  if (count > (offset + sizeof(JournalRecord) + found->m_Size) / sizeof(JournalEntry))
+  {
+    munmap(data, size);
+    return;
+  }
+  
+  History*  history = (History*)calloc(count ? count : 1, sizeof(History));
+  i64*      growth  = (i64*)calloc(count ? count : 1, sizeof(i64));
+  i64*      lengths = (i64*)calloc((u64)count + 1, sizeof(i64));
+  if (!history || !growth || !lengths)
+  {
+    free(history);
+    free(growth);
+    free(lengths);
+    munmap(data, size);
+    return;
+  }
+  
+  // walk back through the records that the history is made up of, taking each one's own entries
+  for (u64 at = offset, remaining = count; remaining;)
+  {
+    if (!validRecord(at))
+    {
+      free(history);
+      free(growth);
+      free(lengths);
+      munmap(data, size);
+      return;
+    }
+    
+    const JournalRecord*  record  = (const JournalRecord*)&data[at];
+    u32                   keep    = record->m_Keep < remaining ? record->m_Keep : remaining;
+    u64                   entry   = at + sizeof(JournalRecord);
+    u64                   end     = entry + record->m_Size;
+    for (u32 i = keep; i < remaining; ++i)
+    {
+      // the text of an entry has to hold exactly what undoing and redoing it reads
+      const JournalEntry* journalEntry  = (const JournalEntry*)&data[entry];
+      const u8*           text          = &data[entry + sizeof(JournalEntry)];
+      if (i - keep >= record->m_NEntries
+          || entry + sizeof(JournalEntry) > end
+          || journalEntry->m_Size > end - entry - sizeof(JournalEntry)
+          || journalEntry->m_LowerBound > journalEntry->m_UpperBound
+          || journalEntry->m_Parent > i
+          || journalEntry->m_Type > HISTORY_REPLACE
+          || ((journalEntry->m_Type == HISTORY_WRITE || journalEntry->m_Type == HISTORY_ERASE)
+              && !ValidText(text, journalEntry->m_Size, journalEntry->m_UpperBound - journalEntry->m_LowerBound))
+          || (journalEntry->m_Type == HISTORY_REPLACE
+              && !ValidReplacement(text, journalEntry->m_Size, journalEntry->m_LowerBound, journalEntry->m_UpperBound,
+                                   growth[i])))
+      {
+        free(history);
+        free(growth);
+        free(lengths);
+        munmap(data, size);
+        return;
+      }
+      
+      u32 length  = journalEntry->m_UpperBound - journalEntry->m_LowerBound;
+      growth[i] = journalEntry->m_Type == HISTORY_WRITE ? length
+                  : journalEntry->m_Type == HISTORY_ERASE ? -(i64)length : growth[i];
+      
+      history[i] = History
+      {
+        .m_Offset     = entry + sizeof(JournalEntry),
+        .m_LowerBound = journalEntry->m_LowerBound,
+        .m_UpperBound = journalEntry->m_UpperBound,
+        .m_Parent     = journalEntry->m_Parent,
+        .m_Redo       = 0,
+        .m_Depth      = 0,
+        .m_Type       = (HistoryType)journalEntry->m_Type,
+        .m_Journaled  = true
+      };
+      entry += sizeof(JournalEntry) + (journalEntry->m_Size + sizeof(u32) - 1) / sizeof(u32) * sizeof(u32);
+    }
+    
+    remaining = keep;
+    at = record->m_Previous;
+  }
+  
+  // every entry has to fit the text it was made on top of, whose length is worked out back from the current text
+  bool  valid = found->m_CurHistory <= count;
+  lengths[0] = frame.m_Buffer.m_Length;
+  for (u32 node = valid ? found->m_CurHistory : 0; node; node = history[node - 1].m_Parent)
+  {
+    lengths[0] -= growth[node - 1];
+  }
+  
+  for (u32 i = 0; i < count && valid; ++i)
+  {
+    i64 before  = lengths[history[i].m_Parent];
+    i64 bound   = history[i].m_Type == HISTORY_WRITE ? history[i].m_LowerBound : history[i].m_UpperBound;
+    lengths[i + 1] = before + growth[i];
+    valid = before >= 0 && (history[i].m_Type == HISTORY_BREAK || bound <= before)
+            && lengths[i + 1] >= 0 && lengths[i + 1] <= UINT32_MAX;
+  }
+  free(lengths);
+  free(growth);
+  
+  if (!valid)
+  {
+    free(history);
+    munmap(data, size);
+    return;
+  }
+  
+  free(frame.m_History);
+  frame.m_History = history;
+  frame.m_HistoryLength = count;
+  frame.m_HistoryCapacity = count ? count : 1;
+  frame.m_CurHistory = found->m_CurHistory;
+  frame.m_RootRedo = 0;
+  
+  // the tree links aren't journaled; redoing follows the newest child, except on the way to the current entry
+  for (u32 i = 0; i < count; ++i)
+  {
+    u32 parent  = history[i].m_Parent;
+    history[i].m_Depth = parent ? history[parent - 1].m_Depth + 1 : 1;
+    (parent ? history[parent - 1].m_Redo : frame.m_RootRedo) = i + 1;
+  }
+  
+  for (u32 node = frame.m_CurHistory; node; node = history[node - 1].m_Parent)
+  {
+    u32 parent  = history[node - 1].m_Parent;
+    (parent ? history[parent - 1].m_Redo : frame.m_RootRedo) = node;
+  }
+  frame.m_Journal = data;
+  frame.m_JournalSize = size;
+  frame.m_JournalRecord = offset;
+  frame.m_JournalSynced = count;
+}
+
+// appends the history entries which the last record of the frame doesn't hold yet; failing to do so only loses history,
+// so it isn't treated as a failure to save
+void  SaveJournal(Frame& frame)
+{
+  char  path[PATH_MAX]  {};
+  if (JournalPath(frame, path) || RecursiveCreateDir(path))
+  {
+    Error("Journal: Failed to create undo journal directory for %s!", frame.m_Source);
+    return;
+  }
+  
+  // the lock is held until the record is written, so that sessions saving the same file append one after another
+  i32 fd  = LockJournal(path);
+  if (fd == -1)
+  {
+    Error("Journal: Failed to open undo journal: %s!", path);
+    return;
+  }
+  
+  struct stat journalStat {};
+  u64         magic       = 0;
+  if (fstat(fd, &journalStat)
+      || journalStat.st_size < (off_t)sizeof(u64)
+      || pread(fd, &magic, sizeof(magic), 0) != sizeof(magic)
+      || magic != JOURNAL_MAGIC)
+  {
+    // anything which isn't a journal is started over in a new file put in its place, since the old one may still be
+    // mapped with journaled entries pointing into it
+    char  newPath[PATH_MAX + 8] {};
+    snprintf(newPath, sizeof(newPath), "%s.new", path);
+    
+    // the new file is locked before it's put in place, and the old one only unlocked after
+    magic = JOURNAL_MAGIC;
+    i32 newFd = open(newPath, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (newFd == -1
+        || flock(newFd, LOCK_EX)
+        || pwrite(newFd, &magic, sizeof(magic), 0) != sizeof(magic)
+        || rename(newPath, path))
+    {
+      Error("Journal: Failed to write undo journal: %s!", path);
+      if (newFd != -1)
+      {
+        close(newFd);
+        unlink(newPath);
+      }
+      close(fd);
+      return;
+    }
+    close(fd);
+    fd = newFd;
+    journalStat.st_size = sizeof(u64);
+    frame.m_JournalRecord = 0;
+  }
+  
+  if (frame.m_JournalRecord >= (u64)journalStat.st_size)
+  {
+    frame.m_JournalRecord = 0;
+  }
+  
+  u32 keep  = frame.m_JournalRecord ? frame.m_JournalSynced : 0;
+  if (keep > frame.m_HistoryLength)
+  {
+    keep = frame.m_HistoryLength;
+  }
+  
+  u64 capacity    = 4096;
+  u64 recordSize  = 0;
+  u8* record      = (u8*)malloc(capacity);
+  
+  JournalRecord header  =
+  {
+    .m_Magic      = JOURNAL_RECORD_MAGIC,
+    .m_Previous   = frame.m_JournalRecord,
+    .m_Hash       = HashBuffer(frame.m_Buffer),
+    .m_Size       = 0,
+    .m_Keep       = keep,
+    .m_NEntries   = frame.m_HistoryLength - keep,
+    .m_CurHistory = frame.m_CurHistory,
+    .m_Reserved   = 0
+  };
+  AppendJournal(record, recordSize, capacity, &header, sizeof(header));
+  
+  EChar*  text          = nullptr;
+  u32     textCapacity  = 0;
+  for (u32 i = keep; i < frame.m_HistoryLength; ++i)
+  {
+    const History&  history = frame.m_History[i];
+    if (LoadHistory(frame, history))
+    {
+      Error("Journal: Failed to read history for undo journal: %s!", path);
+      if (text)
+      {
+        free(text);
+      }
+      free(record);
+      close(fd);
+      return;
+    }
+    
+    u32           length  = HistoryLength(frame, history);
+    JournalEntry  entry   =
+    {
+      .m_LowerBound = history.m_LowerBound,
+      .m_UpperBound = history.m_UpperBound,
+      .m_Parent     = history.m_Parent,
+      .m_Size       = 0,
+      .m_Type       = history.m_Type
+    };
+    
+    u64 entryOffset = recordSize;
+    AppendJournal(record, recordSize, capacity, &entry, sizeof(entry));
+    
+    if (history.m_Type == HISTORY_BREAK)
+    {
+      continue;
+    }
+    
+    if (history.m_Journaled)
+    {
+      const JournalEntry* journalEntry  = (const JournalEntry*)&frame.m_Journal[history.m_Offset - sizeof(JournalEntry)];
+      entry.m_Size = journalEntry->m_Size;
+      AppendJournal(record, recordSize, capacity, &frame.m_Journal[history.m_Offset], entry.m_Size);
+    }
+    else
+    {
+      if (length > textCapacity)
+      {
+        textCapacity = length;
+        text = (EChar*)reallocarray(text, textCapacity, sizeof(EChar));
+      }
+      frame.m_HistoryLog.Read(text, history.m_Offset, length);
+      
+      // the log holds erased text back to front, and replacements in order
+      for (u32 j = 0; j < length; ++j)
+      {
+        const EChar&  ch  = history.m_Type == HISTORY_ERASE ? text[length - j - 1] : text[j];
+        usize         n   = UTF8Length(ch.m_Encoding[0]);
+        AppendJournal(record, recordSize, capacity, ch.m_Encoding, n);
+        entry.m_Size += n;
+      }
+    }
+    
+    // entries are kept aligned so that they can be read from the mapped journal in place
+    u32 padding = 0;
+    AppendJournal(record, recordSize, capacity, &padding, (sizeof(u32) - entry.m_Size % sizeof(u32)) % sizeof(u32));
+    memcpy(&record[entryOffset], &entry, sizeof(entry));
+  }
+  
+  if (text)
+  {
+    free(text);
+  }
+  
+  u64 padding = 0;
+  AppendJournal(record, recordSize, capacity, &padding, (sizeof(u64) - recordSize % sizeof(u64)) % sizeof(u64));
+  ((JournalRecord*)record)->m_Size = recordSize - sizeof(JournalRecord);
+  
+  u64 offset  = journalStat.st_size + (sizeof(u64) - journalStat.st_size % sizeof(u64)) % sizeof(u64);
+  AppendJournal(record, recordSize, capacity, &offset, sizeof(offset));
+  
+  if (pwrite(fd, record, recordSize, offset) != (isize)recordSize)
+  {
+    Error("Journal: Failed to write undo journal: %s!", path);
+  }
+  else
+  {
+    frame.m_JournalRecord = offset;
+    frame.m_JournalSynced = frame.m_HistoryLength;
+  }
+  
+  free(record);
+  close(fd);
+}
+
+void  FreeJournal(Frame& frame)
+{
+  if (frame.m_Journal)
+  {
+    munmap(frame.m_Journal, frame.m_JournalSize);
+  }
+  
+  frame.m_Journal = nullptr;
+  frame.m_JournalSize = 0;
+}
+
+void  JournalHash::Update(const u8* data, u64 size)
+{
+  m_Length += size;
+  
+  while (size && m_NBytes)
+  {
+    m_Word |= (u64)*data++ << 8 * m_NBytes;
+    --size;
+    if (++m_NBytes == sizeof(u64))
+    {
+      Mix(m_Word);
+      m_Word = 0;
+      m_NBytes = 0;
+    }
+  }
+  
+  for (; size >= sizeof(u64); data += sizeof(u64), size -= sizeof(u64))
+  {
+    u64 word  {};
+    memcpy(&word, data, sizeof(word));
+    Mix(word);
+  }
+  
+  for (; size; --size)
+  {
+    m_Word |= (u64)*data++ << 8 * m_NBytes++;
+  }
+}
+
+u64 JournalHash::Finish()
+{
+  Mix(m_Word);
+  Mix(m_Length);
+  return (m_Hash);
+}
+
+void  JournalHash::Mix(u64 word)
+{
+  m_Hash ^= word;
+  m_Hash = (m_Hash << 31 | m_Hash >> 33) * 0x9e3779b97f4a7c15;
+}
+
+// journals are named after the identity of their file, and only apply to content matching the hash in their records
+static i32  JournalPath(const Frame& frame, OUT char path[])
+{
+  if (!frame.m_Source)
+  {
+    return (1);
+  }
+  
+  u64 id  = FileID(frame.m_Source, true);
+  if (!id)
+  {
+    return (1);
+  }
+  
+  char  name[64]  {};
+  snprintf(name, sizeof(name), "%s/%016llx", FUNCTIONAL::UNDO_DIR, (unsigned long long)id);
+  return (ConfigPath(path, name));
+}
+
+// opens the journal and locks it, opening it again if another session put a new journal in its place while waiting
+static i32  LockJournal(const char* path)
+{
+  for (;;)
+  {
+    i32 fd  = open(path, O_RDWR | O_CREAT, 0644);
+    if (fd == -1)
+    {
+      return (-1);
+    }
+    
+    struct stat locked  {};
+    struct stat current {};
+    while (flock(fd, LOCK_EX))
+    {
+      if (errno != EINTR)
+      {
+        close(fd);
+        return (-1);
+      }
+    }
+    
+    if (fstat(fd, &locked))
+    {
+      close(fd);
+      return (-1);
+    }
+    
+    if (!stat(path, &current) && current.st_dev == locked.st_dev && current.st_ino == locked.st_ino)
+    {
+      return (fd);
+    }
+    close(fd);
+  }
+}
+
+static u64  HashBuffer(const Buffer& buffer)
+{
+  JournalHash hash  {};
+  for (u32 i = 0; i < buffer.m_NPieces; ++i)
+  {
+    const Piece&  piece = buffer.m_Pieces[i];
+    hash.Update(&buffer.SourceOf(piece).m_Data[piece.m_Byte], piece.m_Size);
+  }
+  
+  return (hash.Finish());
+}
+
+static void AppendJournal(IN_OUT u8*& data, IN_OUT u64& size, IN_OUT u64& capacity, const void* src, u64 n)
+{
+  if (size + n > capacity)
+  {
+    while (size + n > capacity)
+    {
+      capacity *= 2;
+    }
+    data = (u8*)realloc(data, capacity);
+  }
+  
+  memcpy(&data[size], src, n);
+  size += n;
+}
+
+// whether the text of an entry is made of exactly length well-formed characters
+static bool ValidText(const u8* text, u32 size, u32 length)
+{
+  u32 at  = 0;
+  for (u32 i = 0; i < length; ++i)
+  {
+    usize n = at < size ? ValidUTF8Length(&text[at], size - at) : 0;
+    if (!n)
+    {
+      return (false);
+    }
+    at += n;
+  }
+  
+  return (at == size);
+}
+
+// whether the text of a replacement, laid out as described at Frame::Replace(), fits within its entry, with ranges
+// going from its lower to its upper bound; also gives by how much the replacement grows the text
+static bool ValidReplacement(const u8* text, u32 size, u32 lb, u32 ub, OUT i64& growth)
+{
+  u32 at          = 0;
+  u32 characters  = 0;
+  
+  // the replaced and replacing text has to be well-formed, like that of other entries
+  auto  skip    = [&](u32 length)
+  {
+    for (u32 i = 0; i < length; ++i)
+    {
+      usize n = at < size ? ValidUTF8Length(&text[at], size - at) : 0;
+      if (!n)
+      {
+        return (false);
+      }
+      at += n;
+      ++characters;
+    }
+    
+    return (true);
+  };
+  
+  // digits can take any 16-bit value, surrogates included, so they are decoded here with the same checks otherwise
+  auto  digit   = [&](OUT u32& value)
+  {
+    u8  lead  = at < size ? text[at] : 0xff;
+    u32 n     = lead < 0x80 ? 1 : (lead & 0xe0) == 0xc0 ? 2 : (lead & 0xf0) == 0xe0 ? 3 : 0;
+    if (!n || n > size - at)
+    {
+      return (false);
+    }
+    
+    value = n == 1 ? lead : n == 2 ? lead & 0x1f : lead & 0xf;
+    for (u32 i = 1; i < n; ++i)
+    {
+      if ((text[at + i] & 0xc0) != 0x80)
+      {
+        return (false);
+      }
+      value = value << 6 | (text[at + i] & 0x3f);
+    }
+    
+    if (value < (n == 1 ? 0 : n == 2 ? 0x80 : 0x800))
+    {
+      return (false);
+    }
+    at += n;
+    ++characters;
+    return (true);
+  };
+  
+  auto  number  = [&](OUT u32& value)
+  {
+    value = 0;
+    for (u32 i = 0; i < 3; ++i)
+    {
+      u32 ch;
+      if (!digit(ch))
+      {
+        return (false);
+      }
+      
+      value = value << 15 | (ch & 0x7fff);
+      if (!(ch & 0x8000))
+      {
+        return (true);
+      }
+    }
+    
+    return (false);
+  };
+  
+  u32 length;
+  u32 strLength;
+  u32 count;
+  u32 gaps;
+  if (!number(length) || !number(strLength) || !number(count) || !number(gaps) || !count
+      || !skip(length) || !skip(strLength))
+  {
+    return (false);
+  }
+  
+  // the gaps have to take as many characters as the header says, since saving trusts it
+  u32 from  = characters;
+  u64 end   = lb;
+  for (u32 i = 0; i < count; ++i)
+  {
+    u32 gap;
+    if (!number(gap) || (i == 0 && gap) || end + gap + length > ub)
+    {
+      return (false);
+    }
+    end += gap + length;
+  }
+  
+  growth = (i64)count * ((i64)strLength - length);
+  return (characters - from == gaps && end == ub);
+}
@@ -0,0 +1,10 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#pragma once
+
+#include <Frame.hh>
+#include <Util.hh>
+
+void  LoadJournal(Frame& frame);
+void  SaveJournal(Frame& frame);
+void  FreeJournal(Frame& frame);
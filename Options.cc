@@ -24,6 +24,7 @@ static i32    GetColor(const char* path, FILE* file, const char* key, OUT u8& va
 static i32    GetColorPair(const char* path, FILE* file, const char* key, OUT Color& value);
 static i32    GetBool(const char* path, FILE* file, const char* key, OUT bool& value);
 static void   ReadLangConfig(FILE* file, const char* keywordKey, const char* primitiveKey, LangMode langMode);
+static void   InsertLangWord(LangMode langMode, const EString& word, bool primitive);
 
 i32 ParseOptions()
 {
@@ -58,8 +59,16 @@ i32 ParseOptions()
     g_Options.m_Margins[g_Options.m_NMargins - 1] = margin;
   }
   
+  // rendering options
+  if (getEditorU32("MaxFrameRate", g_Options.m_MaxFrameRate))
+  {
+    fclose(file);
+    return (1);
+  }
+  
   // editing options
-  if (GetBool(FUNCTIONAL::EDITOR_CONF, file, "TabSpaces", g_Options.m_TabSpaces))
+  if (GetBool(FUNCTIONAL::EDITOR_CONF, file, "TabSpaces", g_Options.m_TabSpaces)
+    || getEditorU32("HistoryMemory", g_Options.m_HistoryMemory))
   {
     fclose(file);
     return (1);
@@ -95,6 +104,7 @@ i32 ParseOptions()
     || getColorColorPair("Margin", g_Options.m_Margin)
     || getColorColorPair("Cursor", g_Options.m_Cursor)
     || getColorColor("CursorHighlightBG", g_Options.m_CursorHighlightBG)
+    || getColorColorPair("SearchMatch", g_Options.m_SearchMatch)
     || getColorColorPair("Comment", g_Options.m_Comment)
     || getColorColorPair("Macro", g_Options.m_Macro)
     || getColorColorPair("Special", g_Options.m_Special)
@@ -127,32 +137,22 @@ i32 ParseOptions()
   return (0);
 }
 
-i32 ValidateOptions()
-{
-  if (g_Options.m_TabSpaces < 1)
-  {
-    Error("Options: Invalid value for TabSpaces: %lld!", g_Options.m_TabSpaces);
-    return (1);
-  }
-  
-  return (0);
-}
-
-static FILE*  OpenConfig(const char* configPath)
+// path must hold PATH_MAX bytes
+i32 ConfigPath(OUT char path[], const char* configPath)
 {
-  char  path[PATH_MAX]  {};
+  path[0] = 0;
   
   if (g_Args.m_ConfigDir)
   {
-    strncpy(path, g_Args.m_ConfigDir, sizeof(path) - 1);
+    strncpy(path, g_Args.m_ConfigDir, PATH_MAX - 1);
     
     usize length  = strlen(path);
     if (length && path[length - 1] != '/')
     {
-      AppendCString(path, sizeof(path), "/");
+      AppendCString(path, PATH_MAX, "/");
     }
     
-    AppendCString(path, sizeof(path), configPath);
+    AppendCString(path, PATH_MAX, configPath);
   }
   else
   {
@@ -163,13 +163,35 @@ static FILE*  OpenConfig(const char* configPath)
       if (!userPasswd)
       {
         Error("Options: Failed on getpwuid() getting home directory!");
-        return (nullptr);
+        return (1);
       }
       
       home = userPasswd->pw_dir;
     }
     
-    snprintf(path, sizeof(path), "%s/%s/%s", home, FUNCTIONAL::CONFIG_DIR, configPath);
+    snprintf(path, PATH_MAX, "%s/%s/%s", home, FUNCTIONAL::CONFIG_DIR, configPath);
+  }
+  
+  return (0);
+}
+
+i32 ValidateOptions()
+{
+  if (g_Options.m_TabSpaces < 1)
+  {
+    Error("Options: Invalid value for TabSpaces: %lld!", g_Options.m_TabSpaces);
+    return (1);
+  }
+  
+  return (0);
+}
+
+static FILE*  OpenConfig(const char* configPath)
+{
+  char  path[PATH_MAX]  {};
+  if (ConfigPath(path, configPath))
+  {
+    return (nullptr);
   }
   
   FILE* file  = fopen(path, "rb");
@@ -480,4 +502,63 @@ static void ReadLangConfig(FILE* file, const char* keywordKey, const char* primi
     *primitives = (EString*)reallocarray(*primitives, *nPrimitives, sizeof(EString));
     (*primitives)[*nPrimitives - 1] = value;
   }
+  
+  // the table is kept at most half full so that probe sequences stay short
+  auto& lang    = g_Options.m_Lang[langMode];
+  u32   nSlots  = 1;
+  while (nSlots < 2 * (lang.m_NKeywords + lang.m_NPrimitives))
+  {
+    nSlots *= 2;
+  }
+  
+  lang.m_Words = (LangWord*)calloc(nSlots, sizeof(LangWord));
+  lang.m_WordMask = nSlots - 1;
+  
+  // keywords are inserted first so that they win over primitives of the same name
+  for (usize i = 0; i < lang.m_NKeywords; ++i)
+  {
+    InsertLangWord(langMode, lang.m_Keywords[i], false);
+  }
+  
+  for (usize i = 0; i < lang.m_NPrimitives; ++i)
+  {
+    InsertLangWord(langMode, lang.m_Primitives[i], true);
+  }
+}
+
+static void InsertLangWord(LangMode langMode, const EString& word, bool primitive)
+{
+  auto& lang  = g_Options.m_Lang[langMode];
+  
+  u32 hash  = WORD_HASH_SEED;
+  for (u32 i = 0; i < word.m_Length; ++i)
+  {
+    hash = HashCodepoint(hash, word.m_Data[i].m_Codepoint);
+  }
+  
+  u32 slot  = hash & lang.m_WordMask;
+  while (lang.m_Words[slot].m_Word)
+  {
+    const EString&  other = *lang.m_Words[slot].m_Word;
+    if (lang.m_Words[slot].m_Hash == hash
+        && other.m_Length == word.m_Length
+        && !memcmp(other.m_Data, word.m_Data, sizeof(EChar) * word.m_Length))
+    {
+      return;
+    }
+    
+    slot = (slot + 1) & lang.m_WordMask;
+  }
+  
+  lang.m_Words[slot] = LangWord
+  {
+    .m_Word       = &word,
+    .m_Hash       = hash,
+    .m_Primitive  = primitive
+  };
+  
+  if (word.m_Length > lang.m_MaxWordLength)
+  {
+    lang.m_MaxWordLength = word.m_Length;
+  }
 }
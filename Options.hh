@@ -29,6 +29,11 @@ struct INTERNAL
   static constexpr usize        CONFIG_VALUE_LENGTH = 128;
   static constexpr const char*  CONFIG_SCAN         = "%127s = %127[^\r\n]";
   static constexpr const char*  CONFIG_COLOR_SCAN   = "%127s %127s";
+  static constexpr u32          HIGHLIGHT_INTERVAL  = 1024;
+  static constexpr u32          HIGHLIGHT_LOOKAHEAD = 4096;
+  static constexpr u32          HIGHLIGHT_EDITS     = 32;
+  static constexpr u32          HIGHLIGHT_MAX_COPY  = 1 << 22;
+  static constexpr u32          HISTORY_CHUNK_SIZE  = 4096;
 };
 
 struct FUNCTIONAL
@@ -38,10 +43,9 @@ struct FUNCTIONAL
   static constexpr const char*  COLOR_CONF        = "color.conf";
   static constexpr const char*  LANG_CONF         = "lang.conf";
   static constexpr const char*  EDITOR_CONF       = "editor.conf";
+  static constexpr const char*  UNDO_DIR          = "undo";
   static constexpr usize        MAX_BAR_LENGTH    = 512;
   static constexpr usize        MAX_PROMPT_LENGTH = 512;
-  static constexpr usize        MAX_BIND_LENGTH   = 16;
-  static constexpr usize        MAX_BINDS         = 128;
 };
 
 struct FRAME
@@ -97,8 +101,16 @@ struct FRAME
     "    m          Set the current frame as master\n"
     "    u          Undo the last changes made to a frame\n"
     "    C-r        Redo the last changes made to a frame\n"
+    "    -          Go back to the previously made change, on any branch\n"
+    "    +          Go forward to the next made change, on any branch\n"
+    "    ]          Switch to the next branch of the current change\n"
+    "    [          Switch to the previous branch of the current change\n"
+    "    t          Goto a given change, by the order it was made in\n"
     "    /          Search the frame forwards for literal text\n"
     "    ?          Search the frame backwards for literal text\n"
+    "    M-/        Search the frame forwards for a regular expression\n"
+    "    M-?        Search the frame backwards for a regular expression\n"
+    "    r          Replace every occurrence of literal text in the frame\n"
     "    c          Copy the current line\n"
     "    d          Cut the current line\n"
     "    q c        Copy a given number of lines\n"
@@ -110,6 +122,7 @@ struct FRAME
     "    g          Goto a given line\n"
     "    F3         Start recording a macro\n"
     "    F4         Stop recording or execute a macro\n"
+    "    q F4       Execute a macro a given number of times\n"
     "    i          Enter write mode\n"
     "    C-h        Display this help information\n"
     "\n"
@@ -182,6 +195,11 @@ struct KEYBIND
   static constexpr EChar  NEWLINE[]                 = {KEY(13), KEY_END};
   static constexpr EChar  UNDO[]                    = {KEY('u'), KEY_END};
   static constexpr EChar  REDO[]                    = {KEY_CTRL('r'), KEY_END};
+  static constexpr EChar  EARLIER[]                 = {KEY('-'), KEY_END};
+  static constexpr EChar  LATER[]                   = {KEY('+'), KEY_END};
+  static constexpr EChar  NEXT_BRANCH[]             = {KEY(']'), KEY_END};
+  static constexpr EChar  PREVIOUS_BRANCH[]         = {KEY('['), KEY_END};
+  static constexpr EChar  GOTO_HISTORY[]            = {KEY('t'), KEY_END};
   static constexpr EChar  NEW_FRAME[]               = {KEY_CTRL('n'), KEY_END};
   static constexpr EChar  KILL_FRAME[]              = {KEY_CTRL('k'), KEY_END};
   static constexpr EChar  SAVE[]                    = {KEY_CTRL('s'), KEY_END};
@@ -190,6 +208,9 @@ struct KEYBIND
   static constexpr EChar  COMPLETE[]                = {KEY(9), KEY_END};
   static constexpr EChar  SEARCH[]                  = {KEY('/'), KEY_END};
   static constexpr EChar  REVERSE_SEARCH[]          = {KEY('?'), KEY_END};
+  static constexpr EChar  REGEX_SEARCH[]            = {KEY_META('/'), KEY_END};
+  static constexpr EChar  REVERSE_REGEX_SEARCH[]    = {KEY_META('?'), KEY_END};
+  static constexpr EChar  REPLACE_ALL[]             = {KEY('r'), KEY_END};
   static constexpr EChar  LEFT_PAREN[]              = {KEY('('), KEY_END};
   static constexpr EChar  LEFT_BRACKET[]            = {KEY('['), KEY_END};
   static constexpr EChar  LEFT_BRACE[]              = {KEY('{'), KEY_END};
@@ -205,10 +226,13 @@ struct KEYBIND
   static constexpr EChar  GOTO[]                    = {KEY('g'), KEY_END};
   static constexpr EChar  RECORD_MACRO[]            = {KEY_FN(3), KEY_END};
   static constexpr EChar  EXECUTE_MACRO[]           = {KEY_FN(4), KEY_END};
+  static constexpr EChar  EXECUTE_MACRO_RUNS[]      = {KEY('q'), KEY_FN(4), KEY_END};
   static constexpr EChar  PROMPT_YES[]              = {KEY('y'), KEY_END};
   static constexpr EChar  PROMPT_NO[]               = {KEY('n'), KEY_END};
   static constexpr EChar  HELP[]                    = {KEY_CTRL('h'), KEY_END};
   static constexpr EChar  TAB[]                     = {KEY(9), KEY_END};
+  static constexpr EChar  BRACKETED_PASTE[]         = {KEY(27), KEY('['), KEY('2'), KEY('0'), KEY('0'), KEY('~'), KEY_END};
+  static constexpr EChar  BRACKETED_PASTE_END[]     = {KEY(27), KEY('['), KEY('2'), KEY('0'), KEY('1'), KEY('~'), KEY_END};
 };
 
 struct Color
@@ -223,6 +247,14 @@ struct NamedColor
   u8          m_Color;
 };
 
+// entry of a language mode's keyword and primitive table, which is open addressed by the hash of the word
+struct LangWord
+{
+  const EString*  m_Word;
+  u32             m_Hash;
+  bool            m_Primitive;
+};
+
 struct DynamicOptions
 {
   // layout options
@@ -234,8 +266,12 @@ struct DynamicOptions
   usize       m_NMargins;
   u32         m_TabSize;
   
+  // rendering options
+  u32         m_MaxFrameRate; // while input keeps coming, or 0 to render after every key
+  
   // editing options
   bool        m_TabSpaces;
+  u32         m_HistoryMemory;  // in KiB, per frame
   
   // theme options
   Color       m_Global;
@@ -248,6 +284,7 @@ struct DynamicOptions
   Color       m_Margin;
   Color       m_Cursor;
   u8          m_CursorHighlightBG;
+  Color       m_SearchMatch;
   Color       m_Comment;
   Color       m_Macro;
   Color       m_Special;
@@ -265,9 +302,20 @@ struct DynamicOptions
     usize     m_NKeywords;
     EString*  m_Primitives;
     usize     m_NPrimitives;
+    LangWord* m_Words;
+    u32       m_WordMask;
+    u32       m_MaxWordLength;
   }           m_Lang[LANG_MODE_END];
 };
 
+constexpr u32 WORD_HASH_SEED  = 2166136261;
+
+// FNV-1a over codepoints, so that words can be hashed while being lexed
+constexpr u32 HashCodepoint(u32 hash, u32 codepoint)
+{
+  return ((hash ^ codepoint) * 16777619);
+}
+
 constexpr NamedColor  NAMED_COLORS[]  =
 {
   // terminal
@@ -368,3 +416,4 @@ extern DynamicOptions g_Options;
 
 i32 ParseOptions();
 i32 ValidateOptions();
+i32 ConfigPath(OUT char path[], const char* configPath);
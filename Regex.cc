@@ -0,0 +1,1115 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include <cstdlib>
+#include <cstring>
+#include <Regex.hh>
+
+constexpr u32 MAX_CODEPOINT = 0x10ffff;
+
+enum RegexAstType : u8
+{
+  AST_EMPTY = 0,
+  AST_SET,
+  AST_CONCAT,
+  AST_ALTERNATE,
+  AST_REPEAT,
+  AST_LINE_BEGIN,
+  AST_LINE_END
+};
+
+struct RegexAst
+{
+  RegexAstType  m_Type  {};
+  u32           m_Left  {}; // also the repeated node
+  u32           m_Right {};
+  u32           m_Set   {};
+  u32           m_Min   {};
+  u32           m_Max   {}; // REGEX_UNKNOWN if unbounded
+};
+
+struct RegexRange
+{
+  u32 m_Lower;
+  u32 m_Upper;  // inclusive
+};
+
+struct RegexParser
+{
+  const EString&  m_Pattern;
+  u32             m_Pos           {};
+  const char*     m_Error         {};
+  RegexAst*       m_Ast           {};
+  u32             m_NAst          {};
+  u32             m_AstCapacity   {};
+  RegexRange*     m_Ranges        {}; // ranges of every set, in order
+  u32             m_NRanges       {};
+  u32             m_RangeCapacity {};
+  u32*            m_SetRanges     {}; // first range of every set, and the end of the last
+  u32             m_NSets         {};
+  u32             m_SetCapacity   {};
+  
+  void  Free();
+  bool  AtEnd() const;
+  u32   Peek() const;
+  u32   AddAst(RegexAst ast);
+  void  AddRange(u32 lower, u32 upper);
+  u32   EndSet(u32 first, bool negate);
+  u32   ParseAlternation();
+  u32   ParseConcatenation();
+  u32   ParseRepetition();
+  u32   ParseAtom();
+  u32   ParseClass();
+  bool  ParseEscape();
+  bool  ParseCount(OUT u32& count);
+};
+
+static i32  CompileRegex(OUT Regex& regex, const EString& pattern);
+static void ClassifySets(IN_OUT Regex& regex, const RegexParser& parser);
+static i32  CompileProgram(OUT RegexProgram& program, const RegexParser& parser, u32 root, bool reverse);
+static u32  CompileAst(IN_OUT RegexProgram& program, const RegexParser& parser, u32 ast, u32 next, bool reverse);
+static u32  AddNode(IN_OUT RegexProgram& program, RegexNode node);
+static bool ScanForward(const Buffer& buffer, IN_OUT RegexDFA& dfa, u32 lb, u32 ub, bool longest, OUT u32& pos);
+static bool ScanReverse(const Buffer& buffer, IN_OUT RegexDFA& dfa, u32 lb, u32 ub, bool leftmost, OUT u32& pos);
+static u32  FindClass(const u32* boundaries, u32 nClasses, u32 codepoint);
+static bool AtLineBegin(const Buffer& buffer, u32 pos);
+static int  CompareRanges(const void* lhs, const void* rhs);
+static int  CompareNodes(const void* lhs, const void* rhs);
+
+static Regex* g_Cache[REGEX_CACHE_SIZE];  // most recently used first
+
+void  RegexProgram::Free()
+{
+  free(m_Nodes);
+}
+
+void  RegexDFA::Init(const Regex* regex, const RegexProgram* program, bool unanchored)
+{
+  *this = RegexDFA{};
+  m_Regex = regex;
+  m_Program = program;
+  m_Unanchored = unanchored;
+  m_Scratch = (u32*)calloc(2 * program->m_NNodes, sizeof(u32));
+  m_Stack = (u32*)calloc(2 * program->m_NNodes + 1, sizeof(u32));
+  m_Marks = (u32*)calloc(program->m_NNodes, sizeof(u32));
+  m_PoolCapacity = 256;
+  m_Pool = (u32*)calloc(m_PoolCapacity, sizeof(u32));
+  Clear();
+}
+
+void  RegexDFA::Free()
+{
+  free(m_States);
+  free(m_Pool);
+  free(m_Transitions);
+  free(m_Table);
+  free(m_Scratch);
+  free(m_Stack);
+  free(m_Marks);
+}
+
+// drops every state other than the dead one
+void  RegexDFA::Clear()
+{
+  m_NStates = 0;
+  m_PoolSize = 0;
+  m_Starts[0] = REGEX_UNKNOWN;
+  m_Starts[1] = REGEX_UNKNOWN;
+  if (m_Table)
+  {
+    memset(m_Table, 0, sizeof(u32) * m_TableCapacity);
+  }
+  
+  AddState(nullptr, 0);
+}
+
+u32 RegexDFA::Start(bool boundary)
+{
+  if (m_Starts[boundary] == REGEX_UNKNOWN)
+  {
+    ++m_Generation;
+    u32 n = 0;
+    Closure(m_Program->m_Start, boundary, n);
+    qsort(m_Scratch, n, sizeof(u32), CompareNodes);
+    
+    u32 state = AddState(m_Scratch, n);
+    m_Starts[boundary] = state;
+  }
+  
+  return (m_Starts[boundary]);
+}
+
+u32 RegexDFA::Step(u32 state, u32 cls)
+{
+  u32 next  = m_Transitions[state * m_Regex->m_NClasses + cls];
+  return (next != REGEX_UNKNOWN ? next : StepSlow(state, cls));
+}
+
+u32 RegexDFA::StepSlow(u32 state, u32 cls)
+{
+  ++m_Generation;
+  u32 n = 0;
+  for (u32 i = 0; i < m_States[state].m_NNodes; ++i)
+  {
+    const RegexNode&  node  = m_Program->m_Nodes[m_Pool[m_States[state].m_Nodes + i]];
+    if (node.m_Type == REGEX_SET && m_Regex->InSet(node.m_Set, cls))
+    {
+      Closure(node.m_Next, false, n);
+    }
+  }
+  
+  if (m_Unanchored)
+  {
+    Closure(m_Program->m_Start, false, n);
+  }
+  qsort(m_Scratch, n, sizeof(u32), CompareNodes);
+  
+  // the states may have been dropped to make room, in which case the transition isn't kept
+  u32 nStates = m_NStates;
+  u32 next    = AddState(m_Scratch, n);
+  if (m_NStates >= nStates)
+  {
+    m_Transitions[state * m_Regex->m_NClasses + cls] = next;
+  }
+  
+  return (next);
+}
+
+// adds the set, end and match nodes reachable from a node without reading a character to the scratch set
+void  RegexDFA::Closure(u32 node, bool boundary, IN_OUT u32& n)
+{
+  u32 depth = 0;
+  m_Stack[depth++] = node;
+  while (depth)
+  {
+    u32 cur = m_Stack[--depth];
+    if (m_Marks[cur] == m_Generation)
+    {
+      continue;
+    }
+    m_Marks[cur] = m_Generation;
+    
+    const RegexNode&  curNode = m_Program->m_Nodes[cur];
+    switch (curNode.m_Type)
+    {
+    case (REGEX_SPLIT):
+      m_Stack[depth++] = curNode.m_Alternative;
+      m_Stack[depth++] = curNode.m_Next;
+      break;
+    case (REGEX_AT_START):
+      if (boundary)
+      {
+        m_Stack[depth++] = curNode.m_Next;
+      }
+      break;
+    default:
+      m_Scratch[n++] = cur;
+      break;
+    }
+  }
+}
+
+// whether a match is reached by passing the end nodes of the first n scratch nodes
+bool  RegexDFA::MatchesAtEnd(u32 n)
+{
+  ++m_Generation;
+  u32 closure = n;
+  for (u32 i = 0; i < closure; ++i)
+  {
+    const RegexNode&  node  = m_Program->m_Nodes[m_Scratch[i]];
+    if (node.m_Type == REGEX_MATCH)
+    {
+      return (true);
+    }
+    else if (node.m_Type == REGEX_AT_END)
+    {
+      Closure(node.m_Next, false, closure);
+    }
+  }
+  
+  return (false);
+}
+
+u32 RegexDFA::AddState(const u32* nodes, u32 n)
+{
+  u32 hash  = 2166136261;
+  for (u32 i = 0; i < n; ++i)
+  {
+    hash = (hash ^ nodes[i]) * 16777619;
+  }
+  
+  for (u32 slot = hash & (m_TableCapacity - 1); m_TableCapacity && m_Table[slot]; slot = (slot + 1) & (m_TableCapacity - 1))
+  {
+    const RegexState& state = m_States[m_Table[slot] - 1];
+    if (state.m_Hash == hash && state.m_NNodes == n && !memcmp(&m_Pool[state.m_Nodes], nodes, sizeof(u32) * n))
+    {
+      return (m_Table[slot] - 1);
+    }
+  }
+  
+  if (m_NStates >= REGEX_MAX_STATES)
+  {
+    Clear();
+  }
+  
+  if (m_NStates >= m_StateCapacity)
+  {
+    m_StateCapacity = m_StateCapacity ? 2 * m_StateCapacity : 16;
+    m_States = (RegexState*)reallocarray(m_States, m_StateCapacity, sizeof(RegexState));
+    m_Transitions = (u32*)reallocarray(m_Transitions, m_StateCapacity, sizeof(u32) * m_Regex->m_NClasses);
+  }
+  
+  if (m_PoolSize + n > m_PoolCapacity)
+  {
+    m_PoolCapacity = 2 * m_PoolCapacity < m_PoolSize + n ? m_PoolSize + n : 2 * m_PoolCapacity;
+    m_Pool = (u32*)reallocarray(m_Pool, m_PoolCapacity, sizeof(u32));
+  }
+  
+  // the table is kept at most half full
+  if (2 * (m_NStates + 1) > m_TableCapacity)
+  {
+    free(m_Table);
+    m_TableCapacity = m_TableCapacity ? 2 * m_TableCapacity : 64;
+    m_Table = (u32*)calloc(m_TableCapacity, sizeof(u32));
+    for (u32 i = 0; i < m_NStates; ++i)
+    {
+      u32 slot  = m_States[i].m_Hash & (m_TableCapacity - 1);
+      while (m_Table[slot])
+      {
+        slot = (slot + 1) & (m_TableCapacity - 1);
+      }
+      m_Table[slot] = i + 1;
+    }
+  }
+  
+  if (nodes != m_Scratch && n)
+  {
+    memcpy(m_Scratch, nodes, sizeof(u32) * n);
+  }
+  
+  RegexState& state = m_States[m_NStates];
+  state.m_Nodes = m_PoolSize;
+  state.m_NNodes = n;
+  state.m_Hash = hash;
+  state.m_Match = false;
+  for (u32 i = 0; i < n; ++i)
+  {
+    state.m_Match = state.m_Match || m_Program->m_Nodes[m_Scratch[i]].m_Type == REGEX_MATCH;
+  }
+  state.m_MatchAtEnd = MatchesAtEnd(n);
+  memcpy(&m_Pool[m_PoolSize], m_Scratch, sizeof(u32) * n);
+  m_PoolSize += n;
+  
+  for (u32 i = 0; i < m_Regex->m_NClasses; ++i)
+  {
+    m_Transitions[m_NStates * m_Regex->m_NClasses + i] = REGEX_UNKNOWN;
+  }
+  
+  u32 slot  = hash & (m_TableCapacity - 1);
+  while (m_Table[slot])
+  {
+    slot = (slot + 1) & (m_TableCapacity - 1);
+  }
+  m_Table[slot] = m_NStates + 1;
+  
+  return (m_NStates++);
+}
+
+u32 Regex::Class(u32 codepoint) const
+{
+  return (codepoint < 128 ? m_ASCIIClasses[codepoint] : FindClass(m_Boundaries, m_NClasses, codepoint));
+}
+
+bool  Regex::InSet(u32 set, u32 cls) const
+{
+  return (m_Sets[set * m_SetWords + cls / 64] >> cls % 64 & 1);
+}
+
+void  Regex::Free()
+{
+  m_Pattern.Free();
+  free(m_Boundaries);
+  free(m_Sets);
+  m_Search.Free();
+  m_Match.Free();
+  m_ReverseSearch.Free();
+  m_Forward.Free();
+  m_Reverse.Free();
+}
+
+// compiled patterns are kept, along with the DFA states built for them, so that searching for a pattern again doesn't
+// start over; null is returned if the pattern is invalid
+Regex*  CachedRegex(const EString& pattern)
+{
+  u32 idx = 0;
+  for (; idx < REGEX_CACHE_SIZE && g_Cache[idx]; ++idx)
+  {
+    const EString&  cached  = g_Cache[idx]->m_Pattern;
+    bool            equal   = cached.m_Length == pattern.m_Length;
+    for (u32 i = 0; equal && i < pattern.m_Length; ++i)
+    {
+      equal = cached.m_Data[i].m_Codepoint == pattern.m_Data[i].m_Codepoint;
+    }
+    
+    if (equal)
+    {
+      break;
+    }
+  }
+  
+  Regex*  regex = idx < REGEX_CACHE_SIZE ? g_Cache[idx] : nullptr;
+  if (!regex)
+  {
+    regex = (Regex*)calloc(1, sizeof(Regex));
+    if (CompileRegex(*regex, pattern))
+    {
+      free(regex);
+      return (nullptr);
+    }
+    
+    // the least recently used pattern makes room
+    if (idx == REGEX_CACHE_SIZE)
+    {
+      idx = REGEX_CACHE_SIZE - 1;
+      g_Cache[idx]->Free();
+      free(g_Cache[idx]);
+    }
+  }
+  
+  memmove(&g_Cache[1], &g_Cache[0], sizeof(Regex*) * idx);
+  g_Cache[0] = regex;
+  
+  return (regex);
+}
+
+// finds the leftmost match starting at or after lb and ending at or before ub, and the longest match from there; the
+// earliest end of any match gives the line of the leftmost match, since matches don't span lines, and a backwards scan
+// of that line finds where it starts
+bool  FindRegexForward(const Buffer& buffer, Regex& regex, u32 lb, u32 ub, OUT u32& matchLb, OUT u32& matchUb)
+{
+  u32 end = 0;
+  if (lb > ub || !ScanForward(buffer, regex.m_Search, lb, ub, false, end))
+  {
+    return (false);
+  }
+  
+  u32 lineBegin = buffer.LineBegin(end);
+  u32 lineEnd   = buffer.LineEnd(end);
+  lineBegin = lineBegin < lb ? lb : lineBegin;
+  lineEnd = lineEnd > ub ? ub : lineEnd;
+  
+  ScanReverse(buffer, regex.m_ReverseSearch, lineBegin, lineEnd, true, matchLb);
+  ScanForward(buffer, regex.m_Match, matchLb, lineEnd, true, matchUb);
+  
+  return (true);
+}
+
+// finds the match starting last at or after lb and ending at or before ub, and the longest match from there
+bool  FindRegexReverse(const Buffer& buffer, Regex& regex, u32 lb, u32 ub, OUT u32& matchLb, OUT u32& matchUb)
+{
+  if (lb > ub || !ScanReverse(buffer, regex.m_ReverseSearch, lb, ub, false, matchLb))
+  {
+    return (false);
+  }
+  
+  u32 lineEnd = buffer.LineEnd(matchLb);
+  ScanForward(buffer, regex.m_Match, matchLb, lineEnd > ub ? ub : lineEnd, true, matchUb);
+  
+  return (true);
+}
+
+// gives every position from lb up to ub at which a match ending at or before ub starts, last first, with one scan
+// backwards; lb and ub have to be on the same line
+u32 FindRegexStarts(const Buffer& buffer, Regex& regex, u32 lb, u32 ub, IN_OUT u32*& starts, IN_OUT u32& capacity)
+{
+  RegexDFA&     dfa   = regex.m_ReverseSearch;
+  BufferCursor  c     = buffer.Cursor(ub);
+  u32           state = dfa.Start(ub >= buffer.m_Length || c.Codepoint() == '\n');
+  u32           n     = 0;
+  for (u32 p = ub;; --p)
+  {
+    // the start of the buffer acts as a newline before it
+    u32 ch  = '\n';
+    if (p > 0)
+    {
+      c.Prev();
+      ch = c.Codepoint();
+    }
+    
+    if (ch == '\n' ? dfa.m_States[state].m_MatchAtEnd : dfa.m_States[state].m_Match)
+    {
+      if (n >= capacity)
+      {
+        capacity = capacity ? 2 * capacity : 64;
+        starts = (u32*)reallocarray(starts, capacity, sizeof(u32));
+      }
+      starts[n++] = p;
+    }
+    
+    if (p == lb)
+    {
+      break;
+    }
+    
+    state = dfa.Step(state, regex.Class(ch));
+  }
+  
+  return (n);
+}
+
+// gives the end of the longest match starting at pos and ending at or before ub
+bool  MatchRegexAt(const Buffer& buffer, Regex& regex, u32 pos, u32 ub, OUT u32& matchUb)
+{
+  return (pos <= ub && ScanForward(buffer, regex.m_Match, pos, ub, true, matchUb));
+}
+
+void  RegexParser::Free()
+{
+  free(m_Ast);
+  free(m_Ranges);
+  free(m_SetRanges);
+}
+
+bool  RegexParser::AtEnd() const
+{
+  return (m_Pos >= m_Pattern.m_Length);
+}
+
+u32 RegexParser::Peek() const
+{
+  return (AtEnd() ? 0 : m_Pattern.m_Data[m_Pos].m_Codepoint);
+}
+
+u32 RegexParser::AddAst(RegexAst ast)
+{
+  if (m_NAst >= m_AstCapacity)
+  {
+    m_AstCapacity = m_AstCapacity ? 2 * m_AstCapacity : 32;
+    m_Ast = (RegexAst*)reallocarray(m_Ast, m_AstCapacity, sizeof(RegexAst));
+  }
+  
+  m_Ast[m_NAst] = ast;
+  return (m_NAst++);
+}
+
+void  RegexParser::AddRange(u32 lower, u32 upper)
+{
+  if (m_NRanges >= m_RangeCapacity)
+  {
+    m_RangeCapacity = m_RangeCapacity ? 2 * m_RangeCapacity : 32;
+    m_Ranges = (RegexRange*)reallocarray(m_Ranges, m_RangeCapacity, sizeof(RegexRange));
+  }
+  
+  m_Ranges[m_NRanges++] = RegexRange{lower, upper};
+}
+
+// turns the ranges added since first into a set; they are sorted and merged, complemented if negated, and newlines
+// are taken out, since they are never matched
+u32 RegexParser::EndSet(u32 first, bool negate)
+{
+  if (m_NRanges > first)
+  {
+    qsort(&m_Ranges[first], m_NRanges - first, sizeof(RegexRange), CompareRanges);
+  }
+  
+  u32 n = first;
+  for (u32 i = first; i < m_NRanges; ++i)
+  {
+    if (n > first && m_Ranges[i].m_Lower <= m_Ranges[n - 1].m_Upper + 1)
+    {
+      if (m_Ranges[i].m_Upper > m_Ranges[n - 1].m_Upper)
+      {
+        m_Ranges[n - 1].m_Upper = m_Ranges[i].m_Upper;
+      }
+    }
+    else
+    {
+      m_Ranges[n++] = m_Ranges[i];
+    }
+  }
+  m_NRanges = n;
+  
+  if (negate)
+  {
+    u32 nMerged = m_NRanges - first;
+    u32 lower   = 0;
+    for (u32 i = 0; i < nMerged; ++i)
+    {
+      RegexRange  range = m_Ranges[first + i];
+      if (range.m_Lower > lower)
+      {
+        AddRange(lower, range.m_Lower - 1);
+      }
+      lower = range.m_Upper + 1;
+    }
+    
+    if (lower <= MAX_CODEPOINT)
+    {
+      AddRange(lower, MAX_CODEPOINT);
+    }
+    
+    memmove(&m_Ranges[first], &m_Ranges[first + nMerged], sizeof(RegexRange) * (m_NRanges - first - nMerged));
+    m_NRanges -= nMerged;
+  }
+  
+  for (u32 i = first; i < m_NRanges; ++i)
+  {
+    RegexRange  range = m_Ranges[i];
+    if (range.m_Lower <= '\n' && range.m_Upper >= '\n')
+    {
+      m_Ranges[i].m_Upper = '\n' - 1;
+      if (range.m_Upper > '\n')
+      {
+        AddRange('\n' + 1, range.m_Upper);
+      }
+      if (range.m_Lower == '\n')
+      {
+        m_Ranges[i] = m_Ranges[--m_NRanges];
+      }
+      break;
+    }
+  }
+  
+  if (m_NSets + 2 > m_SetCapacity)
+  {
+    m_SetCapacity = m_SetCapacity ? 2 * m_SetCapacity : 16;
+    m_SetRanges = (u32*)reallocarray(m_SetRanges, m_SetCapacity, sizeof(u32));
+  }
+  m_SetRanges[m_NSets] = first;
+  m_SetRanges[m_NSets + 1] = m_NRanges;
+  
+  return (m_NSets++);
+}
+
+u32 RegexParser::ParseAlternation()
+{
+  u32 ast = ParseConcatenation();
+  while (!m_Error && Peek() == '|')
+  {
+    ++m_Pos;
+    u32 right = ParseConcatenation();
+    ast = AddAst(RegexAst{.m_Type = AST_ALTERNATE, .m_Left = ast, .m_Right = right});
+  }
+  
+  return (ast);
+}
+
+u32 RegexParser::ParseConcatenation()
+{
+  u32 ast = AddAst(RegexAst{.m_Type = AST_EMPTY});
+  while (!m_Error && !AtEnd() && Peek() != '|' && Peek() != ')')
+  {
+    u32 right = ParseRepetition();
+    ast = AddAst(RegexAst{.m_Type = AST_CONCAT, .m_Left = ast, .m_Right = right});
+  }
+  
+  return (ast);
+}
+
+u32 RegexParser::ParseRepetition()
+{
+  u32 ast = ParseAtom();
+  while (!m_Error && !AtEnd())
+  {
+    u32 min = 0;
+    u32 max = REGEX_UNKNOWN;
+    switch (Peek())
+    {
+    case ('*'):
+      ++m_Pos;
+      break;
+    case ('+'):
+      ++m_Pos;
+      min = 1;
+      break;
+    case ('?'):
+      ++m_Pos;
+      max = 1;
+      break;
+    case ('{'):
+      ++m_Pos;
+      if (!ParseCount(min))
+      {
+        return (ast);
+      }
+      
+      max = min;
+      if (Peek() == ',')
+      {
+        ++m_Pos;
+        max = Peek() == '}' ? REGEX_UNKNOWN : 0;
+        if (Peek() != '}' && !ParseCount(max))
+        {
+          return (ast);
+        }
+      }
+      
+      if (Peek() != '}' || (max != REGEX_UNKNOWN && max < min))
+      {
+        m_Error = "Invalid repetition count";
+        return (ast);
+      }
+      ++m_Pos;
+      break;
+    default:
+      return (ast);
+    }
+    
+    ast = AddAst(RegexAst{.m_Type = AST_REPEAT, .m_Left = ast, .m_Min = min, .m_Max = max});
+  }
+  
+  return (ast);
+}
+
+u32 RegexParser::ParseAtom()
+{
+  u32 ch  = Peek();
+  ++m_Pos;
+  switch (ch)
+  {
+  case ('('):
+  {
+    u32 ast = ParseAlternation();
+    if (!m_Error && Peek() != ')')
+    {
+      m_Error = "Unclosed group";
+    }
+    ++m_Pos;
+    return (ast);
+  }
+  case ('['):
+    return (ParseClass());
+  case ('.'):
+  {
+    u32 first = m_NRanges;
+    return (AddAst(RegexAst{.m_Type = AST_SET, .m_Set = EndSet(first, true)}));
+  }
+  case ('^'):
+    return (AddAst(RegexAst{.m_Type = AST_LINE_BEGIN}));
+  case ('$'):
+    return (AddAst(RegexAst{.m_Type = AST_LINE_END}));
+  case ('*'):
+  case ('+'):
+  case ('?'):
+  case ('{'):
+    m_Error = "Nothing to repeat";
+    return (0);
+  case ('\\'):
+  {
+    --m_Pos;
+    u32 first = m_NRanges;
+    bool negate = ParseEscape();
+    return (AddAst(RegexAst{.m_Type = AST_SET, .m_Set = EndSet(first, negate)}));
+  }
+  default:
+  {
+    u32 first = m_NRanges;
+    AddRange(ch, ch);
+    return (AddAst(RegexAst{.m_Type = AST_SET, .m_Set = EndSet(first, false)}));
+  }
+  }
+}
+
+u32 RegexParser::ParseClass()
+{
+  u32   first   = m_NRanges;
+  bool  negate  = Peek() == '^';
+  m_Pos += negate;
+  
+  // a closing bracket straight after the opening one is taken literally
+  for (bool leading = true; !m_Error && (leading || Peek() != ']'); leading = false)
+  {
+    if (AtEnd())
+    {
+      m_Error = "Unclosed character class";
+      return (0);
+    }
+    
+    if (Peek() == '\\')
+    {
+      if (ParseEscape())
+      {
+        m_Error = "Negated escapes can't be used in character classes";
+      }
+      continue;
+    }
+    
+    u32 lower = m_Pattern.m_Data[m_Pos++].m_Codepoint;
+    u32 upper = lower;
+    if (Peek() == '-' && m_Pos + 1 < m_Pattern.m_Length && m_Pattern.m_Data[m_Pos + 1].m_Codepoint != ']')
+    {
+      upper = m_Pattern.m_Data[m_Pos + 1].m_Codepoint;
+      m_Pos += 2;
+      if (upper < lower)
+      {
+        m_Error = "Invalid character range";
+      }
+    }
+    AddRange(lower, upper);
+  }
+  ++m_Pos;
+  
+  return (AddAst(RegexAst{.m_Type = AST_SET, .m_Set = EndSet(first, negate)}));
+}
+
+// adds the ranges of an escape, and returns whether they are to be negated; the only escapes allowed in classes are
+// those which aren't
+bool  RegexParser::ParseEscape()
+{
+  ++m_Pos;
+  if (AtEnd())
+  {
+    m_Error = "Trailing backslash";
+    return (false);
+  }
+  
+  u32 ch  = m_Pattern.m_Data[m_Pos++].m_Codepoint;
+  switch (ch)
+  {
+  case ('D'):
+  case ('d'):
+    AddRange('0', '9');
+    return (ch == 'D');
+  case ('W'):
+  case ('w'):
+    AddRange('0', '9');
+    AddRange('A', 'Z');
+    AddRange('_', '_');
+    AddRange('a', 'z');
+    return (ch == 'W');
+  case ('S'):
+  case ('s'):
+    AddRange('\t', '\r');
+    AddRange(' ', ' ');
+    return (ch == 'S');
+  case ('t'):
+    AddRange('\t', '\t');
+    return (false);
+  case ('r'):
+    AddRange('\r', '\r');
+    return (false);
+  case ('f'):
+    AddRange('\f', '\f');
+    return (false);
+  case ('v'):
+    AddRange('\v', '\v');
+    return (false);
+  case ('n'):
+    m_Error = "Patterns can't match newlines";
+    return (false);
+  default:
+    AddRange(ch, ch);
+    return (false);
+  }
+}
+
+bool  RegexParser::ParseCount(OUT u32& count)
+{
+  count = 0;
+  if (Peek() < '0' || Peek() > '9')
+  {
+    m_Error = "Invalid repetition count";
+    return (false);
+  }
+  
+  while (Peek() >= '0' && Peek() <= '9')
+  {
+    count = 10 * count + Peek() - '0';
+    ++m_Pos;
+    if (count > REGEX_MAX_REPEAT)
+    {
+      m_Error = "Repetition count too large";
+      return (false);
+    }
+  }
+  
+  return (true);
+}
+
+static i32  CompileRegex(OUT Regex& regex, const EString& pattern)
+{
+  RegexParser parser  {.m_Pattern = pattern};
+  u32         root    = parser.ParseAlternation();
+  if (!parser.m_Error && !parser.AtEnd())
+  {
+    parser.m_Error = "Unmatched closing parenthesis";
+  }
+  
+  if (parser.m_Error)
+  {
+    Error("Regex: %s!", parser.m_Error);
+    parser.Free();
+    return (1);
+  }
+  
+  regex = Regex{};
+  ClassifySets(regex, parser);
+  if (CompileProgram(regex.m_Forward, parser, root, false) || CompileProgram(regex.m_Reverse, parser, root, true))
+  {
+    Error("Regex: Pattern is too large!");
+    regex.m_Forward.Free();
+    regex.m_Reverse.Free();
+    free(regex.m_Boundaries);
+    free(regex.m_Sets);
+    parser.Free();
+    return (1);
+  }
+  parser.Free();
+  
+  regex.m_Pattern = pattern.Copy();
+  regex.m_Search.Init(&regex, &regex.m_Forward, true);
+  regex.m_Match.Init(&regex, &regex.m_Forward, false);
+  regex.m_ReverseSearch.Init(&regex, &regex.m_Reverse, true);
+  
+  return (0);
+}
+
+// codepoints are split at every bound of every range, so that each set holds either all or none of a class
+static void ClassifySets(IN_OUT Regex& regex, const RegexParser& parser)
+{
+  u32*  boundaries  = (u32*)calloc(2 * parser.m_NRanges + 1, sizeof(u32));
+  u32   n           = 0;
+  boundaries[n++] = 0;
+  for (u32 i = 0; i < parser.m_NRanges; ++i)
+  {
+    boundaries[n++] = parser.m_Ranges[i].m_Lower;
+    boundaries[n++] = parser.m_Ranges[i].m_Upper + 1;
+  }
+  qsort(boundaries, n, sizeof(u32), CompareNodes);
+  
+  u32 nUnique = 0;
+  for (u32 i = 0; i < n; ++i)
+  {
+    if (boundaries[i] <= MAX_CODEPOINT && (!nUnique || boundaries[i] != boundaries[nUnique - 1]))
+    {
+      boundaries[nUnique++] = boundaries[i];
+    }
+  }
+  
+  regex.m_Boundaries = boundaries;
+  regex.m_NClasses = nUnique;
+  for (u32 i = 0; i < 128; ++i)
+  {
+    regex.m_ASCIIClasses[i] = FindClass(boundaries, nUnique, i);
+  }
+  
+  regex.m_SetWords = (nUnique + 63) / 64;
+  regex.m_Sets = (u64*)calloc(parser.m_NSets ? parser.m_NSets * regex.m_SetWords : 1, sizeof(u64));
+  for (u32 set = 0; set < parser.m_NSets; ++set)
+  {
+    for (u32 i = parser.m_SetRanges[set]; i < parser.m_SetRanges[set + 1]; ++i)
+    {
+      u32 lower = FindClass(boundaries, nUnique, parser.m_Ranges[i].m_Lower);
+      u32 upper = FindClass(boundaries, nUnique, parser.m_Ranges[i].m_Upper);
+      for (u32 cls = lower; cls <= upper; ++cls)
+      {
+        regex.m_Sets[set * regex.m_SetWords + cls / 64] |= (u64)1 << cls % 64;
+      }
+    }
+  }
+}
+
+static i32  CompileProgram(OUT RegexProgram& program, const RegexParser& parser, u32 root, bool reverse)
+{
+  program = RegexProgram{};
+  u32 match = AddNode(program, RegexNode{.m_Type = REGEX_MATCH});
+  program.m_Start = CompileAst(program, parser, root, match, reverse);
+  
+  return (program.m_NNodes > REGEX_MAX_NODES);
+}
+
+// builds the nodes of a subtree in front of the given next node, and returns the first of them; building stops once
+// there are too many nodes
+static u32  CompileAst(IN_OUT RegexProgram& program, const RegexParser& parser, u32 ast, u32 next, bool reverse)
+{
+  if (program.m_NNodes > REGEX_MAX_NODES)
+  {
+    return (next);
+  }
+  
+  const RegexAst& node  = parser.m_Ast[ast];
+  switch (node.m_Type)
+  {
+  case (AST_EMPTY):
+    return (next);
+  case (AST_SET):
+    return (AddNode(program, RegexNode{.m_Type = REGEX_SET, .m_Next = next, .m_Set = node.m_Set}));
+  case (AST_CONCAT):
+    if (reverse)
+    {
+      return (CompileAst(program, parser, node.m_Right, CompileAst(program, parser, node.m_Left, next, true), true));
+    }
+    return (CompileAst(program, parser, node.m_Left, CompileAst(program, parser, node.m_Right, next, false), false));
+  case (AST_ALTERNATE):
+  {
+    u32 left  = CompileAst(program, parser, node.m_Left, next, reverse);
+    u32 right = CompileAst(program, parser, node.m_Right, next, reverse);
+    return (AddNode(program, RegexNode{.m_Type = REGEX_SPLIT, .m_Next = left, .m_Alternative = right}));
+  }
+  case (AST_REPEAT):
+  {
+    // optional repetitions nest from the last, and mandatory ones are put in front of them
+    u32 cur = next;
+    if (node.m_Max == REGEX_UNKNOWN)
+    {
+      cur = AddNode(program, RegexNode{.m_Type = REGEX_SPLIT, .m_Alternative = next});
+      u32 body  = CompileAst(program, parser, node.m_Left, cur, reverse);
+      program.m_Nodes[cur].m_Next = body;
+    }
+    else
+    {
+      for (u32 i = node.m_Min; i < node.m_Max; ++i)
+      {
+        u32 body  = CompileAst(program, parser, node.m_Left, cur, reverse);
+        cur = AddNode(program, RegexNode{.m_Type = REGEX_SPLIT, .m_Next = body, .m_Alternative = next});
+      }
+    }
+    
+    for (u32 i = 0; i < node.m_Min; ++i)
+    {
+      cur = CompileAst(program, parser, node.m_Left, cur, reverse);
+    }
+    return (cur);
+  }
+  case (AST_LINE_BEGIN):
+    return (AddNode(program, RegexNode{.m_Type = reverse ? REGEX_AT_END : REGEX_AT_START, .m_Next = next}));
+  case (AST_LINE_END):
+    return (AddNode(program, RegexNode{.m_Type = reverse ? REGEX_AT_START : REGEX_AT_END, .m_Next = next}));
+  }
+  
+  return (next);
+}
+
+static u32  AddNode(IN_OUT RegexProgram& program, RegexNode node)
+{
+  if (program.m_NNodes >= program.m_Capacity)
+  {
+    program.m_Capacity = program.m_Capacity ? 2 * program.m_Capacity : 32;
+    program.m_Nodes = (RegexNode*)reallocarray(program.m_Nodes, program.m_Capacity, sizeof(RegexNode));
+  }
+  
+  program.m_Nodes[program.m_NNodes] = node;
+  return (program.m_NNodes++);
+}
+
+// scans from lb towards ub for the first position a match ends at, or with longest set, the last one before the DFA
+// dies; unanchored scans start over after every newline, and anchored ones stop at the first one
+static bool ScanForward(const Buffer& buffer, IN_OUT RegexDFA& dfa, u32 lb, u32 ub, bool longest, OUT u32& pos)
+{
+  const Regex&  regex = *dfa.m_Regex;
+  BufferCursor  c     = buffer.Cursor(lb);
+  u32           state = dfa.Start(AtLineBegin(buffer, lb));
+  bool          found = false;
+  for (u32 p = lb;; ++p, c.Next())
+  {
+    u32   ch      = p < buffer.m_Length ? c.Codepoint() : '\n';
+    bool  match   = ch == '\n' ? dfa.m_States[state].m_MatchAtEnd : dfa.m_States[state].m_Match;
+    if (match)
+    {
+      pos = p;
+      found = true;
+      if (!longest)
+      {
+        break;
+      }
+    }
+    
+    if (p == ub || (!state && !dfa.m_Unanchored))
+    {
+      break;
+    }
+    
+    if (ch == '\n')
+    {
+      if (!dfa.m_Unanchored)
+      {
+        break;
+      }
+      state = dfa.Start(true);
+    }
+    else
+    {
+      state = dfa.Step(state, regex.Class(ch));
+    }
+  }
+  
+  return (found);
+}
+
+// scans backwards from ub towards lb with a reversed DFA for where a match starts; the first position found is the
+// last match start, and with leftmost set, the scan goes on to find the first
+static bool ScanReverse(const Buffer& buffer, IN_OUT RegexDFA& dfa, u32 lb, u32 ub, bool leftmost, OUT u32& pos)
+{
+  const Regex&  regex = *dfa.m_Regex;
+  BufferCursor  c     = buffer.Cursor(ub);
+  u32           state = dfa.Start(ub >= buffer.m_Length || c.Codepoint() == '\n');
+  bool          found = false;
+  for (u32 p = ub;; --p)
+  {
+    // the start of the buffer acts as a newline before it
+    u32 ch  = '\n';
+    if (p > 0)
+    {
+      c.Prev();
+      ch = c.Codepoint();
+    }
+    
+    bool  match   = ch == '\n' ? dfa.m_States[state].m_MatchAtEnd : dfa.m_States[state].m_Match;
+    if (match)
+    {
+      pos = p;
+      found = true;
+      if (!leftmost)
+      {
+        break;
+      }
+    }
+    
+    if (p == lb || (!state && !dfa.m_Unanchored))
+    {
+      break;
+    }
+    
+    state = ch == '\n' ? dfa.Start(true) : dfa.Step(state, regex.Class(ch));
+  }
+  
+  return (found);
+}
+
+static u32  FindClass(const u32* boundaries, u32 nClasses, u32 codepoint)
+{
+  u32 low   = 0;
+  u32 high  = nClasses - 1;
+  while (low < high)
+  {
+    u32 mid = (low + high + 1) / 2;
+    if (boundaries[mid] <= codepoint)
+    {
+      low = mid;
+    }
+    else
+    {
+      high = mid - 1;
+    }
+  }
+  
+  return (low);
+}
+
+static bool AtLineBegin(const Buffer& buffer, u32 pos)
+{
+  return (!pos || buffer.At(pos - 1).m_Codepoint == '\n');
+}
+
+static int  CompareRanges(const void* lhs, const void* rhs)
+{
+  u32 lhsLower  = ((const RegexRange*)lhs)->m_Lower;
+  u32 rhsLower  = ((const RegexRange*)rhs)->m_Lower;
+  return ((lhsLower > rhsLower) - (lhsLower < rhsLower));
+}
+
+static int  CompareNodes(const void* lhs, const void* rhs)
+{
+  u32 lhsNode = *(const u32*)lhs;
+  u32 rhsNode = *(const u32*)rhs;
+  return ((lhsNode > rhsNode) - (lhsNode < rhsNode));
+}
@@ -0,0 +1,115 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#pragma once
+
+#include <Buffer.hh>
+#include <Encoding.hh>
+#include <Util.hh>
+
+constexpr u32 REGEX_CACHE_SIZE  = 8;
+constexpr u32 REGEX_MAX_STATES  = 4096;
+constexpr u32 REGEX_MAX_NODES   = 65536;
+constexpr u32 REGEX_MAX_REPEAT  = 1000;
+constexpr u32 REGEX_UNKNOWN     = UINT32_MAX;
+
+enum RegexNodeType : u8
+{
+  REGEX_SET = 0,
+  REGEX_SPLIT,
+  REGEX_AT_START, // the scan started on a line boundary
+  REGEX_AT_END,   // the scan is on a line boundary
+  REGEX_MATCH
+};
+
+struct RegexNode
+{
+  RegexNodeType m_Type        {};
+  u32           m_Next        {};
+  u32           m_Alternative {}; // only for splits
+  u32           m_Set         {}; // only for sets
+};
+
+// Thompson NFA of a pattern, read either forwards or backwards; backwards, the pattern is reversed, and line begins
+// and ends swap roles, so that the same scans work in both directions
+struct RegexProgram
+{
+  RegexNode*  m_Nodes;
+  u32         m_NNodes;
+  u32         m_Capacity;
+  u32         m_Start;
+  
+  void  Free();
+};
+
+struct RegexState
+{
+  u32   m_Nodes;      // offset into the pool of the DFA
+  u32   m_NNodes;
+  u32   m_Hash;
+  bool  m_Match;      // a match ends at the scan position
+  bool  m_MatchAtEnd; // a match ends at the scan position if that's a line boundary
+};
+
+struct Regex;
+
+// DFA built lazily from a program, whose states are sets of the set, end and match nodes of the NFA; a transition is
+// only worked out the first time it's taken, and all states are dropped once there are REGEX_MAX_STATES of them, so
+// that no pattern can blow up the memory used; unanchored DFAs can start a match at any position
+struct RegexDFA
+{
+  const Regex*        m_Regex;
+  const RegexProgram* m_Program;
+  bool                m_Unanchored;
+  RegexState*         m_States;     // the first state is the dead one
+  u32                 m_NStates;
+  u32                 m_StateCapacity;
+  u32*                m_Pool;
+  u32                 m_PoolSize;
+  u32                 m_PoolCapacity;
+  u32*                m_Transitions;  // m_NClasses per state
+  u32*                m_Table;        // open addressing of states by their nodes, by state index plus one
+  u32                 m_TableCapacity;
+  u32                 m_Starts[2];    // by whether the scan starts on a line boundary
+  u32*                m_Scratch;      // for sets being built and closures
+  u32*                m_Stack;
+  u32*                m_Marks;
+  u32                 m_Generation;
+  
+  void  Init(const Regex* regex, const RegexProgram* program, bool unanchored);
+  void  Free();
+  void  Clear();
+  u32   Start(bool boundary);
+  u32   Step(u32 state, u32 cls);
+  u32   StepSlow(u32 state, u32 cls);
+  void  Closure(u32 node, bool boundary, IN_OUT u32& n);
+  bool  MatchesAtEnd(u32 n);
+  u32   AddState(const u32* nodes, u32 n);
+};
+
+// compiled pattern; matches never span lines, since neither the wildcard nor any class matches a newline, which
+// bounds the work done to find where a match starts and ends; the codepoints are split into classes which no set
+// tells apart, and DFA transitions are by class
+struct Regex
+{
+  EString       m_Pattern;
+  u32*          m_Boundaries; // class k holds the codepoints from m_Boundaries[k] up to the next boundary
+  u32           m_NClasses;
+  u32           m_ASCIIClasses[128];
+  u64*          m_Sets;       // class bits of every set, m_SetWords each
+  u32           m_SetWords;
+  RegexProgram  m_Forward;
+  RegexProgram  m_Reverse;
+  RegexDFA      m_Search;         // forwards, for the earliest end of any match
+  RegexDFA      m_Match;          // forwards, anchored, for the end of the longest match
+  RegexDFA      m_ReverseSearch;  // backwards, for the starts of matches
+  
+  u32   Class(u32 codepoint) const;
+  bool  InSet(u32 set, u32 cls) const;
+  void  Free();
+};
+
+Regex*  CachedRegex(const EString& pattern);
+bool    FindRegexForward(const Buffer& buffer, Regex& regex, u32 lb, u32 ub, OUT u32& matchLb, OUT u32& matchUb);
+bool    FindRegexReverse(const Buffer& buffer, Regex& regex, u32 lb, u32 ub, OUT u32& matchLb, OUT u32& matchUb);
+u32     FindRegexStarts(const Buffer& buffer, Regex& regex, u32 lb, u32 ub, IN_OUT u32*& starts, IN_OUT u32& capacity);
+bool    MatchRegexAt(const Buffer& buffer, Regex& regex, u32 pos, u32 ub, OUT u32& matchUb);
@@ -1,8 +1,10 @@
 // SPDX-License-Identifier: GPL-3.0-or-later
 
+#include <cerrno>
 #include <csignal>
 #include <cstdio>
 #include <cstdlib>
+#include <cstring>
 #include <Prompt.hh>
 #include <Render.hh>
 
@@ -12,11 +14,28 @@ extern "C"
 #include <termios.h>
 }
 
+static void ComposeCell(u32 i, u32 barHeight, OUT EChar& ch, OUT Color& color);
+static void PresentCell(u32 i, EChar ch, Color color);
+static void PresentString(const char* str);
+static void PresentBytes(const char* data, usize size);
+static void FlushOutput();
+static void MoveCursor(u32 x, u32 y);
 static void ApplyColor(Color color);
 static void SIGWINCHHandler(int arg);
 
+RenderStats g_RenderStats;
+
 static EChar*         g_CellChars;
 static Color*         g_CellColors;
+static EChar*         g_ShownChars;   // what the terminal currently displays
+static Color*         g_ShownColors;
+static bool           g_ShownValid;
+static Color          g_ShownColor;   // last color applied to the terminal
+static u32            g_ShownX;       // terminal cursor position, -1 if unknown
+static u32            g_ShownY;
+static char*          g_Output;       // a whole frame's worth of terminal output
+static usize          g_OutputSize;
+static usize          g_OutputCapacity;
 static u32            g_Width;
 static u32            g_Height;
 static struct termios g_OldTermIOS;
@@ -43,7 +62,9 @@ i32 InitRender()
   
   setvbuf(stdin, nullptr, _IONBF, 0);
   
-  printf("\x1b[?25l");
+  // pastes are wrapped in escape sequences, so that they can be inserted at once rather than typed key by key
+  printf("\x1b[?25l\x1b[?2004h");
+  fflush(stdout);
   
   struct winsize  winSize {};
   ioctl(0, TIOCGWINSZ, &winSize);
@@ -52,6 +73,9 @@ i32 InitRender()
   
   g_CellChars = (EChar*)calloc(g_Width * g_Height, sizeof(EChar));
   g_CellColors = (Color*)calloc(g_Width * g_Height, sizeof(Color));
+  g_ShownChars = (EChar*)calloc(g_Width * g_Height, sizeof(EChar));
+  g_ShownColors = (Color*)calloc(g_Width * g_Height, sizeof(Color));
+  g_ShownValid = false;
   
   struct sigaction  sigAction {};
   sigaction(SIGWINCH, nullptr, &sigAction);
@@ -63,7 +87,7 @@ i32 InitRender()
 
 void  QuitRender(bool clearScreen)
 {
-  printf("\x1b[?25h\x1b[0m\r");
+  printf("\x1b[?2004l\x1b[?25h\x1b[0m\r");
   
   if (clearScreen)
   {
@@ -186,45 +210,76 @@ void  RenderPresent()
   // allow cursor to be drawn on newline if width is exceeded
   u32 barHeight = g_BarHeight + ((u32)g_Prompt.m_Cursor >= g_Prompt.m_Data.m_Length && g_Prompt.m_Cursor % g_Width == 0);
   
-  fputs("\x1b[H\x1b[0m", stdout);
+  g_ShownX = -1;
+  g_ShownY = -1;
+  
+  // terminals supporting synchronized updates hold off on displaying the frame until it's complete
+  g_OutputSize = 0;
+  PresentString("\x1b[?2026h");
+  usize emptySize = g_OutputSize;
   
-  // draw out the bar
-  ApplyColor(g_Options.m_Global);
-  for (usize i = 0; i < g_Width * barHeight; ++i)
+  // nothing about the terminal is known after a resize, so everything is drawn again
+  if (!g_ShownValid)
   {
-    if ((i64)i == g_Prompt.m_Cursor)
+    PresentString("\x1b[0m");
+    g_ShownColor = Color{};
+    ApplyColor(g_ShownColor);
+  }
+  
+  for (u32 i = 0; i < g_Width * g_Height; ++i)
+  {
+    EChar ch    {};
+    Color color {};
+    ComposeCell(i, barHeight, ch, color);
+    
+    if (g_ShownValid
+        && ch.m_Codepoint == g_ShownChars[i].m_Codepoint
+        && color.m_FG == g_ShownColors[i].m_FG
+        && color.m_BG == g_ShownColors[i].m_BG)
     {
-      ApplyColor(g_Options.m_GlobalCursor);
+      continue;
     }
     
-    if (i < g_Bar.m_Length)
+    u32 x = i % g_Width;
+    u32 y = i / g_Width;
+    
+    // a few unchanged ASCII cells are cheaper to print again than to move the cursor over
+    bool  reprint = g_ShownY == y && g_ShownX < x && x - g_ShownX <= 4;
+    for (u32 j = g_ShownX; reprint && j < x; ++j)
     {
-      PrintEChar(g_Bar.m_Data[i]);
+      reprint = g_ShownChars[y * g_Width + j].m_Codepoint < 0x80;
     }
-    else
+    
+    if (reprint)
     {
-      fputc(' ', stdout);
+      for (u32 j = y * g_Width + g_ShownX; j < i; ++j)
+      {
+        PresentCell(j, g_ShownChars[j], g_ShownColors[j]);
+      }
     }
-    
-    if ((i64)i == g_Prompt.m_Cursor)
+    else if (g_ShownX != x || g_ShownY != y)
     {
-      ApplyColor(g_Options.m_Global);
+      MoveCursor(x, y);
     }
+    
+    PresentCell(i, ch, color);
   }
   
-  // draw out the rendered frame
-  Color color {};
-  ApplyColor(color);
-  for (usize i = 0; i < g_Width * (g_Height - barHeight); ++i)
+  g_ShownValid = true;
+  
+  if (g_OutputSize > emptySize)
   {
-    if (g_CellColors[i].m_FG != color.m_FG || g_CellColors[i].m_BG != color.m_BG)
-    {
-      color = g_CellColors[i];
-      ApplyColor(color);
-    }
-    
-    PrintEChar(g_CellChars[i]);
+    PresentString("\x1b[?2026l");
+    FlushOutput();
   }
+  else
+  {
+    g_OutputSize = 0;
+  }
+  
+  ++g_RenderStats.m_Frames;
+  g_RenderStats.m_LastBytes = g_OutputSize;
+  g_RenderStats.m_Bytes += g_OutputSize;
 }
 
 void  WindowSize(OUT u32& width, OUT u32& height)
@@ -249,6 +304,89 @@ void  RenderBar(const char* str)
   g_BarHeight += !g_BarHeight;
 }
 
+// the screen as it should be presented, with the bar on top of the rendered frames
+static void ComposeCell(u32 i, u32 barHeight, OUT EChar& ch, OUT Color& color)
+{
+  if (i < g_Width * barHeight)
+  {
+    ch = i < g_Bar.m_Length ? g_Bar.m_Data[i] : EChar{(u32)' '};
+    color = (i64)i == g_Prompt.m_Cursor ? g_Options.m_GlobalCursor : g_Options.m_Global;
+  }
+  else
+  {
+    ch = g_CellChars[i - g_Width * barHeight];
+    color = g_CellColors[i - g_Width * barHeight];
+  }
+}
+
+static void PresentCell(u32 i, EChar ch, Color color)
+{
+  if (color.m_FG != g_ShownColor.m_FG || color.m_BG != g_ShownColor.m_BG)
+  {
+    g_ShownColor = color;
+    ApplyColor(color);
+  }
+  
+  // an empty cell would leave the cursor in place, so draw something to keep the position known
+  ch = ch.m_Codepoint ? ch : EChar{(u32)' '};
+  PresentBytes(ch.m_Encoding, ch.EncodingLength());
+  
+  g_ShownChars[i] = ch;
+  g_ShownColors[i] = color;
+  
+  // non-ASCII characters may be wider than a cell, and the last column leaves the cursor pending a wrap
+  u32 x = i % g_Width;
+  g_ShownX = ch.m_Codepoint < 0x80 && x + 1 < g_Width ? x + 1 : -1;
+}
+
+static void PresentString(const char* str)
+{
+  PresentBytes(str, strlen(str));
+}
+
+static void PresentBytes(const char* data, usize size)
+{
+  if (g_OutputSize + size > g_OutputCapacity)
+  {
+    g_OutputCapacity = g_OutputCapacity ? g_OutputCapacity : 4096;
+    while (g_OutputSize + size > g_OutputCapacity)
+    {
+      g_OutputCapacity *= 2;
+    }
+    g_Output = (char*)realloc(g_Output, g_OutputCapacity);
+  }
+  
+  memcpy(&g_Output[g_OutputSize], data, size);
+  g_OutputSize += size;
+}
+
+static void FlushOutput()
+{
+  // a single write normally suffices, but a terminal can still accept less than a whole frame
+  for (usize written = 0; written < g_OutputSize;)
+  {
+    isize n = write(STDOUT_FILENO, &g_Output[written], g_OutputSize - written);
+    if (n < 0 && errno != EINTR)
+    {
+      Error("Render: Failed to write frame to the terminal!");
+      g_ShownValid = false;
+      return;
+    }
+    
+    written += n > 0 ? n : 0;
+  }
+}
+
+static void MoveCursor(u32 x, u32 y)
+{
+  char  buffer[32]  {};
+  snprintf(buffer, sizeof(buffer), "\x1b[%u;%uH", y + 1, x + 1);
+  PresentString(buffer);
+  
+  g_ShownX = x;
+  g_ShownY = y;
+}
+
 static void ApplyColor(Color color)
 {
   u8  fg0 = color.m_FG % 10;
@@ -267,7 +405,7 @@ static void ApplyColor(Color color)
   buffer[19]  += bg1;
   buffer[20]  += bg0;
   
-  fputs(buffer, stdout);
+  PresentString(buffer);
 }
 
 static void SIGWINCHHandler(int arg)
@@ -282,6 +420,9 @@ static void SIGWINCHHandler(int arg)
   
   g_CellChars = (EChar*)reallocarray(g_CellChars, g_Width * g_Height, sizeof(EChar));
   g_CellColors = (Color*)reallocarray(g_CellColors, g_Width * g_Height, sizeof(Color));
+  g_ShownChars = (EChar*)reallocarray(g_ShownChars, g_Width * g_Height, sizeof(EChar));
+  g_ShownColors = (Color*)reallocarray(g_ShownColors, g_Width * g_Height, sizeof(Color));
+  g_ShownValid = false;
   
   RenderBar(g_Bar.Copy()); // recompute bar
 }
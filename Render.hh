@@ -6,6 +6,15 @@
 #include <Options.hh>
 #include <Util.hh>
 
+struct RenderStats
+{
+  u64 m_Frames;
+  u64 m_Bytes;
+  u64 m_LastBytes;  // bytes written by the last presented frame
+};
+
+extern RenderStats  g_RenderStats;
+
 i32   InitRender();
 void  QuitRender(bool clearScreen);
 void  RenderFill(EChar ch, u32 x, u32 y, u32 w, u32 h);
@@ -0,0 +1,724 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include <cstdlib>
+#include <cstring>
+#include <Regex.hh>
+#include <Search.hh>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// AVX2 is only chosen at runtime over SSE2
+#if defined(__x86_64__) && defined(__SSE2__)
+#include <immintrin.h>
+#define SEARCH_DISPATCH
+#endif
+
+using FindBytesFn = const u8* (*)(const u8*, const u8*, const SearchNeedle&);
+
+static const u8*  FindBytes(const u8* begin, const u8* end, const SearchNeedle& needle);
+static const u8*  FindBytesReverse(const u8* begin, const u8* end, const SearchNeedle& needle);
+static const u8*  FilterScalar(const u8* begin, const u8* end, const SearchNeedle& needle);
+static const u8*  FilterReverseScalar(const u8* begin, const u8* end, const SearchNeedle& needle);
+static const u8*  Horspool(const u8* begin, const u8* end, const SearchNeedle& needle);
+static const u8*  HorspoolReverse(const u8* begin, const u8* end, const SearchNeedle& needle);
+static void       FindMatches(const Buffer& buffer, const MatchIndex& index, u32 lb, u32 ub, IN_OUT SearchMatch*& matches,
+                              IN_OUT u32& nMatches, IN_OUT u32& capacity);
+static u32        FirstMatchFrom(const MatchIndex& index, u32 pos);
+static u64        SpanWindow(const Buffer& buffer, u32 piece, u64 from, u64 to, const BufferCursor& end,
+                             const SearchNeedle& needle, OUT u8* window, OUT u64& size);
+#ifdef __SSE2__
+static const u8*  FilterSSE2(const u8* begin, const u8* end, const SearchNeedle& needle);
+static const u8*  FilterReverseSSE2(const u8* begin, const u8* end, const SearchNeedle& needle);
+#endif
+#ifdef SEARCH_DISPATCH
+static const u8*  FilterAVX2(const u8* begin, const u8* end, const SearchNeedle& needle);
+static const u8*  FilterReverseAVX2(const u8* begin, const u8* end, const SearchNeedle& needle);
+#endif
+
+void  SearchNeedle::Free()
+{
+  free(m_Data);
+}
+
+void  CompileNeedle(OUT SearchNeedle& needle, const EString& str)
+{
+  needle.m_Length = str.m_Length;
+  needle.m_Size = 0;
+  for (u32 i = 0; i < str.m_Length; ++i)
+  {
+    needle.m_Size += str.m_Data[i].EncodingLength();
+  }
+  
+  needle.m_Data = (u8*)malloc(needle.m_Size ? needle.m_Size : 1);
+  for (u64 i = 0, byte = 0; i < str.m_Length; ++i)
+  {
+    memcpy(&needle.m_Data[byte], str.m_Data[i].m_Encoding, str.m_Data[i].EncodingLength());
+    byte += str.m_Data[i].EncodingLength();
+  }
+  
+  // a window is shifted forwards until its last byte lines up with the rightmost other occurrence in the needle, and
+  // backwards until its first byte lines up with the leftmost other occurrence
+  for (u32 i = 0; i < 256; ++i)
+  {
+    needle.m_Skip[i] = needle.m_Size;
+    needle.m_ReverseSkip[i] = needle.m_Size;
+  }
+  
+  for (u64 i = 0; i + 1 < needle.m_Size; ++i)
+  {
+    needle.m_Skip[needle.m_Data[i]] = needle.m_Size - 1 - i;
+  }
+  
+  for (u64 i = needle.m_Size; i-- > 1;)
+  {
+    needle.m_ReverseSkip[needle.m_Data[i]] = i;
+  }
+}
+
+void  IncrementalSearch::Begin(const Buffer& buffer, u32 origin, bool reverse)
+{
+  *this = IncrementalSearch
+  {
+    .m_String   = {},
+    .m_Needle   = {},
+    .m_Reverse  = reverse,
+    .m_Origin   = origin,
+    .m_Bound    = buffer.m_Length,
+    .m_Next     = reverse ? origin : origin + 1,
+    .m_Match    = 0,
+    .m_Found    = false
+  };
+  CompileNeedle(m_Needle, m_String);
+}
+
+void  IncrementalSearch::Free()
+{
+  m_String.Free();
+  m_Needle.Free();
+}
+
+void  IncrementalSearch::Update(OWNS EString str)
+{
+  bool  extended  = str.m_Length >= m_String.m_Length;
+  for (u32 i = 0; extended && i < m_String.m_Length; ++i)
+  {
+    extended = str.m_Data[i].m_Codepoint == m_String.m_Data[i].m_Codepoint;
+  }
+  
+  if (extended && str.m_Length == m_String.m_Length)
+  {
+    str.Free();
+    return;
+  }
+  
+  if (!extended || !m_String.m_Length)
+  {
+    m_Next = m_Reverse ? m_Origin : m_Origin + 1;
+  }
+  else if (m_Found)
+  {
+    m_Next = m_Reverse ? m_Match + 1 : m_Match;
+  }
+  
+  m_Found = false;
+  m_String.Free();
+  m_String = str;
+  m_Needle.Free();
+  CompileNeedle(m_Needle, m_String);
+}
+
+// matches starting within the slice may end past it
+void  IncrementalSearch::Step(const Buffer& buffer)
+{
+  if (Done())
+  {
+    return;
+  }
+  
+  u32 overlap = m_Needle.m_Length - 1;
+  if (m_Reverse)
+  {
+    u32 lb  = m_Next > SEARCH_SLICE ? m_Next - SEARCH_SLICE : 0;
+    u32 ub  = m_Origin - m_Next > overlap ? m_Next + overlap : m_Origin;
+    m_Found = FindReverse(buffer, m_Needle, lb, ub, m_Match);
+    m_Next = m_Found ? m_Next : lb;
+  }
+  else
+  {
+    u32 sliceEnd  = m_Bound - m_Next > SEARCH_SLICE ? m_Next + SEARCH_SLICE : m_Bound;
+    u32 ub        = m_Bound - sliceEnd > overlap ? sliceEnd + overlap : m_Bound;
+    m_Found = FindForward(buffer, m_Needle, m_Next, ub, m_Match);
+    m_Next = m_Found ? m_Next : sliceEnd;
+  }
+}
+
+bool  IncrementalSearch::Done() const
+{
+  return (m_Found || !m_String.m_Length || (m_Reverse ? !m_Next : m_Next >= m_Bound));
+}
+
+void  MatchIndex::Free()
+{
+  m_String.Free();
+  m_Needle.Free();
+  free(m_Matches);
+  *this = MatchIndex{};
+}
+
+// small buffers are indexed right away
+void  MatchIndex::Reset(const Buffer& buffer, OWNS EString str, bool regex)
+{
+  Free();
+  m_String = str;
+  m_Regex = regex;
+  if (!regex)
+  {
+    CompileNeedle(m_Needle, m_String);
+  }
+  
+  Step(buffer);
+}
+
+// regex slices are stretched to the end of their last line, unless it goes on for more than another slice; a slice
+// ending inside a line carries on after the last match found in it, since regex matches don't overlap
+void  MatchIndex::Step(const Buffer& buffer)
+{
+  if (Done(buffer))
+  {
+    return;
+  }
+  
+  u32 to  = buffer.m_Length - m_Next > SEARCH_SLICE ? m_Next + SEARCH_SLICE : buffer.m_Length;
+  if (m_Regex)
+  {
+    u32 lineEnd = buffer.LineEnd(to);
+    if (lineEnd - to <= SEARCH_SLICE)
+    {
+      to = lineEnd < buffer.m_Length ? lineEnd + 1 : buffer.m_Length;
+    }
+  }
+  
+  FindMatches(buffer, *this, m_Next, to, m_Matches, m_NMatches, m_Capacity);
+  m_Next = to;
+  if (m_Regex && m_NMatches && m_Matches[m_NMatches - 1].m_UpperBound > m_Next)
+  {
+    m_Next = m_Matches[m_NMatches - 1].m_UpperBound;
+  }
+}
+
+bool  MatchIndex::Done(const Buffer& buffer) const
+{
+  return (!m_String.m_Length || m_Next >= buffer.m_Length || m_NMatches >= SEARCH_MAX_MATCHES);
+}
+
+// called once the buffer was edited; only matches starting close enough to the edit to have changed are looked for
+// again, which for regexes are those on the lines it touched; lines longer than a slice are left to Step() instead
+void  MatchIndex::Edit(const Buffer& buffer, u32 pos, u32 inserted, u32 erased)
+{
+  if (!m_String.m_Length)
+  {
+    return;
+  }
+  
+  u32 lb  = 0;
+  u32 ub  = 0;
+  if (m_Regex)
+  {
+    u32 lineEnd = buffer.LineEnd(pos + inserted);
+    lb = buffer.LineBegin(pos);
+    ub = lineEnd < buffer.m_Length ? lineEnd + 1 : buffer.m_Length;
+  }
+  else
+  {
+    lb = pos >= m_Needle.m_Length ? pos + 1 - m_Needle.m_Length : 0;
+    ub = pos + inserted;
+  }
+  
+  // before the edit, the same starts went up to here
+  u32 oldUb = ub - inserted + erased;
+  u32 first = FirstMatchFrom(*this, lb);
+  if (oldUb > m_Next || (m_Regex && ub - lb > SEARCH_SLICE))
+  {
+    m_NMatches = first;
+    m_Next = lb < m_Next ? lb : m_Next;
+    return;
+  }
+  
+  u32 last  = FirstMatchFrom(*this, oldUb);
+  for (u32 i = last; i < m_NMatches; ++i)
+  {
+    m_Matches[i].m_LowerBound = m_Matches[i].m_LowerBound + inserted - erased;
+    m_Matches[i].m_UpperBound = m_Matches[i].m_UpperBound + inserted - erased;
+  }
+  m_Next = m_Next + inserted - erased;
+  
+  SearchMatch*  found       = nullptr;
+  u32           nFound      = 0;
+  u32           foundCap    = 0;
+  FindMatches(buffer, *this, lb, ub, found, nFound, foundCap);
+  
+  u32 nMatches  = m_NMatches - (last - first) + nFound;
+  if (nMatches > m_Capacity)
+  {
+    while (nMatches > m_Capacity)
+    {
+      m_Capacity = m_Capacity ? 2 * m_Capacity : 1;
+    }
+    m_Matches = (SearchMatch*)reallocarray(m_Matches, m_Capacity, sizeof(SearchMatch));
+  }
+  
+  if (m_NMatches > last)
+  {
+    memmove(&m_Matches[first + nFound], &m_Matches[last], sizeof(SearchMatch) * (m_NMatches - last));
+  }
+  
+  if (nFound)
+  {
+    memcpy(&m_Matches[first], found, sizeof(SearchMatch) * nFound);
+  }
+  
+  m_NMatches = nMatches;
+  free(found);
+}
+
+// gives the first match ending after pos, which is the one holding pos if there is one
+u32 MatchIndex::Find(u32 pos) const
+{
+  u32 low   = 0;
+  u32 high  = m_NMatches;
+  while (low < high)
+  {
+    u32 mid = (low + high) / 2;
+    if (m_Matches[mid].m_UpperBound <= pos)
+    {
+      low = mid + 1;
+    }
+    else
+    {
+      high = mid;
+    }
+  }
+  
+  return (low);
+}
+
+// finds the first match starting at or after lb and ending at or before ub; pieces are searched in place, and matches
+// spanning pieces are found in a small window copied from around the end of each piece
+bool  FindForward(const Buffer& buffer, const SearchNeedle& needle, u32 lb, u32 ub, OUT u32& pos)
+{
+  if (!needle.m_Size || !buffer.m_NPieces || lb > ub || ub - lb < needle.m_Length)
+  {
+    return (false);
+  }
+  
+  BufferCursor  begin   = buffer.Cursor(lb);
+  BufferCursor  end     = buffer.Cursor(ub);
+  u8*           window  = begin.m_Piece == end.m_Piece ? nullptr : (u8*)malloc(2 * needle.m_Size);
+  bool          found   = false;
+  for (u32 i = begin.m_Piece; i <= end.m_Piece && !found; ++i)
+  {
+    const Piece&  piece = buffer.m_Pieces[i];
+    const u8*     data  = buffer.SourceOf(piece).m_Data;
+    u64           from  = i == begin.m_Piece ? begin.m_Byte : piece.m_Byte;
+    u64           to    = i == end.m_Piece ? end.m_Byte : piece.m_Byte + piece.m_Size;
+    u32           start = i == begin.m_Piece ? lb : piece.m_Start;
+    
+    const u8* match = FindBytes(&data[from], &data[to], needle);
+    if (!match && i < end.m_Piece)
+    {
+      u64 size      = 0;
+      u64 overlap   = SpanWindow(buffer, i, from, to, end, needle, window, size);
+      u8* spanMatch = (u8*)FindBytes(window, &window[size], needle);
+      match = spanMatch ? &data[to - overlap + (spanMatch - window)] : nullptr;
+    }
+    
+    if (match)
+    {
+      pos = start + CountUTF8(&data[from], match - &data[from]);
+      found = true;
+    }
+  }
+  
+  free(window);
+  return (found);
+}
+
+// finds the last match starting at or after lb and ending at or before ub
+bool  FindReverse(const Buffer& buffer, const SearchNeedle& needle, u32 lb, u32 ub, OUT u32& pos)
+{
+  if (!needle.m_Size || !buffer.m_NPieces || lb > ub || ub - lb < needle.m_Length)
+  {
+    return (false);
+  }
+  
+  BufferCursor  begin   = buffer.Cursor(lb);
+  BufferCursor  end     = buffer.Cursor(ub);
+  u8*           window  = begin.m_Piece == end.m_Piece ? nullptr : (u8*)malloc(2 * needle.m_Size);
+  bool          found   = false;
+  for (u32 i = end.m_Piece + 1; i-- > begin.m_Piece && !found;)
+  {
+    const Piece&  piece = buffer.m_Pieces[i];
+    const u8*     data  = buffer.SourceOf(piece).m_Data;
+    u64           from  = i == begin.m_Piece ? begin.m_Byte : piece.m_Byte;
+    u64           to    = i == end.m_Piece ? end.m_Byte : piece.m_Byte + piece.m_Size;
+    u32           stop  = i == end.m_Piece ? ub : piece.m_Start + piece.m_Length;
+    
+    // matches spanning into the following pieces come after any within the piece
+    const u8* match = nullptr;
+    if (i < end.m_Piece)
+    {
+      u64 size      = 0;
+      u64 overlap   = SpanWindow(buffer, i, from, to, end, needle, window, size);
+      u8* spanMatch = (u8*)FindBytesReverse(window, &window[size], needle);
+      match = spanMatch ? &data[to - overlap + (spanMatch - window)] : nullptr;
+    }
+    
+    if (!match)
+    {
+      match = FindBytesReverse(&data[from], &data[to], needle);
+    }
+    
+    if (match)
+    {
+      pos = stop - CountUTF8(match, &data[to] - match);
+      found = true;
+    }
+  }
+  
+  free(window);
+  return (found);
+}
+
+static const u8*  FindBytes(const u8* begin, const u8* end, const SearchNeedle& needle)
+{
+  if (needle.m_Size > SEARCH_SHORT_NEEDLE)
+  {
+    return (Horspool(begin, end, needle));
+  }
+
+#ifdef SEARCH_DISPATCH
+  static const FindBytesFn  filter  = __builtin_cpu_supports("avx2") ? FilterAVX2 : FilterSSE2;
+  return (filter(begin, end, needle));
+#elif defined(__SSE2__)
+  return (FilterSSE2(begin, end, needle));
+#else
+  return (FilterScalar(begin, end, needle));
+#endif
+}
+
+static const u8*  FindBytesReverse(const u8* begin, const u8* end, const SearchNeedle& needle)
+{
+  if (needle.m_Size > SEARCH_SHORT_NEEDLE)
+  {
+    return (HorspoolReverse(begin, end, needle));
+  }
+
+#ifdef SEARCH_DISPATCH
+  static const FindBytesFn  filter  = __builtin_cpu_supports("avx2") ? FilterReverseAVX2 : FilterReverseSSE2;
+  return (filter(begin, end, needle));
+#elif defined(__SSE2__)
+  return (FilterReverseSSE2(begin, end, needle));
+#else
+  return (FilterReverseScalar(begin, end, needle));
+#endif
+}
+
+// also finishes the vector filters, for the positions left over from the last whole block
+static const u8*  FilterScalar(const u8* begin, const u8* end, const SearchNeedle& needle)
+{
+  u64 size  = needle.m_Size;
+  while ((u64)(end - begin) >= size)
+  {
+    const u8* candidate = (const u8*)memchr(begin, needle.m_Data[0], end - begin - size + 1);
+    if (!candidate)
+    {
+      return (nullptr);
+    }
+    
+    if (!memcmp(candidate + 1, needle.m_Data + 1, size - 1))
+    {
+      return (candidate);
+    }
+    begin = candidate + 1;
+  }
+  
+  return (nullptr);
+}
+
+static const u8*  FilterReverseScalar(const u8* begin, const u8* end, const SearchNeedle& needle)
+{
+  u64 size  = needle.m_Size;
+  while ((u64)(end - begin) >= size)
+  {
+    const u8* candidate = (const u8*)memrchr(begin, needle.m_Data[0], end - begin - size + 1);
+    if (!candidate)
+    {
+      return (nullptr);
+    }
+    
+    if (!memcmp(candidate + 1, needle.m_Data + 1, size - 1))
+    {
+      return (candidate);
+    }
+    end = candidate + size - 1;
+  }
+  
+  return (nullptr);
+}
+
+static const u8*  Horspool(const u8* begin, const u8* end, const SearchNeedle& needle)
+{
+  u64 size  = needle.m_Size;
+  u8  last  = needle.m_Data[size - 1];
+  for (u64 i = 0, n = end - begin; i + size <= n; i += needle.m_Skip[begin[i + size - 1]])
+  {
+    if (begin[i + size - 1] == last && !memcmp(&begin[i], needle.m_Data, size - 1))
+    {
+      return (&begin[i]);
+    }
+  }
+  
+  return (nullptr);
+}
+
+static const u8*  HorspoolReverse(const u8* begin, const u8* end, const SearchNeedle& needle)
+{
+  u64 size  = needle.m_Size;
+  u8  first = needle.m_Data[0];
+  for (u64 i = end - begin; i >= size; i -= needle.m_ReverseSkip[begin[i - size]])
+  {
+    if (begin[i - size] == first && !memcmp(&begin[i - size + 1], needle.m_Data + 1, size - 1))
+    {
+      return (&begin[i - size]);
+    }
+  }
+  
+  return (nullptr);
+}
+
+// appends the matches starting at or after lb and before ub; literal matches may end up to a needle's length short of a
+// character past ub, and regex ones up to SEARCH_SLICE past it, but never past their line; the starts of regex matches
+// on a line are all found with one scan backwards, and each is then matched forwards only as far as it goes
+static void FindMatches(const Buffer& buffer, const MatchIndex& index, u32 lb, u32 ub, IN_OUT SearchMatch*& matches,
+                        IN_OUT u32& nMatches, IN_OUT u32& capacity)
+{
+  Regex*  regex = index.m_Regex ? CachedRegex(index.m_String) : nullptr;
+  if (index.m_Regex && !regex)
+  {
+    return;
+  }
+  
+  u32 reach = index.m_Regex ? SEARCH_SLICE : index.m_Needle.m_Length - 1;
+  u32 end   = buffer.m_Length - ub > reach ? ub + reach : buffer.m_Length;
+  
+  auto  append  = [&](SearchMatch match)
+  {
+    if (nMatches >= capacity)
+    {
+      capacity = capacity ? 2 * capacity : 1;
+      matches = (SearchMatch*)reallocarray(matches, capacity, sizeof(SearchMatch));
+    }
+    matches[nMatches++] = match;
+  };
+  
+  if (!index.m_Regex)
+  {
+    u32 pos = lb;
+    while (pos < ub && FindForward(buffer, index.m_Needle, pos, end, pos) && pos < ub)
+    {
+      append(SearchMatch{.m_LowerBound = pos, .m_UpperBound = pos + index.m_Needle.m_Length});
+      ++pos;
+    }
+    return;
+  }
+  
+  u32*  starts    = nullptr;
+  u32   startCap  = 0;
+  for (u32 line = lb; line < ub;)
+  {
+    u32 lineEnd = buffer.LineEnd(line);
+    u32 bound   = lineEnd < end ? lineEnd : end;
+    u32 nStarts = FindRegexStarts(buffer, *regex, line, bound, starts, startCap);
+    
+    // the starts come last first; empty matches are skipped, and others rule out the starts inside them
+    for (u32 i = nStarts, pos = line; i-- > 0 && starts[i] < ub;)
+    {
+      SearchMatch match {.m_LowerBound = starts[i], .m_UpperBound = 0};
+      if (match.m_LowerBound < pos || !MatchRegexAt(buffer, *regex, match.m_LowerBound, bound, match.m_UpperBound)
+          || match.m_UpperBound == match.m_LowerBound)
+      {
+        continue;
+      }
+      
+      append(match);
+      pos = match.m_UpperBound;
+    }
+    
+    line = lineEnd + 1;
+  }
+  free(starts);
+}
+
+// gives the first match starting at or after pos
+static u32  FirstMatchFrom(const MatchIndex& index, u32 pos)
+{
+  u32 low   = 0;
+  u32 high  = index.m_NMatches;
+  while (low < high)
+  {
+    u32 mid = (low + high) / 2;
+    if (index.m_Matches[mid].m_LowerBound < pos)
+    {
+      low = mid + 1;
+    }
+    else
+    {
+      high = mid;
+    }
+  }
+  
+  return (low);
+}
+
+// copies the last bytes of a piece range, short of a whole needle, followed by as many bytes from the pieces after it
+// as are left in the search, up to a needle's length short of a byte; the number of bytes from the range is returned
+static u64  SpanWindow(const Buffer& buffer, u32 piece, u64 from, u64 to, const BufferCursor& end,
+                       const SearchNeedle& needle, OUT u8* window, OUT u64& size)
+{
+  u64 overlap = to - from < needle.m_Size - 1 ? to - from : needle.m_Size - 1;
+  memcpy(window, &buffer.SourceOf(buffer.m_Pieces[piece]).m_Data[to - overlap], overlap);
+  size = overlap;
+  
+  for (u32 i = piece + 1; i <= end.m_Piece && size < overlap + needle.m_Size - 1; ++i)
+  {
+    const Piece&  next    = buffer.m_Pieces[i];
+    u64           nextTo  = i == end.m_Piece ? end.m_Byte : next.m_Byte + next.m_Size;
+    u64           n       = nextTo - next.m_Byte;
+    if (n > overlap + needle.m_Size - 1 - size)
+    {
+      n = overlap + needle.m_Size - 1 - size;
+    }
+    
+    memcpy(&window[size], &buffer.SourceOf(next).m_Data[next.m_Byte], n);
+    size += n;
+  }
+  
+  return (overlap);
+}
+
+#ifdef __SSE2__
+// candidates are the positions where both the first and the last byte of the needle match, which are rare enough that
+// comparing the bytes in between costs little
+static const u8*  FilterSSE2(const u8* begin, const u8* end, const SearchNeedle& needle)
+{
+  const __m128i first = _mm_set1_epi8(needle.m_Data[0]);
+  const __m128i last  = _mm_set1_epi8(needle.m_Data[needle.m_Size - 1]);
+  
+  u64 size  = needle.m_Size;
+  u64 i     = 0;
+  for (u64 n = end - begin; i + size - 1 + 16 <= n; i += 16)
+  {
+    __m128i firstBytes  = _mm_loadu_si128((const __m128i*)&begin[i]);
+    __m128i lastBytes   = _mm_loadu_si128((const __m128i*)&begin[i + size - 1]);
+    u32     candidates  = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(firstBytes, first),
+                                                          _mm_cmpeq_epi8(lastBytes, last)));
+    for (; candidates; candidates &= candidates - 1)
+    {
+      const u8* candidate = &begin[i + __builtin_ctz(candidates)];
+      if (!memcmp(candidate + 1, needle.m_Data + 1, size - 1))
+      {
+        return (candidate);
+      }
+    }
+  }
+  
+  return (FilterScalar(&begin[i], end, needle));
+}
+
+// blocks are taken from the end, and candidates within a block from the highest
+static const u8*  FilterReverseSSE2(const u8* begin, const u8* end, const SearchNeedle& needle)
+{
+  const __m128i first = _mm_set1_epi8(needle.m_Data[0]);
+  const __m128i last  = _mm_set1_epi8(needle.m_Data[needle.m_Size - 1]);
+  
+  u64 size  = needle.m_Size;
+  u64 i     = end - begin;  // end of the candidate positions left
+  for (; i >= size - 1 + 16; i -= 16)
+  {
+    const u8* block       = &begin[i - size + 1 - 16];
+    __m128i   firstBytes  = _mm_loadu_si128((const __m128i*)block);
+    __m128i   lastBytes   = _mm_loadu_si128((const __m128i*)&block[size - 1]);
+    u32       candidates  = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(firstBytes, first),
+                                                            _mm_cmpeq_epi8(lastBytes, last)));
+    for (; candidates; candidates &= ~(1u << (31 - __builtin_clz(candidates))))
+    {
+      const u8* candidate = &block[31 - __builtin_clz(candidates)];
+      if (!memcmp(candidate + 1, needle.m_Data + 1, size - 1))
+      {
+        return (candidate);
+      }
+    }
+  }
+  
+  return (FilterReverseScalar(begin, &begin[i], needle));
+}
+#endif
+
+#ifdef SEARCH_DISPATCH
+__attribute__((target("avx2")))
+static const u8*  FilterAVX2(const u8* begin, const u8* end, const SearchNeedle& needle)
+{
+  const __m256i first = _mm256_set1_epi8(needle.m_Data[0]);
+  const __m256i last  = _mm256_set1_epi8(needle.m_Data[needle.m_Size - 1]);
+  
+  u64 size  = needle.m_Size;
+  u64 i     = 0;
+  for (u64 n = end - begin; i + size - 1 + 32 <= n; i += 32)
+  {
+    __m256i firstBytes  = _mm256_loadu_si256((const __m256i*)&begin[i]);
+    __m256i lastBytes   = _mm256_loadu_si256((const __m256i*)&begin[i + size - 1]);
+    u32     candidates  = _mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(firstBytes, first),
+                                                                _mm256_cmpeq_epi8(lastBytes, last)));
+    for (; candidates; candidates &= candidates - 1)
+    {
+      const u8* candidate = &begin[i + __builtin_ctz(candidates)];
+      if (!memcmp(candidate + 1, needle.m_Data + 1, size - 1))
+      {
+        return (candidate);
+      }
+    }
+  }
+  
+  return (FilterScalar(&begin[i], end, needle));
+}
+
+__attribute__((target("avx2")))
+static const u8*  FilterReverseAVX2(const u8* begin, const u8* end, const SearchNeedle& needle)
+{
+  const __m256i first = _mm256_set1_epi8(needle.m_Data[0]);
+  const __m256i last  = _mm256_set1_epi8(needle.m_Data[needle.m_Size - 1]);
+  
+  u64 size  = needle.m_Size;
+  u64 i     = end - begin;
+  for (; i >= size - 1 + 32; i -= 32)
+  {
+    const u8* block       = &begin[i - size + 1 - 32];
+    __m256i   firstBytes  = _mm256_loadu_si256((const __m256i*)block);
+    __m256i   lastBytes   = _mm256_loadu_si256((const __m256i*)&block[size - 1]);
+    u32       candidates  = _mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(firstBytes, first),
+                                                                  _mm256_cmpeq_epi8(lastBytes, last)));
+    for (; candidates; candidates &= ~(1u << (31 - __builtin_clz(candidates))))
+    {
+      const u8* candidate = &block[31 - __builtin_clz(candidates)];
+      if (!memcmp(candidate + 1, needle.m_Data + 1, size - 1))
+      {
+        return (candidate);
+      }
+    }
+  }
+  
+  return (FilterReverseScalar(begin, &begin[i], needle));
+}
+#endif
@@ -0,0 +1,78 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#pragma once
+
+#include <Buffer.hh>
+#include <Encoding.hh>
+#include <Util.hh>
+
+constexpr u64 SEARCH_SHORT_NEEDLE = 32;
+constexpr u32 SEARCH_SLICE        = 1 << 22;
+constexpr u32 SEARCH_MAX_MATCHES  = 1 << 24;
+
+// literal needle, matched on its UTF-8 encoding directly in the sources of a buffer; both are well-formed, so a match
+// of the bytes always starts and ends on character boundaries; needles of up to SEARCH_SHORT_NEEDLE bytes are found
+// by filtering on their first and last bytes with vectors, and longer ones with Horspool skip tables
+struct SearchNeedle
+{
+  u8*   m_Data;
+  u64   m_Size;
+  u32   m_Length;
+  u32   m_Skip[256];        // shift of a window by its last byte, when searching forwards
+  u32   m_ReverseSkip[256]; // shift of a window by its first byte, when searching backwards
+  
+  void  Free();
+};
+
+// search redone as its string is typed, a slice of at most SEARCH_SLICE starting positions at a time; forwards, the
+// match is looked for after the origin, and backwards, before it; extending the string can't give a match before the
+// last one, or before the positions already ruled out, so the search carries on from there
+struct IncrementalSearch
+{
+  EString       m_String;
+  SearchNeedle  m_Needle;
+  bool          m_Reverse;
+  u32           m_Origin;
+  u32           m_Bound;  // forwards, the length of the searched buffer
+  u32           m_Next;   // forwards, the first start not ruled out; backwards, the one after the last
+  u32           m_Match;
+  bool          m_Found;
+  
+  void  Begin(const Buffer& buffer, u32 origin, bool reverse);
+  void  Free();
+  void  Update(OWNS EString str);
+  void  Step(const Buffer& buffer);
+  bool  Done() const;
+};
+
+struct SearchMatch
+{
+  u32 m_LowerBound;
+  u32 m_UpperBound;
+};
+
+// matches of the last search made in a frame, in ascending order; they're found a slice at a time while the editor is
+// idle, and patched on every edit by looking again around it; literal matches may overlap, while regex ones follow
+// each other like repeated searches would, and empty ones are left out; no more are looked for once there are
+// SEARCH_MAX_MATCHES of them
+struct MatchIndex
+{
+  EString       m_String;   // empty if there's no search to highlight
+  SearchNeedle  m_Needle;   // only for literal searches
+  bool          m_Regex;
+  SearchMatch*  m_Matches;
+  u32           m_NMatches;
+  u32           m_Capacity;
+  u32           m_Next;     // every match starting before this was found
+  
+  void  Free();
+  void  Reset(const Buffer& buffer, OWNS EString str, bool regex);
+  void  Step(const Buffer& buffer);
+  bool  Done(const Buffer& buffer) const;
+  void  Edit(const Buffer& buffer, u32 pos, u32 inserted, u32 erased);
+  u32   Find(u32 pos) const;
+};
+
+void  CompileNeedle(OUT SearchNeedle& needle, const EString& str);
+bool  FindForward(const Buffer& buffer, const SearchNeedle& needle, u32 lb, u32 ub, OUT u32& pos);
+bool  FindReverse(const Buffer& buffer, const SearchNeedle& needle, u32 lb, u32 ub, OUT u32& pos);
@@ -11,6 +11,7 @@
 extern "C"
 {
 #include <sys/stat.h>
+#include <time.h>
 }
 
 void  Info(const char* fmt, ...)
@@ -197,3 +198,11 @@ void  TruncateCString(char* str, usize maxLength)
   }
   str[maxLength] = 0;
 }
+
+// in nanoseconds
+u64 MonotonicTime()
+{
+  timespec  now {};
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return ((u64)now.tv_sec * 1000000000 + now.tv_nsec);
+}
@@ -37,3 +37,4 @@ i32         CreateFile(const char* path);
 const char* FileExtension(const char *path);
 void        AppendCString(char* dst, usize dstSize, const char* src);
 void        TruncateCString(char* str, usize maxLength);
+u64         MonotonicTime();
@@ -35,4 +35,15 @@ int main(int argc, char* argv[])
   
   EditorLoop();
   QuitRender(true);
+  
+  if (g_Args.m_RenderStats)
+  {
+    fprintf(
+      stderr,
+      "Presented %lu frames, %lu bytes (%lu bytes per frame)\n",
+      g_RenderStats.m_Frames,
+      g_RenderStats.m_Bytes,
+      g_RenderStats.m_Frames ? g_RenderStats.m_Bytes / g_RenderStats.m_Frames : 0
+    );
+  }
 }
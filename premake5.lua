@@ -11,6 +11,7 @@ workspace "nimped++"
     objdir "obj/%{cfg.buildcfg}"
     files {"**.hh", "**.cc"}
     includedirs "."
+    links "pthread"
     
     warnings "Extra"
     